@@ -22,124 +22,3036 @@
  *
  */
 
+#define _GNU_SOURCE /* For fallocate and MADV_REMOVE */
 #include "shm_ringbuffers.h"
+#include <errno.h>
 #include <fcntl.h> /* For O_* constants */
+#include <inttypes.h>
+#include <limits.h>
+#include <sched.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h> /* For mode constants, and fstat */
+#include <time.h>
 #include <unistd.h>
+#ifdef __x86_64__
+#include <immintrin.h>
+#define SRB_X86_STREAMING
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__aarch64__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#define SRB_ARM_CRC32C
+#endif
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#endif
 
-unsigned int get_aligned_size(unsigned int in_size)
+// Address space reserved past the initial segment, for added rings, kept small where the address space is too
+#if UINTPTR_MAX > 0xffffffffu
+#define SRB_SEGMENT_GROWTH ((uint64_t)64 << 30)
+#else
+#define SRB_SEGMENT_GROWTH ((uint64_t)256 << 20)
+#endif
+
+uint64_t get_aligned_size(uint64_t in_size)
+{
+    in_size /= 4096;
+    return 4096 * (in_size + 1);
+}
+
+uint64_t get_topic_ids_size(unsigned int num_buffers)
+{
+    // Padded to whole cache lines so each ring's topic ids can be scanned without sharing lines
+    return ((num_buffers * sizeof(uint16_t) + 63) / 64) * 64;
+}
+
+uint64_t get_timestamps_size(unsigned int num_buffers)
+{
+    return ((num_buffers * sizeof(uint64_t) + 63) / 64) * 64;
+}
+
+uint64_t get_checksums_size(unsigned int num_buffers)
+{
+    return ((num_buffers * sizeof(struct ShmBufferChecksum) + 63) / 64) * 64;
+}
+
+uint64_t get_dirty_tile_size(uint64_t buffer_size)
+{
+    uint64_t tile_size = 64;
+    while (tile_size * SRB_MAX_DIRTY_TILES < buffer_size) {
+        tile_size *= 2;
+    }
+    return tile_size;
+}
+
+uint64_t get_dirty_words(uint64_t buffer_size)
+{
+    uint64_t tile_size = get_dirty_tile_size(buffer_size);
+    return ((buffer_size + tile_size - 1) / tile_size + 63) / 64;
+}
+
+uint64_t get_dirty_size(uint64_t buffer_size, unsigned int num_buffers)
+{
+    return ((num_buffers * get_dirty_words(buffer_size) * sizeof(uint64_t) + 63) / 64) * 64;
+}
+
+uint64_t get_state_value_stride(uint64_t value_size)
+{
+    return ((value_size + 7) / 8) * 8;
+}
+
+uint64_t get_state_entry_size(uint64_t value_size)
+{
+    // Padded to whole cache lines so updating one key never disturbs readers of another
+    return ((sizeof(struct ShmStateEntryShared) + 2 * get_state_value_stride(value_size) + 63) / 64) * 64;
+}
+
+uint64_t get_monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int64_t get_monotonic_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+int64_t get_monotonic_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * ring_doorbell
+ *   Lets every ring set blocked on the segment know that something changed.
+ */
+static void ring_doorbell(struct ShmRingBuffersHead* head)
+{
+    __atomic_add_fetch(&head->doorbell, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&head->doorbell_waiters, __ATOMIC_SEQ_CST)) {
+#ifdef __linux__
+        syscall(SYS_futex, &head->doorbell, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+    }
+}
+
+/*
+ * wait_doorbell
+ *   Blocks for up to timeout_ms (-1 for no limit) while the doorbell still reads bell.
+ */
+static void wait_doorbell(struct ShmRingBuffersHead* head, unsigned int bell, int timeout_ms)
+{
+    __atomic_add_fetch(&head->doorbell_waiters, 1, __ATOMIC_SEQ_CST);
+#ifdef __linux__
+    struct timespec ts = { .tv_sec = timeout_ms / 1000, .tv_nsec = (timeout_ms % 1000) * 1000000L };
+    syscall(SYS_futex, &head->doorbell, FUTEX_WAIT, bell, (timeout_ms < 0) ? NULL : &ts, NULL, 0);
+#else
+    // No shared memory futex, fall back to polling the doorbell
+    if (__atomic_load_n(&head->doorbell, __ATOMIC_SEQ_CST) == bell) {
+        usleep(((timeout_ms < 0) || (timeout_ms > 1)) ? 1000 : timeout_ms * 1000);
+    }
+#endif
+    __atomic_sub_fetch(&head->doorbell_waiters, 1, __ATOMIC_SEQ_CST);
+}
+
+struct ShmBlockPoolShared* get_block_pool(struct ShmRingBuffersHead* head)
+{
+    if (head->block_pool_offset == 0) {
+        return NULL;
+    }
+    return (struct ShmBlockPoolShared*)((uint8_t*)head + head->block_pool_offset);
+}
+
+/*
+ * free_block
+ *   Pushes an unreferenced block onto the pool's free list.
+ */
+static void free_block(struct ShmBlockPoolShared* pool, uint32_t block)
+{
+    uint64_t head = __atomic_load_n(&pool->free_head, __ATOMIC_ACQUIRE);
+    uint64_t new_head;
+    do {
+        pool->block_states[block - 1].next_free = (uint32_t)head;
+        new_head = ((((head >> 32) + 1) << 32) | block); // Bump the tag so a concurrent pop can't be fooled by ABA
+    } while (!__atomic_compare_exchange_n(&pool->free_head, &head, new_head, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+}
+
+static void release_block(struct ShmBlockPoolShared* pool, uint32_t block)
+{
+    if (__atomic_sub_fetch(&pool->block_states[block - 1].refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+        free_block(pool, block);
+    }
+}
+
+/*
+ * try_acquire_block
+ *   Takes a reference to a block the caller does not hold a reference to, unless it is already free.
+ *
+ * returns:
+ *   non-zero if the reference was taken
+ */
+static int try_acquire_block(struct ShmBlockPoolShared* pool, uint32_t block)
+{
+    uint32_t* refcount = &pool->block_states[block - 1].refcount;
+    uint32_t count = __atomic_load_n(refcount, __ATOMIC_ACQUIRE);
+    do {
+        if (count == 0) {
+            return 0;
+        }
+    } while (!__atomic_compare_exchange_n(refcount, &count, count + 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    return 1;
+}
+
+/*
+ * release_pages
+ *   Releases the whole pages inside [start, end) of the shared memory, partial pages at either end are kept.
+ */
+static void release_pages(SRBHandle handle, uint64_t start, uint64_t end)
+{
+    uint64_t page_size = sysconf(_SC_PAGESIZE);
+    start = ((start + page_size - 1) / page_size) * page_size;
+    end = (end / page_size) * page_size;
+    if (end <= start) {
+        return;
+    }
+#ifdef FALLOC_FL_PUNCH_HOLE
+    if (fallocate(handle->shm_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, start, end - start) == 0) {
+        return;
+    }
+#endif
+#ifdef MADV_REMOVE
+    madvise(handle->mem_map + start, end - start, MADV_REMOVE);
+#endif
+}
+
+/*
+ * map_segment
+ *   Reserves max_size bytes of address space and maps the first size bytes of the segment at its start, so the
+ *   mapping can grow in place later without anything in it moving.
+ *
+ * returns:
+ *   the start of the mapping, or NULL on failure, including when max_size does not fit in this process's size_t
+ */
+static uint8_t* map_segment(int shm_fd, uint64_t size, uint64_t max_size)
+{
+    if ((max_size > SIZE_MAX) || (size > max_size)) {
+        return NULL;
+    }
+    uint8_t* m = (uint8_t*)mmap(NULL, max_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (m == MAP_FAILED) {
+        return NULL;
+    }
+    if (mmap(m, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, shm_fd, 0) == MAP_FAILED) {
+        munmap(m, max_size);
+        return NULL;
+    }
+    return m;
+}
+
+/*
+ * grow_mapping
+ *   Extends a handle's mapping to cover the first size bytes of the segment.
+ *
+ * returns:
+ *   0 on success, or -1 if size is past the head's max_size or could not be mapped
+ */
+static int grow_mapping(SRBHandle handle, uint64_t size)
+{
+    if (size <= handle->shm_size) {
+        return 0;
+    }
+    if (size > handle->ring_buffers_head->max_size) {
+        return -1;
+    }
+    uint64_t page_size = sysconf(_SC_PAGESIZE);
+    uint64_t start = (handle->shm_size / page_size) * page_size;
+    if (mmap(handle->mem_map + start, size - start, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, handle->shm_fd, start) == MAP_FAILED) {
+        return -1;
+    }
+    handle->shm_size = size;
+    return 0;
+}
+
+/*
+ * init_ring
+ *   Writes a new ring's shared state, and fills in its description and topic ids, in the segment at m.
+ */
+static void init_ring(uint8_t* m, struct ShmRingBufferShared* shared, struct ShmRingBufferDef* def, char* description, uint16_t* topic_ids, uint64_t* timestamps, struct ShmBufferChecksum* checksums, uint64_t* dirty_tiles, uint8_t* buffers)
+{
+    shared->num_buffers = def->num_buffers;
+    shared->buffer_size = def->buffer_size;
+    shared->write_ring_pos = def->num_buffers - 1;
+    shared->reclaim_state = SRB_RING_ACTIVE;
+    shared->reclaim_floor = 0;
+    shared->holds_blocks = 0;
+    shared->retired = 0;
+    shared->write_progress = 0;
+    if (def->multiplexed) {
+        shared->topic_ids_offset = (uint8_t*)topic_ids - m;
+        memset(topic_ids, 0, def->num_buffers * sizeof(uint16_t));
+    } else {
+        shared->topic_ids_offset = 0;
+    }
+    if (def->timestamped) {
+        shared->timestamps_offset = (uint8_t*)timestamps - m;
+        memset(timestamps, 0, def->num_buffers * sizeof(uint64_t));
+    } else {
+        shared->timestamps_offset = 0;
+    }
+    if (def->checksummed) {
+        shared->checksums_offset = (uint8_t*)checksums - m;
+        memset(checksums, 0, def->num_buffers * sizeof(struct ShmBufferChecksum));
+    } else {
+        shared->checksums_offset = 0;
+    }
+    if (def->dirty_tracked) {
+        shared->dirty_offset = (uint8_t*)dirty_tiles - m;
+        shared->dirty_tile_size = get_dirty_tile_size(def->buffer_size);
+        // Every tile of the first buffers is dirty, as there is nothing before them
+        memset(dirty_tiles, 0xff, def->num_buffers * get_dirty_words(def->buffer_size) * sizeof(uint64_t));
+    } else {
+        shared->dirty_offset = 0;
+        shared->dirty_tile_size = 0;
+    }
+    if (def->description) {
+        strcpy(description, def->description);
+    } else {
+        description[0] = 0; // zero length string for null src description
+    }
+    shared->description_offset = (uint8_t*)description - m;
+    shared->buffers_offset = buffers - m;
+}
+
+/*
+ * create_ring_file
+ *   Creates the file a persisted ring at shared is flushed to, laid out as a segment holding only that ring, and
+ *   adds it to the host's list, which a flusher thread may be walking at the same time. The ring's file path is
+ *   written at path in the segment. A file already at the path is kept as path.prev, as it may hold what led up to
+ *   a crash.
+ *
+ * returns:
+ *   0 on success, or -1 if the file could not be created
+ */
+static int create_ring_file(SRBHandle handle, struct ShmRingBufferShared* shared, struct ShmRingBufferDef* def, char* path)
+{
+    strcpy(path, def->persist_path);
+
+    // Ascertain sizes of everything, as in a segment of this ring alone
+    uint64_t head_size = sizeof(struct ShmRingBuffersHead);
+    char* description = (char*)(handle->mem_map + shared->description_offset);
+    uint64_t description_offset = head_size + sizeof(struct ShmRingBufferShared);
+    uint64_t directory_offset = ((description_offset + strlen(description) + 1 + 7) / 8) * 8;
+    uint64_t topic_ids_offset = ((directory_offset + sizeof(struct ShmRingDirectory) + sizeof(uint64_t) + 63) / 64) * 64;
+    uint64_t timestamps_offset = topic_ids_offset + (def->multiplexed ? get_topic_ids_size(def->num_buffers) : 0);
+    uint64_t checksums_offset = timestamps_offset + (def->timestamped ? get_timestamps_size(def->num_buffers) : 0);
+    uint64_t dirty_offset = checksums_offset + (def->checksummed ? get_checksums_size(def->num_buffers) : 0);
+    uint64_t buffers_offset = get_aligned_size(dirty_offset + (def->dirty_tracked ? get_dirty_size(def->buffer_size, def->num_buffers) : 0));
+    uint64_t total_size = buffers_offset + def->num_buffers * def->buffer_size;
+
+    char* prev_path = malloc(strlen(path) + sizeof(".prev"));
+    if (prev_path == NULL) {
+        return -1;
+    }
+    sprintf(prev_path, "%s.prev", path);
+    if ((rename(path, prev_path) < 0) && (errno != ENOENT)) {
+        // Carrying on would truncate what may be the only record of a crash
+        fprintf(stderr, "Error keeping ring file (%s) as %s: %s\n", path, prev_path, strerror(errno));
+        free(prev_path);
+        return -1;
+    }
+    free(prev_path);
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if ((fd < 0) || (posix_fallocate(fd, 0, total_size) != 0)) {
+        fprintf(stderr, "Error creating ring file (%s) at size: %" PRIu64 "\n", path, total_size);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    uint8_t* m = (uint8_t*)mmap(NULL, total_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (m == MAP_FAILED) {
+        fprintf(stderr, "Error mapping ring file (%s)\n", path);
+        close(fd);
+        return -1;
+    }
+
+    // Every page is written out once here, so flushes only ever overwrite data and never wait on the filesystem
+    memset(m, 0, total_size);
+    struct ShmRingBuffersHead* head = (struct ShmRingBuffersHead*)m;
+    head->state = SRB_RUNNING; // Until the host closes, so a file left running was not closed cleanly
+    head->num_ringbuffers = 1;
+    head->directory_offset = directory_offset;
+    head->max_size = total_size;
+    struct ShmRingBufferShared* persisted = (struct ShmRingBufferShared*)(m + head_size);
+    init_ring(m, persisted, def, (char*)(m + description_offset), (uint16_t*)(m + topic_ids_offset), (uint64_t*)(m + timestamps_offset), (struct ShmBufferChecksum*)(m + checksums_offset), (uint64_t*)(m + dirty_offset), m + buffers_offset);
+    persisted->persist_path_offset = 0;
+    struct ShmRingDirectory* directory = (struct ShmRingDirectory*)(m + directory_offset);
+    directory->num_ringbuffers = 1;
+    directory->ring_offsets[0] = head_size;
+    int synced = fsync(fd);
+    struct ShmRingBufferFile* file = malloc(sizeof(struct ShmRingBufferFile));
+    if (file) {
+        file->persisted = *persisted;
+    }
+    munmap(m, total_size); // From here on only the flusher writes the file, with pwrite
+    if ((synced < 0) || (file == NULL)) {
+        fprintf(stderr, "Error writing ring file (%s)\n", path);
+        free(file);
+        close(fd);
+        return -1;
+    }
+
+    file->shared = shared;
+    file->fd = fd;
+    file->flushed_write_ring_pos = shared->write_ring_pos;
+    file->flushing_write_ring_pos = file->flushed_write_ring_pos;
+    file->next = handle->ring_files;
+    __atomic_store_n(&handle->ring_files, file, __ATOMIC_RELEASE);
+    shared->persist_path_offset = (uint8_t*)path - handle->mem_map;
+    return 0;
+}
+
+/*
+ * load_ring
+ *   Sets up this process's view of a ring from its shared state.
+ */
+static void load_ring(SRBHandle handle, struct ShmRingBuffer* ring, struct ShmRingBufferShared* shared)
+{
+    uint8_t* m = handle->mem_map;
+    ring->shared = shared;
+    ring->head = handle->ring_buffers_head;
+    ring->description = (char*)(m + shared->description_offset);
+    ring->buffers = m + shared->buffers_offset;
+    ring->topic_ids = shared->topic_ids_offset ? (uint16_t*)(m + shared->topic_ids_offset) : NULL;
+    ring->timestamps = shared->timestamps_offset ? (uint64_t*)(m + shared->timestamps_offset) : NULL;
+    ring->checksums = shared->checksums_offset ? (struct ShmBufferChecksum*)(m + shared->checksums_offset) : NULL;
+    ring->checksum_set = 0;
+    ring->dirty_tiles = shared->dirty_offset ? (uint64_t*)(m + shared->dirty_offset) : NULL;
+    ring->dirty_words = shared->dirty_offset ? get_dirty_words(shared->buffer_size) : 0;
+    ring->dirty_set = 0;
+    ring->num_topic_filter = 0;
+    ring->last_read_ring_pos = 0;
+    ring->last_seen_write_ring_pos = shared->write_ring_pos;
+    ring->last_activity_time = get_monotonic_seconds();
+}
+
+/*
+ * load_directory
+ *   Loads the segment's current directory into a handle, first growing the mapping if the segment has grown.
+ *   Rings the handle already had keep their local state, the previous ringbuffers array is kept until close.
+ *
+ * returns:
+ *   0 on success, or -1 if the grown segment could not be mapped
+ */
+static int load_directory(SRBHandle handle)
+{
+    struct ShmRingBuffersHead* head = handle->ring_buffers_head;
+    uint64_t generation = __atomic_load_n(&head->generation, __ATOMIC_ACQUIRE);
+    uint64_t directory_offset = __atomic_load_n(&head->directory_offset, __ATOMIC_ACQUIRE);
+    struct stat shm_stat;
+    if ((fstat(handle->shm_fd, &shm_stat) < 0) || (grow_mapping(handle, shm_stat.st_size) < 0)) {
+        fprintf(stderr, "Error mapping grown shm object (%s)\n", handle->shm_path);
+        return -1;
+    }
+
+    struct ShmRingDirectory* directory = (struct ShmRingDirectory*)(handle->mem_map + directory_offset);
+    unsigned int num_rings = directory->num_ringbuffers;
+    struct ShmRingBuffer* ringbuffers = malloc(sizeof(struct ShmRingBuffer) * (num_rings ? num_rings : 1));
+    for (unsigned int i = 0; i < num_rings; i++) {
+        struct ShmRingBufferShared* shared = (struct ShmRingBufferShared*)(handle->mem_map + directory->ring_offsets[i]);
+        unsigned int j = 0;
+        while ((j < handle->num_ringbuffers) && (handle->ringbuffers[j].shared != shared)) {
+            j++;
+        }
+        if (j < handle->num_ringbuffers) {
+            ringbuffers[i] = handle->ringbuffers[j];
+        } else {
+            load_ring(handle, ringbuffers + i, shared);
+        }
+    }
+
+    if (handle->ringbuffers) {
+        handle->old_ringbuffers = realloc(handle->old_ringbuffers, (handle->num_old_ringbuffers + 1) * sizeof(struct ShmRingBuffer*));
+        handle->old_ringbuffers[handle->num_old_ringbuffers++] = handle->ringbuffers;
+    }
+    handle->ringbuffers = ringbuffers;
+    handle->num_ringbuffers = num_rings;
+    handle->generation = generation;
+    return 0;
+}
+
+/*
+ * change_rings
+ *   Publishes a new directory in which retire (if not NULL) is replaced by a ring made from add_def (if not NULL),
+ *   or the new ring is appended. Everything new goes in a fresh region at the end of the segment. A replacement
+ *   ring starts with the most recent buffer of the ring it replaces.
+ *
+ * returns:
+ *   the new ring's shared state (retire's if add_def is NULL), or NULL if the segment could not grow or the new
+ *   ring's file could not be created
+ */
+static struct ShmRingBufferShared* change_rings(SRBHandle handle, struct ShmRingBufferDef* add_def, struct ShmRingBufferShared* retire)
+{
+    struct ShmRingBuffersHead* head = handle->ring_buffers_head;
+    struct ShmRingDirectory* old_directory = (struct ShmRingDirectory*)(handle->mem_map + head->directory_offset);
+    unsigned int num_rings = old_directory->num_ringbuffers + (add_def ? 1 : 0) - (retire ? 1 : 0);
+
+    // Ascertain sizes of everything
+    uint64_t region_offset = get_aligned_size(handle->shm_size);
+    uint64_t description_offset = region_offset + sizeof(struct ShmRingBufferShared);
+    uint64_t directory_offset = description_offset;
+    if (add_def) {
+        directory_offset += (add_def->description ? strlen(add_def->description) : 0) + 1;
+        if (add_def->persist_path) {
+            directory_offset += strlen(add_def->persist_path) + 1;
+        }
+    }
+    directory_offset = ((directory_offset + 7) / 8) * 8;
+    uint64_t topic_ids_offset = ((directory_offset + sizeof(struct ShmRingDirectory) + num_rings * sizeof(uint64_t) + 63) / 64) * 64;
+    uint64_t timestamps_offset = topic_ids_offset;
+    uint64_t checksums_offset = topic_ids_offset;
+    uint64_t dirty_offset = topic_ids_offset;
+    uint64_t buffers_offset = topic_ids_offset;
+    uint64_t total_size = topic_ids_offset;
+    if (add_def) {
+        timestamps_offset += add_def->multiplexed ? get_topic_ids_size(add_def->num_buffers) : 0;
+        checksums_offset = timestamps_offset + (add_def->timestamped ? get_timestamps_size(add_def->num_buffers) : 0);
+        dirty_offset = checksums_offset + (add_def->checksummed ? get_checksums_size(add_def->num_buffers) : 0);
+        buffers_offset = get_aligned_size(dirty_offset + (add_def->dirty_tracked ? get_dirty_size(add_def->buffer_size, add_def->num_buffers) : 0));
+        total_size = buffers_offset + add_def->num_buffers * add_def->buffer_size;
+    }
+    if ((total_size > head->max_size) || (ftruncate(handle->shm_fd, total_size) < 0) || (grow_mapping(handle, total_size) < 0)) {
+        fprintf(stderr, "Error growing shm object (%s) to size: %" PRIu64 "\n", handle->shm_path, total_size);
+        return NULL;
+    }
+
+    uint8_t* m = handle->mem_map;
+    struct ShmRingBufferShared* added = NULL;
+    if (add_def) {
+        added = (struct ShmRingBufferShared*)(m + region_offset);
+        char* description = (char*)(m + description_offset);
+        init_ring(m, added, add_def, description, (uint16_t*)(m + topic_ids_offset), (uint64_t*)(m + timestamps_offset), (struct ShmBufferChecksum*)(m + checksums_offset), (uint64_t*)(m + dirty_offset), m + buffers_offset);
+        if (add_def->persist_path && (create_ring_file(handle, added, add_def, description + strlen(description) + 1) < 0)) {
+            return NULL;
+        }
+        uint64_t recent = retire ? __atomic_load_n(&retire->write_ring_pos, __ATOMIC_ACQUIRE) - 1 : 0;
+        if (retire && (recent >= retire->num_buffers) && !retire->holds_blocks) {
+            // Carry the most recent buffer over as slot 0, before any client can see the new ring
+            uint64_t slot = recent % retire->num_buffers;
+            memcpy(m + buffers_offset, m + retire->buffers_offset + slot * retire->buffer_size, added->buffer_size);
+            if (added->topic_ids_offset) {
+                ((uint16_t*)(m + topic_ids_offset))[0] = ((uint16_t*)(m + retire->topic_ids_offset))[slot];
+            }
+            if (added->timestamps_offset) {
+                ((uint64_t*)(m + timestamps_offset))[0] = ((uint64_t*)(m + retire->timestamps_offset))[slot];
+            }
+            if (added->checksums_offset && retire->checksums_offset) {
+                ((struct ShmBufferChecksum*)(m + checksums_offset))[0] = ((struct ShmBufferChecksum*)(m + retire->checksums_offset))[slot];
+            }
+            // Its dirty tiles are left all set, as there is nothing before it in the new ring
+            added->write_ring_pos = added->num_buffers + 1;
+        }
+    }
+
+    struct ShmRingDirectory* directory = (struct ShmRingDirectory*)(m + directory_offset);
+    unsigned int n = 0;
+    for (unsigned int i = 0; i < old_directory->num_ringbuffers; i++) {
+        if ((m + old_directory->ring_offsets[i]) != (uint8_t*)retire) {
+            directory->ring_offsets[n++] = old_directory->ring_offsets[i];
+        } else if (added) {
+            directory->ring_offsets[n++] = region_offset; // Resized rings keep their place
+        }
+    }
+    if (added && !retire) {
+        directory->ring_offsets[n++] = region_offset;
+    }
+    directory->num_ringbuffers = n;
+    if (retire) {
+        __atomic_store_n(&retire->retired, 1, __ATOMIC_RELEASE);
+    }
+
+    head->num_ringbuffers = n;
+    __atomic_store_n(&head->directory_offset, directory_offset, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&head->generation, 1, __ATOMIC_RELEASE);
+    ring_doorbell(head); // Wake ring sets so they can refresh
+    return added ? added : retire;
+}
+
+/*
+ * find_local_ring
+ *
+ * returns:
+ *   the handle's ring for the given shared state, or NULL if it is not in the handle's directory
+ */
+static struct ShmRingBuffer* find_local_ring(SRBHandle handle, struct ShmRingBufferShared* shared)
+{
+    for (unsigned int i = 0; i < handle->num_ringbuffers; i++) {
+        if (handle->ringbuffers[i].shared == shared) {
+            return handle->ringbuffers + i;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * keep_retired_ring
+ *   Remembers a host's retired ring, so its memory is still reclaimed once it goes idle.
+ */
+static void keep_retired_ring(SRBHandle handle, struct ShmRingBuffer* ring)
+{
+    handle->retired_rings = realloc(handle->retired_rings, (handle->num_retired_rings + 1) * sizeof(struct ShmRingBuffer));
+    handle->retired_rings[handle->num_retired_rings++] = *ring;
+}
+
+/*
+ * find_topic
+ *   Scans topic ids [from, to) of a multiplexed ring for the first one in the ring's topic filter.
+ *
+ * returns:
+ *   the index of the first matching topic id, or -1 if none match
+ */
+static int find_topic(const struct ShmRingBuffer* ring_buffer, unsigned int from, unsigned int to)
+{
+    const uint16_t* ids = ring_buffer->topic_ids;
+    const uint16_t* filter = ring_buffer->topic_filter;
+    unsigned int num_filter = ring_buffer->num_topic_filter;
+    unsigned int i = from;
+#ifdef __SSE2__
+    __m128i wanted[SRB_MAX_TOPIC_FILTER];
+    for (unsigned int f = 0; f < num_filter; f++) {
+        wanted[f] = _mm_set1_epi16((short)filter[f]);
+    }
+    for (; i + 8 <= to; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(ids + i));
+        __m128i hit = _mm_cmpeq_epi16(v, wanted[0]);
+        for (unsigned int f = 1; f < num_filter; f++) {
+            hit = _mm_or_si128(hit, _mm_cmpeq_epi16(v, wanted[f]));
+        }
+        int mask = _mm_movemask_epi8(hit);
+        if (mask) {
+            return i + (__builtin_ctz(mask) >> 1);
+        }
+    }
+#endif
+    for (; i < to; i++) {
+        for (unsigned int f = 0; f < num_filter; f++) {
+            if (ids[i] == filter[f]) {
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+/*
+ * get_next_unread_topic_buffer
+ *   The topic filtered counterpart of srb_subscriber_get_next_unread_buffer, newest is write_ring_pos - 1.
+ */
+static uint8_t* get_next_unread_topic_buffer(struct ShmRingBuffer* ring_buffer, uint64_t newest)
+{
+    unsigned int num_buffers = ring_buffer->shared->num_buffers;
+    uint64_t first = ring_buffer->last_read_ring_pos + 1;
+    if ((newest - first) >= (num_buffers - 1)) {
+        first = newest - (num_buffers - 2); // Fallen too far behind, scan from the oldest intact buffer
+    }
+
+    // The unread window is at most two contiguous runs of the topic id array
+    unsigned int count = newest - first + 1; // At most num_buffers - 1
+    unsigned int start = first % num_buffers;
+    unsigned int run = (count < (num_buffers - start)) ? count : (num_buffers - start);
+    int found = find_topic(ring_buffer, start, start + run);
+    uint64_t pos;
+    if (found >= 0) {
+        pos = first + (found - start);
+    } else if ((count > run) && ((found = find_topic(ring_buffer, 0, count - run)) >= 0)) {
+        pos = first + run + found;
+    } else {
+        ring_buffer->last_read_ring_pos = newest; // Nothing of interest, all caught up.
+        return NULL;
+    }
+    ring_buffer->last_read_ring_pos = pos;
+    return ring_buffer->buffers + ((pos % num_buffers) * ring_buffer->shared->buffer_size);
+}
+
+// Copies smaller than this go through memcpy, streaming them isn't worth the fence
+#define STREAM_MIN_SIZE (4096)
+
+#ifdef SRB_X86_STREAMING
+/*
+ * Streaming copy and fill kernels, dst must be aligned to and size a multiple of the StreamOps alignment.
+ */
+static void stream_copy_sse2(uint8_t* dst, const uint8_t* src, uint64_t size)
+{
+    for (uint64_t i = 0; i < size; i += 16) {
+        _mm_stream_si128((__m128i*)(dst + i), _mm_loadu_si128((const __m128i*)(src + i)));
+    }
+}
+
+static void stream_fill_sse2(uint8_t* dst, uint8_t value, uint64_t size)
+{
+    __m128i v = _mm_set1_epi8((char)value);
+    for (uint64_t i = 0; i < size; i += 16) {
+        _mm_stream_si128((__m128i*)(dst + i), v);
+    }
+}
+
+__attribute__((target("avx2"))) static void stream_copy_avx2(uint8_t* dst, const uint8_t* src, uint64_t size)
+{
+    for (uint64_t i = 0; i < size; i += 32) {
+        _mm256_stream_si256((__m256i*)(dst + i), _mm256_loadu_si256((const __m256i*)(src + i)));
+    }
+}
+
+__attribute__((target("avx2"))) static void stream_fill_avx2(uint8_t* dst, uint8_t value, uint64_t size)
+{
+    __m256i v = _mm256_set1_epi8((char)value);
+    for (uint64_t i = 0; i < size; i += 32) {
+        _mm256_stream_si256((__m256i*)(dst + i), v);
+    }
+}
+
+__attribute__((target("avx512f"))) static void stream_copy_avx512(uint8_t* dst, const uint8_t* src, uint64_t size)
+{
+    for (uint64_t i = 0; i < size; i += 64) {
+        _mm512_stream_si512((void*)(dst + i), _mm512_loadu_si512((const void*)(src + i)));
+    }
+}
+
+__attribute__((target("avx512f"))) static void stream_fill_avx512(uint8_t* dst, uint8_t value, uint64_t size)
+{
+    __m512i v = _mm512_set1_epi32(value * 0x01010101u);
+    for (uint64_t i = 0; i < size; i += 64) {
+        _mm512_stream_si512((void*)(dst + i), v);
+    }
+}
+
+struct StreamOps {
+    uint64_t alignment;
+    void (*copy)(uint8_t* dst, const uint8_t* src, uint64_t size);
+    void (*fill)(uint8_t* dst, uint8_t value, uint64_t size);
+};
+
+static const struct StreamOps stream_ops_sse2 = { 16, stream_copy_sse2, stream_fill_sse2 };
+static const struct StreamOps stream_ops_avx2 = { 32, stream_copy_avx2, stream_fill_avx2 };
+static const struct StreamOps stream_ops_avx512 = { 64, stream_copy_avx512, stream_fill_avx512 };
+
+/*
+ * get_stream_ops
+ *   Picks the widest streaming store kernels the CPU supports, once.
+ *
+ * returns:
+ *   the kernels to use, or NULL if the CPU has no streaming stores
+ */
+static const struct StreamOps* get_stream_ops(void)
+{
+    static const struct StreamOps* stream_ops = NULL;
+    static int resolved = 0;
+    if (!__atomic_load_n(&resolved, __ATOMIC_ACQUIRE)) {
+        __builtin_cpu_init();
+        const struct StreamOps* ops = NULL;
+        if (__builtin_cpu_supports("avx512f")) {
+            ops = &stream_ops_avx512;
+        } else if (__builtin_cpu_supports("avx2")) {
+            ops = &stream_ops_avx2;
+        } else if (__builtin_cpu_supports("sse2")) {
+            ops = &stream_ops_sse2;
+        }
+        __atomic_store_n(&stream_ops, ops, __ATOMIC_RELAXED);
+        __atomic_store_n(&resolved, 1, __ATOMIC_RELEASE);
+    }
+    return __atomic_load_n(&stream_ops, __ATOMIC_RELAXED);
+}
+#endif
+
+// CRC32C (Castagnoli), bit reflected, as computed by the SSE4.2 and ARMv8 CRC instructions
+#define CRC32C_POLY (0x82F63B78u)
+// Bytes per lane of the 3 way interleaved hardware kernel, a lane's CRC is shifted into place with one multiply
+#define CRC32C_LANE (4096)
+
+/*
+ * crc32c_multiply
+ *   Multiplies two polynomials modulo the CRC32C polynomial, in the reflected bit order.
+ */
+static uint32_t crc32c_multiply(uint32_t a, uint32_t b)
+{
+    uint32_t product = 0;
+    for (uint32_t m = 1u << 31; m; m >>= 1) {
+        if (a & m) {
+            product ^= b;
+        }
+        b = (b & 1) ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+    return product;
+}
+
+/*
+ * crc32c_x_pow
+ *
+ * returns:
+ *   x^n modulo the CRC32C polynomial, in the reflected bit order
+ */
+static uint32_t crc32c_x_pow(uint64_t n)
+{
+    uint32_t result = 1u << 31; // x^0
+    uint32_t square = 1u << 30; // x^1
+    while (n) {
+        if (n & 1) {
+            result = crc32c_multiply(square, result);
+        }
+        square = crc32c_multiply(square, square);
+        n >>= 1;
+    }
+    return result;
+}
+
+/*
+ * CRC32C kernels, each updates the raw (not inverted) crc with size bytes of src. If dst is not NULL the bytes
+ * are also copied there, in the same pass, for the hardware kernels dst must then be 16 byte aligned.
+ */
+static uint32_t crc32c_table[256];
+
+static uint32_t crc32c_software(uint32_t crc, const uint8_t* src, uint8_t* dst, uint64_t size)
+{
+    if (dst) {
+        memcpy(dst, src, size);
+    }
+    for (uint64_t i = 0; i < size; i++) {
+        crc = crc32c_table[(crc ^ src[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef SRB_X86_STREAMING
+static uint64_t crc32c_lane_shifts[2]; // For shifting a lane's CRC past one and two further lanes
+
+/*
+ * crc32c_shift_clmul
+ *   Shifts a raw crc past the zero bytes that k stands for, x^(8 * bytes - 33), with one carry-less multiply.
+ */
+__attribute__((target("sse4.2,pclmul"))) static uint32_t crc32c_shift_clmul(uint32_t crc, uint64_t k)
+{
+    __m128i product = _mm_clmulepi64_si128(_mm_cvtsi32_si128(crc), _mm_cvtsi64_si128(k), 0);
+    return _mm_crc32_u64(0, _mm_cvtsi128_si64(product));
+}
+
+// One lane at a time, for CPUs without carry-less multiply and for what is left after crc32c_sse42_clmul's lanes
+__attribute__((target("sse4.2"))) static uint32_t crc32c_sse42(uint32_t crc, const uint8_t* src, uint8_t* dst, uint64_t size)
+{
+    uint64_t crc64 = crc;
+    for (; size >= 16; size -= 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)src);
+        if (dst) {
+            _mm_stream_si128((__m128i*)dst, a);
+            dst += 16;
+        }
+        crc64 = _mm_crc32_u64(_mm_crc32_u64(crc64, _mm_cvtsi128_si64(a)), _mm_extract_epi64(a, 1));
+        src += 16;
+    }
+    crc = crc64;
+    if (dst) {
+        memcpy(dst, src, size);
+    }
+    for (; size; size--) {
+        crc = _mm_crc32_u8(crc, *src++);
+    }
+    return crc;
+}
+
+__attribute__((target("sse4.2,pclmul"))) static uint32_t crc32c_sse42_clmul(uint32_t crc, const uint8_t* src, uint8_t* dst, uint64_t size)
+{
+    // Large runs go 3 lanes at a time, so the crc32 instruction's latency is hidden, then the lanes are folded
+    while (size >= 3 * CRC32C_LANE) {
+        uint64_t crc0 = crc, crc1 = 0, crc2 = 0;
+        for (uint64_t i = 0; i < CRC32C_LANE; i += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(src + i));
+            __m128i b = _mm_loadu_si128((const __m128i*)(src + CRC32C_LANE + i));
+            __m128i c = _mm_loadu_si128((const __m128i*)(src + 2 * CRC32C_LANE + i));
+            if (dst) {
+                _mm_stream_si128((__m128i*)(dst + i), a);
+                _mm_stream_si128((__m128i*)(dst + CRC32C_LANE + i), b);
+                _mm_stream_si128((__m128i*)(dst + 2 * CRC32C_LANE + i), c);
+            }
+            crc0 = _mm_crc32_u64(_mm_crc32_u64(crc0, _mm_cvtsi128_si64(a)), _mm_extract_epi64(a, 1));
+            crc1 = _mm_crc32_u64(_mm_crc32_u64(crc1, _mm_cvtsi128_si64(b)), _mm_extract_epi64(b, 1));
+            crc2 = _mm_crc32_u64(_mm_crc32_u64(crc2, _mm_cvtsi128_si64(c)), _mm_extract_epi64(c, 1));
+        }
+        crc = crc32c_shift_clmul(crc0, crc32c_lane_shifts[1]) ^ crc32c_shift_clmul(crc1, crc32c_lane_shifts[0]) ^ crc2;
+        src += 3 * CRC32C_LANE;
+        dst = dst ? dst + 3 * CRC32C_LANE : NULL;
+        size -= 3 * CRC32C_LANE;
+    }
+    return crc32c_sse42(crc, src, dst, size);
+}
+#endif
+
+#ifdef SRB_ARM_CRC32C
+__attribute__((target("+crc"))) static uint32_t crc32c_armv8(uint32_t crc, const uint8_t* src, uint8_t* dst, uint64_t size)
+{
+    if (dst) {
+        memcpy(dst, src, size);
+    }
+    for (; size >= 8; size -= 8) {
+        uint64_t v;
+        memcpy(&v, src, sizeof(v));
+        crc = __crc32cd(crc, v);
+        src += 8;
+    }
+    for (; size; size--) {
+        crc = __crc32cb(crc, *src++);
+    }
+    return crc;
+}
+#endif
+
+typedef uint32_t (*Crc32cKernel)(uint32_t crc, const uint8_t* src, uint8_t* dst, uint64_t size);
+
+/*
+ * get_crc32c_kernel
+ *   Builds the software table and picks the fastest CRC32C kernel the CPU supports, once.
+ *
+ * returns:
+ *   the kernel to use, and via streams whether it copies with streaming stores
+ */
+static Crc32cKernel get_crc32c_kernel(int* streams)
+{
+    static Crc32cKernel kernel = NULL;
+    static int kernel_streams = 0;
+    static int resolved = 0;
+    if (!__atomic_load_n(&resolved, __ATOMIC_ACQUIRE)) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+            }
+            crc32c_table[i] = crc;
+        }
+        Crc32cKernel k = crc32c_software;
+        int k_streams = 0;
+#ifdef SRB_X86_STREAMING
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("pclmul")) {
+            crc32c_lane_shifts[0] = crc32c_x_pow(8 * CRC32C_LANE - 33);
+            crc32c_lane_shifts[1] = crc32c_x_pow(2 * 8 * CRC32C_LANE - 33);
+            k = crc32c_sse42_clmul;
+            k_streams = 1;
+        } else if (__builtin_cpu_supports("sse4.2")) {
+            k = crc32c_sse42; // Such as Nehalem, still far quicker than the table
+            k_streams = 1;
+        }
+#endif
+#ifdef SRB_ARM_CRC32C
+        if (getauxval(AT_HWCAP) & HWCAP_CRC32) {
+            k = crc32c_armv8;
+        }
+#endif
+        __atomic_store_n(&kernel, k, __ATOMIC_RELAXED);
+        __atomic_store_n(&kernel_streams, k_streams, __ATOMIC_RELAXED);
+        __atomic_store_n(&resolved, 1, __ATOMIC_RELEASE);
+    }
+    if (streams) {
+        *streams = __atomic_load_n(&kernel_streams, __ATOMIC_RELAXED);
+    }
+    return __atomic_load_n(&kernel, __ATOMIC_RELAXED);
+}
+
+typedef int (*TileDiffer)(const uint8_t* a, const uint8_t* b, uint64_t size);
+
+/*
+ * Tile comparison kernels, non-zero if the size bytes at a and b differ. They stop at the first 64 bytes that do.
+ */
+static int tile_differs_scalar(const uint8_t* a, const uint8_t* b, uint64_t size)
+{
+    return memcmp(a, b, size) != 0;
+}
+
+#ifdef SRB_X86_STREAMING
+static int tile_differs_sse2(const uint8_t* a, const uint8_t* b, uint64_t size)
+{
+    uint64_t i = 0;
+    for (; i + 64 <= size; i += 64) {
+        __m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i)));
+        x = _mm_or_si128(x, _mm_xor_si128(_mm_loadu_si128((const __m128i*)(a + i + 16)), _mm_loadu_si128((const __m128i*)(b + i + 16))));
+        x = _mm_or_si128(x, _mm_xor_si128(_mm_loadu_si128((const __m128i*)(a + i + 32)), _mm_loadu_si128((const __m128i*)(b + i + 32))));
+        x = _mm_or_si128(x, _mm_xor_si128(_mm_loadu_si128((const __m128i*)(a + i + 48)), _mm_loadu_si128((const __m128i*)(b + i + 48))));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_setzero_si128())) != 0xFFFF) {
+            return 1;
+        }
+    }
+    return memcmp(a + i, b + i, size - i) != 0;
+}
+
+__attribute__((target("avx2"))) static int tile_differs_avx2(const uint8_t* a, const uint8_t* b, uint64_t size)
+{
+    uint64_t i = 0;
+    for (; i + 64 <= size; i += 64) {
+        __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(a + i)), _mm256_loadu_si256((const __m256i*)(b + i)));
+        x = _mm256_or_si256(x, _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(a + i + 32)), _mm256_loadu_si256((const __m256i*)(b + i + 32))));
+        if (!_mm256_testz_si256(x, x)) {
+            return 1;
+        }
+    }
+    return memcmp(a + i, b + i, size - i) != 0;
+}
+#endif
+
+/*
+ * get_tile_differ
+ *   Picks the widest tile comparison kernel the CPU supports, once.
+ */
+static TileDiffer get_tile_differ(void)
+{
+    static TileDiffer differ = NULL;
+    static int resolved = 0;
+    if (!__atomic_load_n(&resolved, __ATOMIC_ACQUIRE)) {
+        TileDiffer d = tile_differs_scalar;
+#ifdef SRB_X86_STREAMING
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            d = tile_differs_avx2;
+        } else if (__builtin_cpu_supports("sse2")) {
+            d = tile_differs_sse2;
+        }
+#endif
+        __atomic_store_n(&differ, d, __ATOMIC_RELAXED);
+        __atomic_store_n(&resolved, 1, __ATOMIC_RELEASE);
+    }
+    return __atomic_load_n(&differ, __ATOMIC_RELAXED);
+}
+
+/*
+ * find_dirty_tiles
+ *   Sets the bitmap of tiles in which buffer differs from previous, both size bytes.
+ */
+static void find_dirty_tiles(const uint8_t* buffer, const uint8_t* previous, uint64_t size, uint64_t tile_size, uint64_t* dirty, uint64_t num_words)
+{
+    TileDiffer differs = get_tile_differ();
+    memset(dirty, 0, num_words * sizeof(uint64_t));
+    uint64_t tile = 0;
+    for (uint64_t offset = 0; offset < size; offset += tile_size, tile++) {
+        uint64_t length = ((size - offset) < tile_size) ? size - offset : tile_size;
+        if (differs(buffer + offset, previous + offset, length)) {
+            dirty[tile / 64] |= (uint64_t)1 << (tile % 64);
+        }
+    }
+}
+
+/*
+ * copy_dirty_tiles
+ *   Copies the tiles of buffer that changed in any of the sequences [first, last] into copy, a run at a time.
+ *
+ * returns:
+ *   the number of bytes copied
+ */
+static uint64_t copy_dirty_tiles(struct ShmRingBuffer* ring_buffer, uint8_t* copy, const uint8_t* buffer, uint64_t first, uint64_t last)
+{
+    uint64_t num_buffers = ring_buffer->shared->num_buffers;
+    uint64_t size = ring_buffer->shared->buffer_size;
+    uint64_t tile_size = ring_buffer->shared->dirty_tile_size;
+    uint64_t copied = 0;
+    for (uint64_t w = 0; w < ring_buffer->dirty_words; w++) {
+        uint64_t dirty = 0;
+        for (uint64_t sequence = first; sequence <= last; sequence++) {
+            dirty |= ring_buffer->dirty_tiles[(sequence % num_buffers) * ring_buffer->dirty_words + w];
+        }
+        while (dirty) {
+            unsigned int start = __builtin_ctzll(dirty);
+            uint64_t shifted = dirty >> start;
+            unsigned int run = (~shifted == 0) ? 64 : __builtin_ctzll(~shifted);
+            uint64_t offset = (w * 64 + start) * tile_size;
+            if (offset >= size) {
+                break; // Bits past the last tile
+            }
+            uint64_t length = run * tile_size;
+            if (length > size - offset) {
+                length = size - offset;
+            }
+            memcpy(copy + offset, buffer + offset, length);
+            copied += length;
+            dirty = (run == 64) ? 0 : dirty & ~((((uint64_t)1 << run) - 1) << start);
+        }
+    }
+    return copied;
+}
+
+// ====================
+// Subscriber functions
+// ====================
+
+/*
+ * srb_subscriber_get_most_recent_buffer_id
+ *
+ * params:
+ *   ring_buffer - the ring buffer to get the most recent buffer id
+ *
+ * returns:
+ *   the most recent buffer id, that is not currently set as the write_ring_pos, or 0 if no valid buffers exist
+ */
+uint64_t srb_subscriber_get_most_recent_buffer_id(struct ShmRingBuffer* ring_buffer)
+{
+    return ring_buffer->shared->write_ring_pos - ring_buffer->shared->num_buffers;
+}
+
+/*
+ * srb_subscriber_get_most_recent_buffer
+ *
+ * params:
+ *   ring_buffer - the ring buffer to get the most recent buffer
+ *
+ * returns:
+ *   the most recent buffer that is not currently set as the write_ring_pos, or NULL if no valid buffers exist
+ */
+uint8_t* srb_subscriber_get_most_recent_buffer(struct ShmRingBuffer* ring_buffer)
+{
+    uint64_t b = ring_buffer->shared->write_ring_pos - 1;
+    if (b < ring_buffer->shared->num_buffers) {
+        return NULL; // No buffers yet.
+    }
+    b = b % ring_buffer->shared->num_buffers;
+    return ring_buffer->buffers + (b * ring_buffer->shared->buffer_size);
+}
+
+/*
+ * srb_subscriber_get_next_unread_buffer
+ *
+ * params:
+ *   ring_buffer - the ring buffer to get the next unread buffer
+ *
+ * returns:
+ *   the next unread buffer up until to write_ring_pos - 1, or NULL if no buffers meet this criteria. On a
+ *   multiplexed ring with a topic filter set, buffers of other topics are skipped without being touched.
+ */
+uint8_t* srb_subscriber_get_next_unread_buffer(struct ShmRingBuffer* ring_buffer)
+{
+    uint64_t b = ring_buffer->shared->write_ring_pos - 1;
+    if (b < ring_buffer->shared->num_buffers) {
+        return NULL; // No buffers yet.
+    }
+    if (ring_buffer->last_read_ring_pos >= b) {
+        return NULL; // All caught up.
+    }
+    uint64_t floor = __atomic_load_n(&ring_buffer->shared->reclaim_floor, __ATOMIC_ACQUIRE);
+    if (ring_buffer->last_read_ring_pos + 1 < floor) {
+        ring_buffer->last_read_ring_pos = floor - 1; // Older buffers were released while the ring was idle
+    }
+    if (ring_buffer->num_topic_filter) {
+        return get_next_unread_topic_buffer(ring_buffer, b);
+    }
+    ring_buffer->last_read_ring_pos++;
+    b -= ring_buffer->last_read_ring_pos;
+    if (b >= (ring_buffer->shared->num_buffers - 1)) {
+        ring_buffer->last_read_ring_pos += b; // Fallen too far behind, catch up to newest buffer
+    }
+    b = ring_buffer->last_read_ring_pos % ring_buffer->shared->num_buffers;
+    return ring_buffer->buffers + (b * ring_buffer->shared->buffer_size);
+}
+
+/*
+ * srb_subscriber_set_topic_filter
+ *   Restricts srb_subscriber_get_next_unread_buffer on a multiplexed ring to the given topics.
+ *
+ * params:
+ *   ring_buffer - the multiplexed ring buffer to filter
+ *   num_topics - the number of topics, up to SRB_MAX_TOPIC_FILTER, or 0 to receive all topics again
+ *   topics - the topic ids to receive
+ *
+ * returns:
+ *   0 on success, or -1 if the ring is not multiplexed or too many topics were given
+ */
+int srb_subscriber_set_topic_filter(struct ShmRingBuffer* ring_buffer, unsigned int num_topics, const uint16_t* topics)
+{
+    if ((ring_buffer->topic_ids == NULL) || (num_topics > SRB_MAX_TOPIC_FILTER)) {
+        return -1;
+    }
+    memcpy(ring_buffer->topic_filter, topics, num_topics * sizeof(uint16_t));
+    ring_buffer->num_topic_filter = num_topics;
+    return 0;
+}
+
+/*
+ * srb_subscriber_get_buffer_topic
+ *
+ * params:
+ *   ring_buffer - the multiplexed ring buffer the buffer belongs to
+ *   buffer - a buffer returned from one of the subscriber functions
+ *
+ * returns:
+ *   the topic id the buffer was written with, or 0 if the ring is not multiplexed
+ */
+uint16_t srb_subscriber_get_buffer_topic(struct ShmRingBuffer* ring_buffer, uint8_t* buffer)
+{
+    if (ring_buffer->topic_ids == NULL) {
+        return 0;
+    }
+    return ring_buffer->topic_ids[(buffer - ring_buffer->buffers) / ring_buffer->shared->buffer_size];
+}
+
+/*
+ * srb_client_get_state
+ *
+ * params:
+ *   ring_buffers_handle - the handle to the ring buffer's shared memory
+ *
+ * returns:
+ *   the run state of the host
+ */
+enum EShmRingBuffersState srb_client_get_state(SRBHandle ring_buffers_handle)
+{
+    return ring_buffers_handle->ring_buffers_head->state;
+}
+
+/*
+ * srb_subscriber_get_next_unread_block
+ *   Like srb_subscriber_get_next_unread_buffer, for a ring whose slots hold struct ShmBlockRef, but also takes a
+ *   reference to the block so it stays valid after the slot is reused. Release it with srb_block_release.
+ *
+ * params:
+ *   ring_buffer - the ring buffer to get the next unread block from
+ *   length - will be set to the bytes of the block in use
+ *
+ * returns:
+ *   the block id of the next unread block, or 0 if none
+ */
+uint32_t srb_subscriber_get_next_unread_block(struct ShmRingBuffer* ring_buffer, uint64_t* length)
+{
+    struct ShmBlockPoolShared* pool = get_block_pool(ring_buffer->head);
+    if (pool == NULL) {
+        return 0;
+    }
+    struct ShmBlockRef* ref;
+    while ((ref = (struct ShmBlockRef*)srb_subscriber_get_next_unread_buffer(ring_buffer))) {
+        uint32_t block = __atomic_load_n(&ref->block, __ATOMIC_ACQUIRE);
+        uint64_t ref_length = ref->length;
+        if ((block == 0) || (block > pool->num_blocks) || !try_acquire_block(pool, block)) {
+            continue;
+        }
+        // The producer only drops a slot's reference after moving write_ring_pos past it, so if the slot is still
+        // intact now, it held the block while we acquired it and the block was not recycled under us.
+        uint64_t pos = __atomic_load_n(&ring_buffer->shared->write_ring_pos, __ATOMIC_SEQ_CST);
+        if ((pos - ring_buffer->last_read_ring_pos) < ring_buffer->shared->num_buffers) {
+            *length = ref_length;
+            return block;
+        }
+        release_block(pool, block);
+    }
+    return 0;
+}
+
+/*
+ * srb_subscriber_get_most_recent_buffers
+ *   Gets the most recent buffer of each of several rings as one consistent snapshot: every ring is seen as of the
+ *   same publish epoch, so buffers published together by srb_producer_next_write_buffers are returned together.
+ *   This never blocks the producer, it only retries if a multi-ring publish happens while it reads. It gives up
+ *   after SRB_SNAPSHOT_MAX_TRIES, such as when a producer died part way through a publish.
+ *
+ * params:
+ *   ring_buffers - the ring buffers to read, all in the same segment
+ *   num_rings - the number of ring buffers
+ *   buffers - will be set to each ring's most recent buffer, or NULL for rings with no buffers yet
+ *   sequences - if not NULL, will be set to each buffer's write sequence number
+ *
+ * returns:
+ *   the publish epoch the snapshot was taken at, or SRB_SNAPSHOT_FAILED if a publish never finished, in which
+ *   case buffers and sequences should not be used
+ */
+uint64_t srb_subscriber_get_most_recent_buffers(struct ShmRingBuffer** ring_buffers, unsigned int num_rings, uint8_t** buffers, uint64_t* sequences)
+{
+    if (num_rings == 0) {
+        return 0;
+    }
+    uint64_t* epoch = &ring_buffers[0]->head->publish_epoch;
+    uint64_t start, end;
+    unsigned int tries = 0;
+    do {
+        if (tries++ == SRB_SNAPSHOT_MAX_TRIES) {
+            return SRB_SNAPSHOT_FAILED; // The publish never finished, its producer may have died part way through
+        }
+        start = __atomic_load_n(epoch, __ATOMIC_ACQUIRE);
+        if (start & 1) {
+            end = start + 1; // A publish is in progress, try again
+            sched_yield();
+            continue;
+        }
+        for (unsigned int i = 0; i < num_rings; i++) {
+            struct ShmRingBufferShared* shared = ring_buffers[i]->shared;
+            uint64_t b = __atomic_load_n(&shared->write_ring_pos, __ATOMIC_RELAXED) - 1;
+            buffers[i] = (b < shared->num_buffers) ? NULL : ring_buffers[i]->buffers + ((b % shared->num_buffers) * shared->buffer_size);
+            if (sequences) {
+                sequences[i] = b;
+            }
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        end = __atomic_load_n(epoch, __ATOMIC_RELAXED);
+    } while (start != end);
+    return start / 2;
+}
+
+/*
+ * srb_subscriber_seek_timestamp
+ *   Finds the published buffer whose timestamp is closest to timestamp, by binary search of the ring's timestamp
+ *   index over the buffers that are still intact. Timestamps within a ring must not decrease. On a tie the
+ *   earlier buffer is returned. This does not change the ring's read position.
+ *
+ * params:
+ *   ring_buffer - the timestamped ring buffer to search
+ *   timestamp - the time to look for, CLOCK_MONOTONIC nanoseconds unless the producer sets its own
+ *   sequence - will be set to the write sequence number of the buffer found
+ *
+ * returns:
+ *   the closest buffer, or NULL if the ring is not timestamped or has no buffers yet
+ */
+uint8_t* srb_subscriber_seek_timestamp(struct ShmRingBuffer* ring_buffer, uint64_t timestamp, uint64_t* sequence)
+{
+    struct ShmRingBufferShared* shared = ring_buffer->shared;
+    const uint64_t* timestamps = ring_buffer->timestamps;
+    uint64_t n = shared->num_buffers;
+    if (timestamps == NULL) {
+        return NULL;
+    }
+    while (1) {
+        uint64_t pos = __atomic_load_n(&shared->write_ring_pos, __ATOMIC_ACQUIRE);
+        uint64_t newest = pos - 1;
+        if (newest < n) {
+            return NULL; // No buffers yet.
+        }
+        uint64_t oldest = (pos - (n - 1) > n) ? pos - (n - 1) : n;
+        uint64_t floor = __atomic_load_n(&shared->reclaim_floor, __ATOMIC_ACQUIRE);
+        if (oldest < floor) {
+            oldest = floor; // Older buffers were released while the ring was idle
+        }
+
+        // Find the first buffer at or after timestamp, or the newest if all are before it
+        uint64_t lo = oldest, hi = newest;
+        while (lo < hi) {
+            uint64_t mid = lo + (hi - lo) / 2;
+            if (__atomic_load_n(&timestamps[mid % n], __ATOMIC_RELAXED) < timestamp) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        uint64_t best = lo;
+        uint64_t after = __atomic_load_n(&timestamps[lo % n], __ATOMIC_RELAXED);
+        if ((lo > oldest) && (after >= timestamp)
+            && ((timestamp - __atomic_load_n(&timestamps[(lo - 1) % n], __ATOMIC_RELAXED)) <= (after - timestamp))) {
+            best = lo - 1;
+        }
+
+        // The search is only good if the producer has not started rewriting the buffer found
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&shared->write_ring_pos, __ATOMIC_RELAXED) < best + n) {
+            *sequence = best;
+            return ring_buffer->buffers + ((best % n) * shared->buffer_size);
+        }
+    }
+}
+
+/*
+ * srb_subscriber_get_buffer_timestamp
+ *
+ * params:
+ *   ring_buffer - the timestamped ring buffer the buffer came from
+ *   buffer - a buffer returned by one of the srb_subscriber_get functions
+ *
+ * returns:
+ *   the timestamp of the buffer, or 0 if the ring is not timestamped
+ */
+uint64_t srb_subscriber_get_buffer_timestamp(struct ShmRingBuffer* ring_buffer, uint8_t* buffer)
+{
+    if (ring_buffer->timestamps == NULL) {
+        return 0;
+    }
+    return __atomic_load_n(&ring_buffer->timestamps[(buffer - ring_buffer->buffers) / ring_buffer->shared->buffer_size], __ATOMIC_RELAXED);
+}
+
+/*
+ * srb_subscriber_verify_buffer
+ *   Checks a buffer against the CRC32C its producer published with it. A buffer overwritten while being checked,
+ *   by a subscriber num_buffers - 1 behind, also fails.
+ *
+ * params:
+ *   ring_buffer - the checksummed ring buffer the buffer came from
+ *   buffer - a buffer returned by one of the srb_subscriber_get functions
+ *
+ * returns:
+ *   1 if the buffer matches its checksum, 0 if not, or -1 if the ring is not checksummed
+ */
+int srb_subscriber_verify_buffer(struct ShmRingBuffer* ring_buffer, uint8_t* buffer)
+{
+    if (ring_buffer->checksums == NULL) {
+        return -1;
+    }
+    uint64_t length;
+    uint32_t crc = srb_subscriber_get_buffer_checksum(ring_buffer, buffer, &length);
+    return srb_crc32c(0, buffer, length) == crc;
+}
+
+/*
+ * srb_subscriber_get_buffer_checksum
+ *
+ * params:
+ *   ring_buffer - the checksummed ring buffer the buffer came from
+ *   buffer - a buffer returned by one of the srb_subscriber_get functions
+ *   length - will be set to the number of bytes from the start of the buffer the checksum covers
+ *
+ * returns:
+ *   the CRC32C of the buffer, or 0 with length 0 if the ring is not checksummed
+ */
+uint32_t srb_subscriber_get_buffer_checksum(struct ShmRingBuffer* ring_buffer, uint8_t* buffer, uint64_t* length)
+{
+    if (ring_buffer->checksums == NULL) {
+        *length = 0;
+        return 0;
+    }
+    struct ShmBufferChecksum* checksum = ring_buffer->checksums + (buffer - ring_buffer->buffers) / ring_buffer->shared->buffer_size;
+    *length = (checksum->length < ring_buffer->shared->buffer_size) ? checksum->length : ring_buffer->shared->buffer_size;
+    return checksum->crc;
+}
+
+/*
+ * srb_subscriber_apply_deltas
+ *   Brings the caller's own copy of a dirty tracked ring's buffer up to date with the most recent buffer, copying
+ *   only the tiles that changed since the buffer the copy holds. The whole buffer is copied if the copy holds
+ *   nothing yet, is num_buffers - 1 or more behind, or the ring is not dirty tracked.
+ *
+ * params:
+ *   ring_buffer - the ring buffer to copy from
+ *   copy - buffer_size bytes, holding the buffer of sequence
+ *   sequence - the sequence number of the buffer copy holds, 0 if none, will be set to the one it now holds
+ *
+ * returns:
+ *   the number of bytes copied, 0 if the copy is already up to date or there are no buffers yet
+ */
+uint64_t srb_subscriber_apply_deltas(struct ShmRingBuffer* ring_buffer, uint8_t* copy, uint64_t* sequence)
+{
+    struct ShmRingBufferShared* shared = ring_buffer->shared;
+    uint64_t num_buffers = shared->num_buffers;
+    while (1) {
+        uint64_t newest = __atomic_load_n(&shared->write_ring_pos, __ATOMIC_ACQUIRE) - 1;
+        if ((newest < num_buffers) || (newest == *sequence)) {
+            return 0;
+        }
+        const uint8_t* buffer = ring_buffer->buffers + (newest % num_buffers) * shared->buffer_size;
+        uint64_t oldest_read = newest; // The oldest sequence whose buffer or dirty tiles are read
+        uint64_t copied;
+        if (ring_buffer->dirty_tiles && (*sequence >= num_buffers) && (*sequence < newest) && ((newest - *sequence) < num_buffers)) {
+            oldest_read = *sequence + 1;
+            copied = copy_dirty_tiles(ring_buffer, copy, buffer, oldest_read, newest);
+        } else {
+            memcpy(copy, buffer, shared->buffer_size);
+            copied = shared->buffer_size;
+        }
+
+        // Done unless the producer started overwriting what was read
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&shared->write_ring_pos, __ATOMIC_RELAXED) < oldest_read + num_buffers) {
+            *sequence = newest;
+            return copied;
+        }
+        // Tiles torn by the overwrite are dirty in the newer buffers too, so they are copied again
+    }
+}
+
+/*
+ * srb_subscriber_get_buffer_dirty_tiles
+ *   Gets which tiles of a buffer changed since the buffer published before it, for forwarding only the changes.
+ *   Tile i covers bytes [i * tile_size, (i + 1) * tile_size) of the buffer, and is changed if bit i % 64 of word
+ *   i / 64 is set. Like the buffer itself, the bitmap is overwritten once the subscriber is num_buffers - 1 behind.
+ *
+ * params:
+ *   ring_buffer - the dirty tracked ring buffer the buffer came from
+ *   buffer - a buffer returned by one of the srb_subscriber_get functions
+ *   tile_size - will be set to the bytes per tile
+ *
+ * returns:
+ *   the buffer's bitmap of changed tiles, or NULL if the ring is not dirty tracked
+ */
+const uint64_t* srb_subscriber_get_buffer_dirty_tiles(struct ShmRingBuffer* ring_buffer, uint8_t* buffer, uint64_t* tile_size)
+{
+    if (ring_buffer->dirty_tiles == NULL) {
+        *tile_size = 0;
+        return NULL;
+    }
+    *tile_size = ring_buffer->shared->dirty_tile_size;
+    return ring_buffer->dirty_tiles + ((buffer - ring_buffer->buffers) / ring_buffer->shared->buffer_size) * ring_buffer->dirty_words;
+}
+
+/*
+ * srb_subscriber_get_next_partial_buffer
+ *   Gets the buffer the producer is writing right now, before it is published, and marks it as read so
+ *   srb_subscriber_get_next_unread_buffer moves on past it. Use srb_subscriber_get_buffer_progress to find how
+ *   much of it is complete, so the regions can be processed as the producer lands them. A subscriber that is
+ *   behind gets the published buffers it has not read first, as srb_subscriber_get_next_unread_buffer would, and
+ *   only gets the buffer being written once it has caught up.
+ *
+ * params:
+ *   ring_buffer - the ring buffer to get the partial buffer from
+ *   sequence - will be set to the buffer's write sequence number
+ *
+ * returns:
+ *   the next unread published buffer, or else the buffer being written, or NULL if that has already been read or
+ *   the producer has not started
+ */
+uint8_t* srb_subscriber_get_next_partial_buffer(struct ShmRingBuffer* ring_buffer, uint64_t* sequence)
+{
+    struct ShmRingBufferShared* shared = ring_buffer->shared;
+    uint64_t b = __atomic_load_n(&shared->write_ring_pos, __ATOMIC_ACQUIRE);
+    if (b < shared->num_buffers) {
+        return NULL; // Producer not started
+    }
+    if (ring_buffer->last_read_ring_pos + 1 < b) {
+        // Published buffers not read yet come first, they are already complete
+        uint8_t* buffer = srb_subscriber_get_next_unread_buffer(ring_buffer);
+        if (buffer) {
+            *sequence = ring_buffer->last_read_ring_pos;
+            return buffer;
+        }
+    }
+    if (ring_buffer->last_read_ring_pos >= b) {
+        return NULL; // Already read
+    }
+    ring_buffer->last_read_ring_pos = b;
+    *sequence = b;
+    return ring_buffer->buffers + ((b % shared->num_buffers) * shared->buffer_size);
+}
+
+/*
+ * srb_subscriber_get_buffer_progress
+ *
+ * params:
+ *   ring_buffer - the ring buffer the buffer is from
+ *   sequence - the buffer's write sequence number, from srb_subscriber_get_next_partial_buffer
+ *
+ * returns:
+ *   how many bytes from the start of the buffer are complete, buffer_size once it has been published. As with any
+ *   buffer, it may be overwritten once the subscriber is num_buffers - 1 behind.
+ */
+uint64_t srb_subscriber_get_buffer_progress(struct ShmRingBuffer* ring_buffer, uint64_t sequence)
+{
+    struct ShmRingBufferShared* shared = ring_buffer->shared;
+    // The producer zeroes progress before moving on, so progress read between two equal positions is this buffer's
+    uint64_t pos = __atomic_load_n(&shared->write_ring_pos, __ATOMIC_ACQUIRE);
+    if (sequence < pos) {
+        return shared->buffer_size;
+    }
+    uint64_t bytes = __atomic_load_n(&shared->write_progress, __ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&shared->write_ring_pos, __ATOMIC_ACQUIRE) != pos) {
+        return shared->buffer_size;
+    }
+    return (bytes < shared->buffer_size) ? bytes : shared->buffer_size;
+}
+
+/*
+ * srb_subscriber_prefetch_next_unread_buffer
+ *   Hints the CPU to start loading the buffer srb_subscriber_get_next_unread_buffer would return next, without
+ *   consuming it, so it is on its way into cache while the current buffer is processed.
+ *
+ * params:
+ *   ring_buffer - the ring buffer to prefetch from
+ *   bytes - how much of the start of the buffer to prefetch (capped at buffer_size)
+ */
+void srb_subscriber_prefetch_next_unread_buffer(struct ShmRingBuffer* ring_buffer, uint64_t bytes)
+{
+    struct ShmRingBuffer peek = *ring_buffer; // Look ahead on a copy, so the read position is left alone
+    uint8_t* next = srb_subscriber_get_next_unread_buffer(&peek);
+    if (next == NULL) {
+        return;
+    }
+    if (bytes > ring_buffer->shared->buffer_size) {
+        bytes = ring_buffer->shared->buffer_size;
+    }
+    for (uint64_t i = 0; i < bytes; i += 64) {
+        __builtin_prefetch(next + i, 0, 3);
+    }
+}
+
+// ==================
+// Ring set functions
+// ==================
+
+/*
+ * srb_ring_set_new
+ *
+ * returns:
+ *   a new empty ring set, to be freed with srb_ring_set_free
+ */
+struct ShmRingBufferSet* srb_ring_set_new(void)
+{
+    struct ShmRingBufferSet* ring_set = calloc(1, sizeof(struct ShmRingBufferSet));
+    return ring_set;
+}
+
+/*
+ * srb_ring_set_add
+ *   Adds a ring to the set. If the ring already has unread buffers it is reported by the next srb_ring_set_wait.
+ *
+ * params:
+ *   ring_set - the ring set to add to
+ *   ring_buffer - the ring buffer to add, it must be in the same segment as the rings already in the set
+ *
+ * returns:
+ *   0 on success, or -1 if the ring is from a different segment
+ */
+int srb_ring_set_add(struct ShmRingBufferSet* ring_set, struct ShmRingBuffer* ring_buffer)
+{
+    if (ring_set->num_rings == 0) {
+        ring_set->head = ring_buffer->head;
+    } else if (ring_set->head != ring_buffer->head) {
+        return -1;
+    }
+    if (ring_set->num_rings == ring_set->capacity) {
+        ring_set->capacity = ring_set->capacity ? ring_set->capacity * 2 : 16;
+        ring_set->rings = realloc(ring_set->rings, ring_set->capacity * sizeof(struct ShmRingBuffer*));
+        ring_set->write_ring_pos = realloc(ring_set->write_ring_pos, ring_set->capacity * sizeof(uint64_t*));
+        ring_set->seen_write_ring_pos = realloc(ring_set->seen_write_ring_pos, ring_set->capacity * sizeof(uint64_t));
+    }
+
+    unsigned int i = ring_set->num_rings++;
+    uint64_t pos = __atomic_load_n(&ring_buffer->shared->write_ring_pos, __ATOMIC_SEQ_CST);
+    int has_unread = ((pos - 1) >= ring_buffer->shared->num_buffers) && ((pos - 1) > ring_buffer->last_read_ring_pos);
+    ring_set->rings[i] = ring_buffer;
+    ring_set->write_ring_pos[i] = &ring_buffer->shared->write_ring_pos;
+    ring_set->seen_write_ring_pos[i] = has_unread ? pos - 1 : pos;
+    return 0;
+}
+
+/*
+ * srb_ring_set_wait
+ *   Blocks on the segment's doorbell until any ring in the set has advanced since it was last reported. Each
+ *   advance is reported once, so drain a reported ring with srb_subscriber_get_next_unread_buffer.
+ *
+ * params:
+ *   ring_set - the ring set to wait on
+ *   ready - will be filled with the rings that advanced
+ *   max_ready - the number of entries in ready
+ *   timeout_ms - how long to wait, 0 to only poll, or -1 to wait until a ring advances or the host stops running
+ *
+ * returns:
+ *   the number of rings put in ready, 0 on timeout or if the host is no longer running
+ */
+unsigned int srb_ring_set_wait(struct ShmRingBufferSet* ring_set, struct ShmRingBuffer** ready, unsigned int max_ready, int timeout_ms)
+{
+    if ((ring_set->num_rings == 0) || (max_ready == 0)) {
+        return 0;
+    }
+    int64_t deadline = get_monotonic_ms() + timeout_ms;
+    while (1) {
+        // Read the doorbell before scanning, so an advance during the scan stops the wait below from blocking
+        unsigned int bell = __atomic_load_n(&ring_set->head->doorbell, __ATOMIC_SEQ_CST);
+        unsigned int num_ready = 0;
+        unsigned int i = ring_set->next_scan;
+        for (unsigned int n = 0; (n < ring_set->num_rings) && (num_ready < max_ready); n++) {
+            uint64_t pos = __atomic_load_n(ring_set->write_ring_pos[i], __ATOMIC_ACQUIRE);
+            if (pos != ring_set->seen_write_ring_pos[i]) {
+                ring_set->seen_write_ring_pos[i] = pos;
+                ready[num_ready++] = ring_set->rings[i];
+            }
+            if (++i == ring_set->num_rings) {
+                i = 0;
+            }
+        }
+        ring_set->next_scan = i;
+        if (num_ready || (ring_set->head->state != SRB_RUNNING)) {
+            return num_ready;
+        }
+
+        int remaining_ms = -1;
+        if (timeout_ms >= 0) {
+            int64_t now = get_monotonic_ms();
+            if (now >= deadline) {
+                return 0;
+            }
+            remaining_ms = deadline - now;
+        }
+        wait_doorbell(ring_set->head, bell, remaining_ms);
+    }
+}
+
+/*
+ * srb_ring_set_free
+ *
+ * params:
+ *   ring_set - the ring set to free, its rings are left untouched
+ */
+void srb_ring_set_free(struct ShmRingBufferSet* ring_set)
+{
+    free(ring_set->rings);
+    free(ring_set->write_ring_pos);
+    free(ring_set->seen_write_ring_pos);
+    free(ring_set);
+}
+
+// ===============
+// Merge functions
+// ===============
+
+/*
+ * merge_replay
+ *   Replays the matches on the path from a ring's leaf to the root, after its key changed. Each match is against
+ *   the winner of the sibling subtree, and ties go to the left, lower numbered, subtree. Which ring wins is as
+ *   good as random, so the matches are played without branches.
+ */
+static inline void merge_replay(struct ShmRingBufferMerge* merge, unsigned int ring)
+{
+    unsigned int* winners = merge->winners;
+    uint64_t* keys = merge->keys;
+    unsigned int winner = ring;
+    uint64_t winner_key = keys[ring];
+    for (unsigned int node = merge->num_leaves + ring; node > 1; node /= 2) {
+        unsigned int sibling = winners[node ^ 1];
+        uint64_t sibling_key = keys[sibling];
+        unsigned int sibling_wins = (sibling_key < winner_key) | ((sibling_key == winner_key) & node);
+        uint64_t mask = -(uint64_t)sibling_wins;
+        winner ^= (winner ^ sibling) & (unsigned int)mask;
+        winner_key ^= (winner_key ^ sibling_key) & mask;
+        winners[node / 2] = winner;
+    }
+}
+
+/*
+ * merge_fetch
+ *   Reads a ring's next unread buffer into the tree, counting any it skipped for having been overwritten.
+ */
+static inline void merge_fetch(struct ShmRingBufferMerge* merge, unsigned int ring)
+{
+    struct ShmRingBuffer* ring_buffer = merge->rings[ring];
+    unsigned int num_buffers = ring_buffer->shared->num_buffers;
+    uint64_t newest = __atomic_load_n(&ring_buffer->shared->write_ring_pos, __ATOMIC_ACQUIRE) - 1;
+    uint64_t pos = ring_buffer->last_read_ring_pos;
+    if (pos >= newest) {
+        merge->num_pending -= (merge->pending[ring] != NULL);
+        merge->pending[ring] = NULL;
+        merge->keys[ring] = UINT64_MAX;
+        return;
+    }
+    uint64_t floor = __atomic_load_n(&ring_buffer->shared->reclaim_floor, __ATOMIC_RELAXED);
+    if (pos + 1 < floor) {
+        // Older buffers were released while the ring was idle
+        merge->num_lost[ring] += floor - 1 - pos;
+        pos = floor - 1;
+        merge->slots[ring] = pos % num_buffers;
+    }
+    unsigned int slot = merge->slots[ring] + 1;
+    if (++pos + num_buffers - 1 <= newest) {
+        // Fallen too far behind, catch up to newest buffer
+        merge->num_lost[ring] += newest - pos;
+        pos = newest;
+        slot = pos % num_buffers;
+    } else if (slot == num_buffers) {
+        slot = 0;
+    }
+    ring_buffer->last_read_ring_pos = pos;
+    merge->slots[ring] = slot;
+    uint8_t* buffer = ring_buffer->buffers + slot * ring_buffer->shared->buffer_size;
+    merge->num_pending += (merge->pending[ring] == NULL);
+    merge->pending[ring] = buffer;
+    merge->keys[ring] = merge->key ? merge->key(ring_buffer, buffer, merge->user_data) : __atomic_load_n(&ring_buffer->timestamps[slot], __ATOMIC_RELAXED);
+}
+
+/*
+ * srb_merge_new
+ *
+ * params:
+ *   key - gives the key each buffer is ordered by, or NULL to order by buffer timestamps
+ *   user_data - passed to key
+ *
+ * returns:
+ *   a new empty merge, to be freed with srb_merge_free
+ */
+struct ShmRingBufferMerge* srb_merge_new(SRBMergeKey key, void* user_data)
+{
+    struct ShmRingBufferMerge* merge = calloc(1, sizeof(struct ShmRingBufferMerge));
+    merge->key = key;
+    merge->user_data = user_data;
+    return merge;
+}
+
+/*
+ * srb_merge_add
+ *   Adds a ring to the merge, which then reads it as srb_subscriber_get_next_unread_buffer would, except that a
+ *   ring not read before starts at its newest buffer and is read in full after it rather than jumping ahead, and
+ *   topic filters are not applied.
+ *
+ * params:
+ *   merge - the merge to add to
+ *   ring_buffer - the ring buffer to add, its buffers' keys must not decrease and must be below UINT64_MAX
+ *
+ * returns:
+ *   0 on success, or -1 if the merge orders by timestamps and the ring is not timestamped
+ */
+int srb_merge_add(struct ShmRingBufferMerge* merge, struct ShmRingBuffer* ring_buffer)
+{
+    if ((merge->key == NULL) && (ring_buffer->timestamps == NULL)) {
+        return -1;
+    }
+    if (merge->num_rings == merge->capacity) {
+        merge->capacity = merge->capacity ? merge->capacity * 2 : 16;
+        merge->rings = realloc(merge->rings, merge->capacity * sizeof(struct ShmRingBuffer*));
+        merge->pending = realloc(merge->pending, merge->capacity * sizeof(uint8_t*));
+        merge->slots = realloc(merge->slots, merge->capacity * sizeof(unsigned int));
+        merge->num_lost = realloc(merge->num_lost, merge->capacity * sizeof(uint64_t));
+    }
+    // A ring not read before starts at its newest buffer, and then every buffer after it is merged
+    uint64_t newest = __atomic_load_n(&ring_buffer->shared->write_ring_pos, __ATOMIC_ACQUIRE) - 1;
+    if (ring_buffer->last_read_ring_pos == 0) {
+        ring_buffer->last_read_ring_pos = ((newest > ring_buffer->shared->num_buffers) ? newest : ring_buffer->shared->num_buffers) - 1;
+    }
+
+    unsigned int i = merge->num_rings++;
+    merge->rings[i] = ring_buffer;
+    merge->pending[i] = NULL;
+    merge->slots[i] = ring_buffer->last_read_ring_pos % ring_buffer->shared->num_buffers;
+    merge->num_lost[i] = 0;
+    merge->emitted = merge->num_rings;
+
+    // Rebuild the tree whenever it outgrows its leaves, leaves without a ring have no buffer so never win
+    if (merge->num_rings > merge->num_leaves) {
+        merge->num_leaves = merge->num_leaves ? merge->num_leaves * 2 : 1;
+        merge->keys = realloc(merge->keys, merge->num_leaves * sizeof(uint64_t));
+        merge->winners = realloc(merge->winners, 2 * merge->num_leaves * sizeof(unsigned int));
+        for (unsigned int leaf = 0; leaf < merge->num_leaves; leaf++) {
+            merge->keys[leaf] = ((leaf < i) && merge->pending[leaf]) ? merge->keys[leaf] : UINT64_MAX;
+            merge->winners[merge->num_leaves + leaf] = leaf;
+        }
+        for (unsigned int leaf = 0; leaf < merge->num_leaves; leaf++) {
+            merge_replay(merge, leaf);
+        }
+    }
+    merge->keys[i] = UINT64_MAX;
+    merge_fetch(merge, i);
+    merge_replay(merge, i);
+    return 0;
+}
+
+/*
+ * srb_merge_next
+ *   Gives the unread buffer with the lowest key across all the merge's rings, ties going to the ring added first.
+ *   The rings are merged through a tournament tree, so each buffer costs a comparison per level of the tree.
+ *
+ * params:
+ *   merge - the merge to read
+ *   require_all - non-zero to only give a buffer while every ring has one unread, so a ring that is slow to
+ *     publish can never have a lower key come after it. Otherwise the rings that have something unread are merged.
+ *   ring_buffer - if not NULL, set to the ring the buffer came from
+ *   key - if not NULL, set to the buffer's key
+ *
+ * returns:
+ *   the buffer, which is valid until its ring's producer laps it, or NULL if there is nothing to give yet
+ */
+uint8_t* srb_merge_next(struct ShmRingBufferMerge* merge, int require_all, struct ShmRingBuffer** ring_buffer, uint64_t* key)
+{
+    // The ring given last is read on from here, so its buffer stayed put while the caller used it
+    if (merge->emitted < merge->num_rings) {
+        merge_fetch(merge, merge->emitted);
+        merge_replay(merge, merge->emitted);
+        merge->emitted = merge->num_rings;
+    }
+    // Rings that had nothing unread may have been published to since
+    for (unsigned int i = 0; (i < merge->num_rings) && (merge->num_pending < merge->num_rings); i++) {
+        if (merge->pending[i] == NULL) {
+            merge_fetch(merge, i);
+            if (merge->pending[i]) {
+                merge_replay(merge, i);
+            }
+        }
+    }
+
+    while ((merge->num_pending > 0) && (!require_all || (merge->num_pending == merge->num_rings))) {
+        unsigned int winner = merge->winners[1];
+        struct ShmRingBuffer* winner_ring = merge->rings[winner];
+        // A buffer that waited in the tree while its producer lapped it is lost, and the ring is read on from it
+        if (__atomic_load_n(&winner_ring->shared->write_ring_pos, __ATOMIC_ACQUIRE) >= winner_ring->last_read_ring_pos + winner_ring->shared->num_buffers) {
+            merge->num_lost[winner]++;
+            merge_fetch(merge, winner);
+            merge_replay(merge, winner);
+            continue;
+        }
+        if (ring_buffer) {
+            *ring_buffer = winner_ring;
+        }
+        if (key) {
+            *key = merge->keys[winner];
+        }
+        merge->emitted = winner;
+        return merge->pending[winner];
+    }
+    return NULL;
+}
+
+/*
+ * srb_merge_get_num_lost
+ *
+ * params:
+ *   merge - the merge
+ *   ring_buffer - the ring to count for, or NULL for all rings
+ *
+ * returns:
+ *   the number of buffers overwritten by their producer before the merge could give them
+ */
+uint64_t srb_merge_get_num_lost(struct ShmRingBufferMerge* merge, struct ShmRingBuffer* ring_buffer)
+{
+    uint64_t num_lost = 0;
+    for (unsigned int i = 0; i < merge->num_rings; i++) {
+        if ((ring_buffer == NULL) || (merge->rings[i] == ring_buffer)) {
+            num_lost += merge->num_lost[i];
+        }
+    }
+    return num_lost;
+}
+
+/*
+ * srb_merge_free
+ *
+ * params:
+ *   merge - the merge to free, its rings are left untouched
+ */
+void srb_merge_free(struct ShmRingBufferMerge* merge)
+{
+    free(merge->rings);
+    free(merge->pending);
+    free(merge->slots);
+    free(merge->keys);
+    free(merge->num_lost);
+    free(merge->winners);
+    free(merge);
+}
+
+// ==================
+// Dispatcher functions
+// ==================
+
+// Most buffers a worker consumes from a ring before giving other rings a turn
+#define DISPATCH_BATCH (16)
+
+/*
+ * dispatch_ring
+ *   Claims ring i for the calling worker, if no other worker has it, and drains up to DISPATCH_BATCH buffers.
+ *
+ * returns:
+ *   the number of buffers dispatched
+ */
+static unsigned int dispatch_ring(struct ShmRingBufferDispatcher* dispatcher, unsigned int i)
+{
+    unsigned int unclaimed = 0;
+    if (!__atomic_compare_exchange_n(&dispatcher->ring_claimed[i], &unclaimed, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+    struct ShmRingBuffer* ring_buffer = dispatcher->rings[i];
+    unsigned int num_dispatched = 0;
+    uint8_t* buffer;
+    while ((num_dispatched < DISPATCH_BATCH) && (buffer = srb_subscriber_get_next_unread_buffer(ring_buffer))) {
+        dispatcher->callback(ring_buffer, buffer, dispatcher->user_data);
+        num_dispatched++;
+    }
+    __atomic_store_n(&dispatcher->ring_claimed[i], 0, __ATOMIC_RELEASE);
+    return num_dispatched;
+}
+
+static void* dispatch_worker(void* arg)
+{
+    struct ShmRingBufferDispatchWorker* worker = arg;
+    struct ShmRingBufferDispatcher* dispatcher = worker->dispatcher;
+    unsigned int num_rings = dispatcher->num_rings;
+    unsigned int steal_from = worker->index;
+    while (__atomic_load_n(&dispatcher->running, __ATOMIC_ACQUIRE)) {
+        unsigned int bell = __atomic_load_n(&dispatcher->head->doorbell, __ATOMIC_SEQ_CST);
+
+        // Own rings first
+        unsigned int num_dispatched = 0;
+        for (unsigned int i = worker->index; i < num_rings; i += dispatcher->num_workers) {
+            num_dispatched += dispatch_ring(dispatcher, i);
+        }
+        if (num_dispatched) {
+            continue;
+        }
+
+        // Nothing of our own to do, steal from any ring with unread buffers that is not being consumed
+        for (unsigned int n = 0; (n < num_rings) && (num_dispatched == 0); n++) {
+            steal_from = (steal_from + 1) % num_rings;
+            if ((steal_from % dispatcher->num_workers) != worker->index) {
+                num_dispatched += dispatch_ring(dispatcher, steal_from);
+            }
+        }
+        if (num_dispatched == 0) {
+            // Also once the host stops, so idle workers sleep until srb_dispatcher_stop rather than spin
+            wait_doorbell(dispatcher->head, bell, 100);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * srb_dispatcher_new
+ *
+ * params:
+ *   num_workers - the number of worker threads to consume rings with
+ *   callback - called with every buffer read, concurrently for different rings but never for the same ring
+ *   user_data - passed through to callback
+ *
+ * returns:
+ *   a new dispatcher with no rings, to be freed with srb_dispatcher_free
+ */
+struct ShmRingBufferDispatcher* srb_dispatcher_new(unsigned int num_workers, SRBDispatchCallback callback, void* user_data)
+{
+    struct ShmRingBufferDispatcher* dispatcher = calloc(1, sizeof(struct ShmRingBufferDispatcher));
+    dispatcher->callback = callback;
+    dispatcher->user_data = user_data;
+    dispatcher->num_workers = num_workers ? num_workers : 1;
+    dispatcher->workers = calloc(dispatcher->num_workers, sizeof(struct ShmRingBufferDispatchWorker));
+    return dispatcher;
+}
+
+/*
+ * srb_dispatcher_add
+ *   Adds a ring for the dispatcher to consume. Rings can only be added while the dispatcher is stopped.
+ *
+ * params:
+ *   dispatcher - the dispatcher to add to
+ *   ring_buffer - the ring buffer to consume, it must be in the same segment as the rings already added
+ *
+ * returns:
+ *   0 on success, or -1 if the ring is from a different segment or the dispatcher is running
+ */
+int srb_dispatcher_add(struct ShmRingBufferDispatcher* dispatcher, struct ShmRingBuffer* ring_buffer)
+{
+    if (dispatcher->running) {
+        return -1;
+    }
+    if (dispatcher->num_rings == 0) {
+        dispatcher->head = ring_buffer->head;
+    } else if (dispatcher->head != ring_buffer->head) {
+        return -1;
+    }
+    if (dispatcher->num_rings == dispatcher->capacity) {
+        dispatcher->capacity = dispatcher->capacity ? dispatcher->capacity * 2 : 16;
+        dispatcher->rings = realloc(dispatcher->rings, dispatcher->capacity * sizeof(struct ShmRingBuffer*));
+        dispatcher->ring_claimed = realloc(dispatcher->ring_claimed, dispatcher->capacity * sizeof(unsigned int));
+    }
+    dispatcher->rings[dispatcher->num_rings] = ring_buffer;
+    dispatcher->ring_claimed[dispatcher->num_rings] = 0;
+    dispatcher->num_rings++;
+    return 0;
+}
+
+/*
+ * srb_dispatcher_start
+ *   Starts the worker threads. Each worker drains the rings it owns, and when those are empty steals any other
+ *   ring with unread buffers that no worker is consuming. A ring is consumed by one worker at a time, in order.
+ *
+ * params:
+ *   dispatcher - the dispatcher to start
+ *
+ * returns:
+ *   0 on success, or -1 if the worker threads could not be started
+ */
+int srb_dispatcher_start(struct ShmRingBufferDispatcher* dispatcher)
+{
+    if (dispatcher->running || (dispatcher->num_rings == 0)) {
+        return -1;
+    }
+    dispatcher->running = 1;
+    for (unsigned int w = 0; w < dispatcher->num_workers; w++) {
+        struct ShmRingBufferDispatchWorker* worker = dispatcher->workers + w;
+        worker->dispatcher = dispatcher;
+        worker->index = w;
+        if (pthread_create(&worker->thread, NULL, dispatch_worker, worker) != 0) {
+            fprintf(stderr, "Error starting dispatcher worker %u\n", w);
+            __atomic_store_n(&dispatcher->running, 0, __ATOMIC_RELEASE);
+            while (w--) {
+                pthread_join(dispatcher->workers[w].thread, NULL);
+            }
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * srb_dispatcher_stop
+ *   Stops and joins the worker threads, callbacks already running are finished first.
+ *
+ * params:
+ *   dispatcher - the dispatcher to stop
+ */
+void srb_dispatcher_stop(struct ShmRingBufferDispatcher* dispatcher)
+{
+    if (!dispatcher->running) {
+        return;
+    }
+    __atomic_store_n(&dispatcher->running, 0, __ATOMIC_RELEASE);
+    ring_doorbell(dispatcher->head); // Wake idle workers so they notice straight away
+    for (unsigned int w = 0; w < dispatcher->num_workers; w++) {
+        pthread_join(dispatcher->workers[w].thread, NULL);
+    }
+}
+
+/*
+ * srb_dispatcher_free
+ *
+ * params:
+ *   dispatcher - the dispatcher to free, it is stopped first if running
+ */
+void srb_dispatcher_free(struct ShmRingBufferDispatcher* dispatcher)
+{
+    srb_dispatcher_stop(dispatcher);
+    free(dispatcher->rings);
+    free(dispatcher->ring_claimed);
+    free(dispatcher->workers);
+    free(dispatcher);
+}
+
+// ==================
+// Notifier functions
+// ==================
+
+/*
+ * signal_notifier
+ *   Makes the notifier's descriptor readable, unless it already is.
+ */
+static void signal_notifier(struct ShmRingBufferNotifier* notifier)
+{
+    if (__atomic_exchange_n(&notifier->pending, 1, __ATOMIC_SEQ_CST) == 0) {
+        uint64_t one = 1;
+        if (write(notifier->write_fd, &one, sizeof(one)) < 0) {
+            // Already readable, the reader just hasn't cleared it yet
+        }
+    }
+}
+
+static void* notifier_thread(void* arg)
+{
+    struct ShmRingBufferNotifier* notifier = arg;
+    struct ShmRingBuffersHead* head = notifier->head;
+    unsigned int last_bell = __atomic_load_n(&head->doorbell, __ATOMIC_SEQ_CST);
+    enum EShmRingBuffersState last_state = head->state;
+    signal_notifier(notifier); // Rings may have advanced before the thread got going
+    while (__atomic_load_n(&notifier->running, __ATOMIC_ACQUIRE)) {
+        unsigned int bell = __atomic_load_n(&head->doorbell, __ATOMIC_SEQ_CST);
+        enum EShmRingBuffersState state = head->state;
+        if ((bell != last_bell) || (state != last_state)) {
+            signal_notifier(notifier);
+            last_bell = bell;
+            last_state = state;
+        }
+        // Wake up now and then to notice srb_notifier_free
+        wait_doorbell(head, bell, 100);
+    }
+    return NULL;
+}
+
+/*
+ * srb_notifier_new
+ *   Forwards the segment's doorbell to a file descriptor, so an event loop can wait for rings to advance with epoll,
+ *   io_uring or poll alongside its other descriptors. One thread per notifier blocks on the doorbell, and the file
+ *   descriptor is signalled once per batch of advances until it is cleared.
+ *
+ * params:
+ *   ring_buffers_handle - the handle to the ring buffer's shared memory
+ *
+ * returns:
+ *   a new notifier, to be freed with srb_notifier_free, or NULL if its descriptor or thread could not be created
+ */
+struct ShmRingBufferNotifier* srb_notifier_new(SRBHandle ring_buffers_handle)
+{
+    struct ShmRingBufferNotifier* notifier = calloc(1, sizeof(struct ShmRingBufferNotifier));
+    notifier->head = ring_buffers_handle->ring_buffers_head;
+#ifdef __linux__
+    notifier->read_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    notifier->write_fd = notifier->read_fd;
+    if (notifier->read_fd < 0) {
+        fprintf(stderr, "Error creating notifier eventfd\n");
+        free(notifier);
+        return NULL;
+    }
+#else
+    int fds[2];
+    if (pipe(fds) < 0) {
+        fprintf(stderr, "Error creating notifier pipe\n");
+        free(notifier);
+        return NULL;
+    }
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    notifier->read_fd = fds[0];
+    notifier->write_fd = fds[1];
+#endif
+    notifier->running = 1;
+    if (pthread_create(&notifier->thread, NULL, notifier_thread, notifier) != 0) {
+        fprintf(stderr, "Error starting notifier thread\n");
+        notifier->running = 0;
+        srb_notifier_free(notifier);
+        return NULL;
+    }
+    return notifier;
+}
+
+/*
+ * srb_notifier_get_fd
+ *
+ * params:
+ *   notifier - the notifier to get the file descriptor of
+ *
+ * returns:
+ *   a non-blocking file descriptor that becomes readable when any ring in the segment advances, or the host state
+ *   changes, and stays readable until srb_notifier_clear
+ */
+int srb_notifier_get_fd(struct ShmRingBufferNotifier* notifier)
+{
+    return notifier->read_fd;
+}
+
+/*
+ * srb_notifier_clear
+ *   Rearms the notifier. Call this before checking the rings, so an advance during the check signals again.
+ *
+ * params:
+ *   notifier - the notifier to clear
+ */
+void srb_notifier_clear(struct ShmRingBufferNotifier* notifier)
+{
+    // Drain before dropping pending, so a signal is never swallowed while pending stays set. An advance skipped
+    // in between happened before the caller's check, which sees it.
+    uint64_t count;
+    while (read(notifier->read_fd, &count, sizeof(count)) > 0) {
+    }
+    __atomic_store_n(&notifier->pending, 0, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * srb_notifier_free
+ *
+ * params:
+ *   notifier - the notifier to stop and free, along with its file descriptor
+ */
+void srb_notifier_free(struct ShmRingBufferNotifier* notifier)
+{
+    if (notifier->running) {
+        __atomic_store_n(&notifier->running, 0, __ATOMIC_RELEASE);
+        pthread_join(notifier->thread, NULL);
+    }
+    close(notifier->read_fd);
+    if (notifier->write_fd != notifier->read_fd) {
+        close(notifier->write_fd);
+    }
+    free(notifier);
+}
+
+// =================
+// Flusher functions
+// =================
+
+static void* flusher_thread(void* arg)
+{
+    struct ShmRingBufferFlusher* flusher = arg;
+    while (__atomic_load_n(&flusher->running, __ATOMIC_ACQUIRE)) {
+        int64_t deadline = get_monotonic_ms() + flusher->interval_ms;
+        srb_host_flush_rings(flusher->handle);
+        // Nap in short slices to notice srb_flusher_free
+        for (int64_t now = get_monotonic_ms(); (now < deadline) && __atomic_load_n(&flusher->running, __ATOMIC_ACQUIRE); now = get_monotonic_ms()) {
+            usleep(((deadline - now) < 10 ? (deadline - now) : 10) * 1000);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * srb_flusher_new
+ *   Starts a thread that calls srb_host_flush_rings every interval_ms, so producers of persisted rings never wait
+ *   on the disk. Free it before closing the handle.
+ *
+ * params:
+ *   ring_buffers_handle - the host's handle to the ring buffer's shared memory
+ *   interval_ms - how often to flush, which bounds how much a power cut can lose
+ *
+ * returns:
+ *   a new flusher, to be freed with srb_flusher_free, or NULL if the handle is not the host's or the thread could
+ *   not be started
+ */
+struct ShmRingBufferFlusher* srb_flusher_new(SRBHandle ring_buffers_handle, unsigned int interval_ms)
+{
+    if (!ring_buffers_handle->is_host) {
+        return NULL;
+    }
+    struct ShmRingBufferFlusher* flusher = calloc(1, sizeof(struct ShmRingBufferFlusher));
+    flusher->handle = ring_buffers_handle;
+    flusher->interval_ms = interval_ms;
+    flusher->running = 1;
+    if (pthread_create(&flusher->thread, NULL, flusher_thread, flusher) != 0) {
+        fprintf(stderr, "Error starting flusher thread\n");
+        free(flusher);
+        return NULL;
+    }
+    return flusher;
+}
+
+/*
+ * srb_flusher_free
+ *   Stops the flusher's thread, and flushes once more.
+ *
+ * params:
+ *   flusher - the flusher to stop and free
+ */
+void srb_flusher_free(struct ShmRingBufferFlusher* flusher)
+{
+    __atomic_store_n(&flusher->running, 0, __ATOMIC_RELEASE);
+    pthread_join(flusher->thread, NULL);
+    srb_host_flush_rings(flusher->handle);
+    free(flusher);
+}
+
+// ==================
+// Producer functions
+// ==================
+
+/*
+ * finish_write_buffer
+ *   Works out the checksum and dirty tiles of the buffer about to be published, if the producer did not set them.
+ */
+static void finish_write_buffer(struct ShmRingBuffer* ring_buffer)
+{
+    struct ShmRingBufferShared* shared = ring_buffer->shared;
+    if (ring_buffer->checksums && !ring_buffer->checksum_set && (shared->write_ring_pos >= shared->num_buffers)) {
+        // The producer did not checksum the buffer it is publishing, so do the whole of it
+        uint64_t b = shared->write_ring_pos % shared->num_buffers;
+        ring_buffer->checksums[b].length = shared->buffer_size;
+        ring_buffer->checksums[b].crc = srb_crc32c(0, ring_buffer->buffers + b * shared->buffer_size, shared->buffer_size);
+    }
+    ring_buffer->checksum_set = 0;
+    if (ring_buffer->dirty_tiles && !ring_buffer->dirty_set && (shared->write_ring_pos > shared->num_buffers)) {
+        // The producer did not mark what changed, so compare with the buffer before
+        uint64_t b = shared->write_ring_pos % shared->num_buffers;
+        uint64_t previous = (shared->write_ring_pos - 1) % shared->num_buffers;
+        find_dirty_tiles(ring_buffer->buffers + b * shared->buffer_size, ring_buffer->buffers + previous * shared->buffer_size, shared->buffer_size,
+            shared->dirty_tile_size, ring_buffer->dirty_tiles + b * ring_buffer->dirty_words, ring_buffer->dirty_words);
+    }
+    ring_buffer->dirty_set = 0;
+    __atomic_store_n(&shared->write_progress, 0, __ATOMIC_RELAXED); // Ordered before the new position is seen
+}
+
+/*
+ * start_write_buffer
+ *   Readies the slot of write sequence pos, once write_ring_pos has been advanced to it.
+ *
+ * returns:
+ *   the buffer to write
+ */
+static uint8_t* start_write_buffer(struct ShmRingBuffer* ring_buffer, uint64_t pos)
+{
+    struct ShmRingBufferShared* shared = ring_buffer->shared;
+    uint64_t b = pos % shared->num_buffers;
+    if (__atomic_load_n(&shared->reclaim_state, __ATOMIC_SEQ_CST) != SRB_RING_ACTIVE) {
+        // Host saw this ring idle, wait for it to finish releasing pages before writing to the slot.
+        while (__atomic_load_n(&shared->reclaim_state, __ATOMIC_SEQ_CST) == SRB_RING_RECLAIMING) {
+            sched_yield();
+        }
+        __atomic_store_n(&shared->reclaim_state, SRB_RING_ACTIVE, __ATOMIC_SEQ_CST);
+    }
+    if (ring_buffer->timestamps) {
+        // Until the producer says otherwise, a buffer's time is when it was started
+        __atomic_store_n(&ring_buffer->timestamps[b], get_monotonic_ns(), __ATOMIC_RELAXED);
+    }
+    if (ring_buffer->dirty_tiles) {
+        // Marks start from nothing, except on the first buffer which has nothing before it
+        memset(ring_buffer->dirty_tiles + b * ring_buffer->dirty_words, (pos > shared->num_buffers) ? 0 : 0xff, ring_buffer->dirty_words * sizeof(uint64_t));
+    }
+    return ring_buffer->buffers + (b * shared->buffer_size);
+}
+
+/*
+ * srb_producer_next_write_buffer
+ *   this function returns the next shared write buffer.
+ *
+ * params:
+ *   ring_buffer - the ring buffer to get the next shared buffer from
+ *
+ * return:
+ *   pointer to the next shared buffer
+ */
+uint8_t* srb_producer_next_write_buffer(struct ShmRingBuffer* ring_buffer)
 {
-    in_size /= 4096;
-    return 4096 * (in_size + 1);
+    finish_write_buffer(ring_buffer);
+    uint64_t pos = __atomic_add_fetch(&ring_buffer->shared->write_ring_pos, 1, __ATOMIC_SEQ_CST);
+    uint8_t* buffer = start_write_buffer(ring_buffer, pos);
+    ring_doorbell(ring_buffer->head); // The previous buffer is now readable
+    return buffer;
+}
+
+/*
+ * srb_producer_set_buffer_timestamp
+ *   Sets the timestamp of the buffer being written, such as the capture time of a sensor reading, in place of the
+ *   time it was started. Timestamps within a ring must not decrease.
+ *
+ * params:
+ *   ring_buffer - the timestamped ring buffer being written
+ *   timestamp - the buffer's timestamp
+ */
+void srb_producer_set_buffer_timestamp(struct ShmRingBuffer* ring_buffer, uint64_t timestamp)
+{
+    if (ring_buffer->timestamps) {
+        // Published along with the buffer, when write_ring_pos moves past it
+        uint64_t b = ring_buffer->shared->write_ring_pos % ring_buffer->shared->num_buffers;
+        __atomic_store_n(&ring_buffer->timestamps[b], timestamp, __ATOMIC_RELAXED);
+    }
+}
+
+/*
+ * srb_producer_set_buffer_checksum
+ *   Sets the CRC32C of the first length bytes of the buffer being written on a checksummed ring. Without this,
+ *   the CRC32C of the whole buffer is computed when it is published.
+ *
+ * params:
+ *   ring_buffer - the checksummed ring buffer being written
+ *   crc - the CRC32C, from srb_producer_stream_copy_checksum or srb_crc32c
+ *   length - the number of bytes from the start of the buffer it covers
+ */
+void srb_producer_set_buffer_checksum(struct ShmRingBuffer* ring_buffer, uint32_t crc, uint64_t length)
+{
+    if (ring_buffer->checksums) {
+        // Published along with the buffer, when write_ring_pos moves past it
+        struct ShmBufferChecksum* checksum = ring_buffer->checksums + ring_buffer->shared->write_ring_pos % ring_buffer->shared->num_buffers;
+        checksum->length = length;
+        checksum->crc = crc;
+        ring_buffer->checksum_set = 1;
+    }
+}
+
+/*
+ * srb_producer_mark_dirty
+ *   Marks a range of the buffer being written on a dirty tracked ring as changed from the buffer before it. The
+ *   buffer must still be written in full, marking only saves subscribers copying the rest. Without any marks, the
+ *   changed tiles are found by comparing the buffer with the one before it when it is published.
+ *
+ * params:
+ *   ring_buffer - the dirty tracked ring buffer being written
+ *   offset - the start of the changed range in the buffer
+ *   length - the number of bytes changed
+ */
+void srb_producer_mark_dirty(struct ShmRingBuffer* ring_buffer, uint64_t offset, uint64_t length)
+{
+    struct ShmRingBufferShared* shared = ring_buffer->shared;
+    if ((ring_buffer->dirty_tiles == NULL) || (offset >= shared->buffer_size) || (length == 0)) {
+        return;
+    }
+    if (length > shared->buffer_size - offset) {
+        length = shared->buffer_size - offset;
+    }
+    // Published along with the buffer, when write_ring_pos moves past it
+    uint64_t* dirty = ring_buffer->dirty_tiles + (shared->write_ring_pos % shared->num_buffers) * ring_buffer->dirty_words;
+    uint64_t last = (offset + length - 1) / shared->dirty_tile_size;
+    for (uint64_t tile = offset / shared->dirty_tile_size; tile <= last; tile++) {
+        dirty[tile / 64] |= (uint64_t)1 << (tile % 64);
+    }
+    ring_buffer->dirty_set = 1;
+}
+
+/*
+ * srb_producer_set_write_progress
+ *   Tells subscribers that the first bytes of the buffer being written are complete, such as the rows of a frame
+ *   written so far. Progress starts at 0 for every new buffer and should only increase.
+ *
+ * params:
+ *   ring_buffer - the ring buffer being written
+ *   bytes - how many bytes from the start of the current write buffer are complete
+ */
+void srb_producer_set_write_progress(struct ShmRingBuffer* ring_buffer, uint64_t bytes)
+{
+    __atomic_store_n(&ring_buffer->shared->write_progress, bytes, __ATOMIC_RELEASE);
+}
+
+/*
+ * srb_producer_next_write_buffers
+ *   srb_producer_next_write_buffer for several rings as one transaction: the buffers previously written to all of
+ *   the rings are published together, in a single publish epoch. Rings read with
+ *   srb_subscriber_get_most_recent_buffers should only be written this way. Checksums and dirty tiles of the
+ *   buffers are worked out first, so other producers and readers only wait on the write positions being advanced.
+ *
+ * params:
+ *   ring_buffers - the ring buffers to publish, all in the same segment
+ *   num_rings - the number of ring buffers
+ *   buffers - will be set to each ring's next shared buffer
+ *
+ * return:
+ *   the publish epoch of this transaction
+ */
+uint64_t srb_producer_next_write_buffers(struct ShmRingBuffer** ring_buffers, unsigned int num_rings, uint8_t** buffers)
+{
+    if (num_rings == 0) {
+        return 0;
+    }
+    for (unsigned int i = 0; i < num_rings; i++) {
+        finish_write_buffer(ring_buffers[i]);
+    }
+
+    // Make the epoch odd, this also excludes producers of other rings in the segment until we are done, so only
+    // the write positions are advanced while it is held
+    uint64_t* epoch = &ring_buffers[0]->head->publish_epoch;
+    uint64_t start = __atomic_load_n(epoch, __ATOMIC_RELAXED);
+    do {
+        while (start & 1) {
+            sched_yield();
+            start = __atomic_load_n(epoch, __ATOMIC_RELAXED);
+        }
+    } while (!__atomic_compare_exchange_n(epoch, &start, start + 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+    for (unsigned int i = 0; i < num_rings; i++) {
+        __atomic_add_fetch(&ring_buffers[i]->shared->write_ring_pos, 1, __ATOMIC_SEQ_CST);
+    }
+    __atomic_store_n(epoch, start + 2, __ATOMIC_RELEASE);
+
+    // Each ring has only one producer, so its write position is still where this left it
+    for (unsigned int i = 0; i < num_rings; i++) {
+        buffers[i] = start_write_buffer(ring_buffers[i], __atomic_load_n(&ring_buffers[i]->shared->write_ring_pos, __ATOMIC_RELAXED));
+    }
+    ring_doorbell(ring_buffers[0]->head); // The previous buffers are now readable
+    return (start + 2) / 2;
+}
+
+/*
+ * srb_producer_next_write_topic_buffer
+ *   this function returns the next shared write buffer of a multiplexed ring, tagged with topic.
+ *
+ * params:
+ *   ring_buffer - the multiplexed ring buffer to get the next shared buffer from
+ *   topic - the topic id subscribers will see for this buffer (ignored if the ring is not multiplexed)
+ *
+ * return:
+ *   pointer to the next shared buffer
+ */
+uint8_t* srb_producer_next_write_topic_buffer(struct ShmRingBuffer* ring_buffer, uint16_t topic)
+{
+    uint8_t* buffer = srb_producer_next_write_buffer(ring_buffer);
+    if (ring_buffer->topic_ids) {
+        // Subscribers only look at this slot's topic once write_ring_pos moves past it
+        ring_buffer->topic_ids[ring_buffer->shared->write_ring_pos % ring_buffer->shared->num_buffers] = topic;
+    }
+    return buffer;
+}
+
+/*
+ * srb_producer_publish_block
+ *   Writes a reference to block into the next write buffer of a ring whose buffer_size fits a struct ShmBlockRef.
+ *   The ring holds its own reference to the block until the slot is reused, so the same block can be published
+ *   to any number of rings. The caller's reference is left untouched.
+ *
+ * params:
+ *   ring_buffer - the ring buffer to publish to
+ *   block - the block id to publish, the caller must hold a reference to it
+ *   length - the bytes of the block in use
+ *
+ * returns:
+ *   0 on success, or -1 if the ring's buffers are too small or the segment has no block pool
+ */
+int srb_producer_publish_block(struct ShmRingBuffer* ring_buffer, uint32_t block, uint64_t length)
+{
+    struct ShmBlockPoolShared* pool = get_block_pool(ring_buffer->head);
+    if ((pool == NULL) || (ring_buffer->shared->buffer_size < sizeof(struct ShmBlockRef))) {
+        return -1;
+    }
+    if (!ring_buffer->shared->holds_blocks) {
+        __atomic_store_n(&ring_buffer->shared->holds_blocks, 1, __ATOMIC_SEQ_CST);
+    }
+    __atomic_add_fetch(&pool->block_states[block - 1].refcount, 1, __ATOMIC_RELAXED); // The ring's reference
+    struct ShmBlockRef* ref = (struct ShmBlockRef*)srb_producer_next_write_buffer(ring_buffer);
+    if (ref->block) {
+        release_block(pool, ref->block); // Drop the reference of the block this slot held a lap ago
+    }
+    ref->length = length;
+    __atomic_store_n(&ref->block, block, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/*
+ * srb_producer_stream_copy
+ *   Copies size bytes into a write buffer with non-temporal (cache bypassing) stores, using the widest of
+ *   AVX-512, AVX2 or SSE2 the CPU supports, then fences so the data is visible before the buffer is published.
+ *   Use this for large buffers subscribers won't read straight away, so filling them doesn't evict the
+ *   producer's working set. Small copies, and CPUs without streaming stores, fall back to memcpy.
+ *
+ * params:
+ *   buffer - the write buffer (or block) to copy into
+ *   src - the data to copy
+ *   size - the number of bytes to copy
+ */
+void srb_producer_stream_copy(uint8_t* buffer, const void* src, uint64_t size)
+{
+#ifdef SRB_X86_STREAMING
+    const struct StreamOps* ops = get_stream_ops();
+    if (ops && (size >= STREAM_MIN_SIZE)) {
+        // Regular stores up to the first aligned address and for the tail, streaming stores in between
+        uint64_t head = (ops->alignment - ((uintptr_t)buffer & (ops->alignment - 1))) & (ops->alignment - 1);
+        uint64_t body = (size - head) & ~(ops->alignment - 1);
+        memcpy(buffer, src, head);
+        ops->copy(buffer + head, (const uint8_t*)src + head, body);
+        memcpy(buffer + head + body, (const uint8_t*)src + head + body, size - head - body);
+        _mm_sfence();
+        return;
+    }
+#endif
+    memcpy(buffer, src, size);
+}
+
+/*
+ * srb_producer_stream_fill
+ *   Like srb_producer_stream_copy, but sets size bytes of the buffer to value.
+ *
+ * params:
+ *   buffer - the write buffer (or block) to fill
+ *   value - the byte to fill with
+ *   size - the number of bytes to fill
+ */
+void srb_producer_stream_fill(uint8_t* buffer, uint8_t value, uint64_t size)
+{
+#ifdef SRB_X86_STREAMING
+    const struct StreamOps* ops = get_stream_ops();
+    if (ops && (size >= STREAM_MIN_SIZE)) {
+        uint64_t head = (ops->alignment - ((uintptr_t)buffer & (ops->alignment - 1))) & (ops->alignment - 1);
+        uint64_t body = (size - head) & ~(ops->alignment - 1);
+        memset(buffer, value, head);
+        ops->fill(buffer + head, value, body);
+        memset(buffer + head + body, value, size - head - body);
+        _mm_sfence();
+        return;
+    }
+#endif
+    memset(buffer, value, size);
+}
+
+/*
+ * srb_producer_stream_copy_checksum
+ *   srb_producer_stream_copy, computing the CRC32C of the bytes as they are copied, so checksumming needs no
+ *   pass of its own over memory.
+ *
+ * params:
+ *   buffer - the write buffer (or block) to copy into
+ *   src - the data to copy
+ *   size - the number of bytes to copy
+ *   crc - the CRC32C of the buffer's bytes before these, or 0 to start
+ *
+ * returns:
+ *   the CRC32C of the buffer up to and including the copied bytes, for srb_producer_set_buffer_checksum
+ */
+uint32_t srb_producer_stream_copy_checksum(uint8_t* buffer, const void* src, uint64_t size, uint32_t crc)
+{
+    const uint8_t* from = (const uint8_t*)src;
+    int streams;
+    Crc32cKernel kernel = get_crc32c_kernel(&streams);
+    crc = ~crc;
+    if (streams && (size >= STREAM_MIN_SIZE)) {
+        // Regular stores up to the first 16 byte aligned address, then the kernel copies with streaming stores
+        uint64_t head = (16 - ((uintptr_t)buffer & 15)) & 15;
+        crc = kernel(crc, from, NULL, head);
+        memcpy(buffer, from, head);
+        crc = kernel(crc, from + head, buffer + head, size - head);
+#ifdef SRB_X86_STREAMING
+        _mm_sfence();
+#endif
+    } else {
+        crc = kernel(crc, from, NULL, size);
+        memcpy(buffer, from, size);
+    }
+    return ~crc;
 }
 
 // ====================
-// Subscriber functions
+// Block pool functions
 // ====================
 
 /*
- * srb_subscriber_get_most_recent_buffer_id
+ * srb_block_alloc
  *
  * params:
- *   ring_buffer - the ring buffer to get the most recent buffer id
+ *   ring_buffers_handle - the handle to the ring buffer's shared memory
  *
  * returns:
- *   the most recent buffer id, that is not currently set as the write_ring_pos, or 0 if no valid buffers exist
+ *   the block id of a free block, referenced once by the caller, or 0 if the pool is exhausted or missing
  */
-unsigned int srb_subscriber_get_most_recent_buffer_id(struct ShmRingBuffer* ring_buffer)
+uint32_t srb_block_alloc(SRBHandle ring_buffers_handle)
 {
-    return ring_buffer->shared->write_ring_pos - ring_buffer->shared->num_buffers;
+    struct ShmBlockPoolShared* pool = ring_buffers_handle->block_pool;
+    if (pool == NULL) {
+        return 0;
+    }
+    uint64_t head = __atomic_load_n(&pool->free_head, __ATOMIC_ACQUIRE);
+    uint32_t block;
+    uint64_t new_head;
+    do {
+        block = (uint32_t)head;
+        if (block == 0) {
+            return 0; // Exhausted
+        }
+        new_head = (((head >> 32) + 1) << 32) | __atomic_load_n(&pool->block_states[block - 1].next_free, __ATOMIC_RELAXED);
+    } while (!__atomic_compare_exchange_n(&pool->free_head, &head, new_head, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    __atomic_store_n(&pool->block_states[block - 1].refcount, 1, __ATOMIC_RELEASE);
+    return block;
 }
 
 /*
- * srb_subscriber_get_most_recent_buffer
+ * srb_block_get
  *
  * params:
- *   ring_buffer - the ring buffer to get the most recent buffer
+ *   ring_buffers_handle - the handle to the ring buffer's shared memory
+ *   block - the block id, the caller must hold a reference to it
  *
  * returns:
- *   the most recent buffer that is not currently set as the write_ring_pos, or NULL if no valid buffers exist
+ *   pointer to the block's block_size bytes
  */
-uint8_t* srb_subscriber_get_most_recent_buffer(struct ShmRingBuffer* ring_buffer)
+uint8_t* srb_block_get(SRBHandle ring_buffers_handle, uint32_t block)
 {
-    unsigned int b = ring_buffer->shared->write_ring_pos - 1;
-    if (b < ring_buffer->shared->num_buffers) {
-        return NULL; // No buffers yet.
-    }
-    b = b % ring_buffer->shared->num_buffers;
-    return ring_buffer->buffers + (b * ring_buffer->shared->buffer_size);
+    return ring_buffers_handle->blocks + ((block - 1) * ring_buffers_handle->block_pool->block_size);
 }
 
 /*
- * srb_subscriber_get_next_unread_buffer
+ * srb_block_acquire
+ *   Takes another reference to a block, e.g. to hand it on to another stage.
  *
  * params:
- *   ring_buffer - the ring buffer to get the next unread buffer
+ *   ring_buffers_handle - the handle to the ring buffer's shared memory
+ *   block - the block id, the caller must already hold a reference to it
+ */
+void srb_block_acquire(SRBHandle ring_buffers_handle, uint32_t block)
+{
+    __atomic_add_fetch(&ring_buffers_handle->block_pool->block_states[block - 1].refcount, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * srb_block_release
+ *   Drops a reference to a block, the last one returns it to the pool.
+ *
+ * params:
+ *   ring_buffers_handle - the handle to the ring buffer's shared memory
+ *   block - the block id
+ */
+void srb_block_release(SRBHandle ring_buffers_handle, uint32_t block)
+{
+    release_block(ring_buffers_handle->block_pool, block);
+}
+
+/*
+ * srb_block_pool_num_free
+ *
+ * params:
+ *   ring_buffers_handle - the handle to the ring buffer's shared memory
  *
  * returns:
- *   the next unread buffer up until to write_ring_pos - 1, or NULL if no buffers meet this criteria
+ *   the number of blocks currently in the pool's free list
  */
-uint8_t* srb_subscriber_get_next_unread_buffer(struct ShmRingBuffer* ring_buffer)
+unsigned int srb_block_pool_num_free(SRBHandle ring_buffers_handle)
 {
-    unsigned int b = ring_buffer->shared->write_ring_pos - 1;
-    if (b < ring_buffer->shared->num_buffers) {
-        return NULL; // No buffers yet.
+    struct ShmBlockPoolShared* pool = ring_buffers_handle->block_pool;
+    unsigned int num_free = 0;
+    for (unsigned int i = 0; pool && (i < pool->num_blocks); i++) {
+        if (__atomic_load_n(&pool->block_states[i].refcount, __ATOMIC_RELAXED) == 0) {
+            num_free++;
+        }
     }
-    if (ring_buffer->last_read_ring_pos >= b) {
-        return NULL; // All caught up.
+    return num_free;
+}
+
+// =====================
+// State table functions
+// =====================
+
+static struct ShmStateEntryShared* get_state_entry(struct ShmStateTable* state_table, unsigned int slot)
+{
+    return (struct ShmStateEntryShared*)(state_table->entries + slot * state_table->shared->entry_size);
+}
+
+/*
+ * find_state_slot
+ *   Probes linearly from the key's hashed slot. As slots are never freed, the first unused slot ends the search.
+ *
+ * returns:
+ *   1 with slot set to the key's slot, or 0 with slot set to the unused slot the key would go in
+ */
+static int find_state_slot(struct ShmStateTable* state_table, uint64_t key, unsigned int* slot)
+{
+    unsigned int mask = state_table->shared->num_slots - 1;
+    unsigned int i = (unsigned int)((key * 0x9E3779B97F4A7C15ull) >> state_table->slot_shift);
+    while (1) {
+        struct ShmStateEntryShared* entry = get_state_entry(state_table, i);
+        if (!__atomic_load_n(&entry->in_use, __ATOMIC_ACQUIRE)) {
+            *slot = i;
+            return 0;
+        }
+        if (entry->key == key) {
+            *slot = i;
+            return 1;
+        }
+        i = (i + 1) & mask;
     }
-    ring_buffer->last_read_ring_pos++;
-    b -= ring_buffer->last_read_ring_pos;
-    if (b >= (ring_buffer->shared->num_buffers - 1)) {
-        ring_buffer->last_read_ring_pos += b; // Fallen too far behind, catch up to newest buffer
+}
+
+/*
+ * load_state_table
+ *   Makes a local view of a state table, kept on the handle until close.
+ */
+static struct ShmStateTable* load_state_table(SRBHandle handle, struct ShmStateTableShared* shared)
+{
+    uint8_t* m = handle->mem_map;
+    struct ShmStateTable* state_table = malloc(sizeof(struct ShmStateTable));
+    state_table->description = (char*)(m + shared->description_offset);
+    state_table->shared = shared;
+    state_table->entries = m + shared->entries_offset;
+    state_table->log = (uint32_t*)(m + shared->log_offset);
+    state_table->slot_shift = 64;
+    for (unsigned int num_slots = shared->num_slots; num_slots > 1; num_slots /= 2) {
+        state_table->slot_shift--;
     }
-    b = ring_buffer->last_read_ring_pos % ring_buffer->shared->num_buffers;
-    return ring_buffer->buffers + (b * ring_buffer->shared->buffer_size);
+    state_table->next = handle->state_tables;
+    handle->state_tables = state_table;
+    return state_table;
+}
+
+struct StateChange {
+    uint64_t changed;
+    uint64_t key;
+};
+
+static int compare_state_changes(const void* a, const void* b)
+{
+    uint64_t changed_a = ((const struct StateChange*)a)->changed;
+    uint64_t changed_b = ((const struct StateChange*)b)->changed;
+    return (changed_a > changed_b) - (changed_a < changed_b);
 }
 
 /*
- * srb_client_get_state
+ * srb_get_state_table
  *
  * params:
  *   ring_buffers_handle - the handle to the ring buffer's shared memory
+ *   description - the description the table was added with
  *
  * returns:
- *   the run state of the host
+ *   the state table, or NULL if there is no such table or the grown segment could not be mapped
  */
-enum EShmRingBuffersState srb_client_get_state(SRBHandle ring_buffers_handle)
+struct ShmStateTable* srb_get_state_table(SRBHandle ring_buffers_handle, const char* description)
 {
-    return ring_buffers_handle->ring_buffers_head->state;
+    SRBHandle handle = ring_buffers_handle;
+    for (struct ShmStateTable* state_table = handle->state_tables; state_table; state_table = state_table->next) {
+        if (strcmp(state_table->description, description) == 0) {
+            return state_table;
+        }
+    }
+
+    // Tables added since the handle last grew its mapping are past its end
+    uint64_t offset = __atomic_load_n(&handle->ring_buffers_head->state_tables_offset, __ATOMIC_ACQUIRE);
+    struct stat shm_stat;
+    if ((offset >= handle->shm_size) && ((fstat(handle->shm_fd, &shm_stat) < 0) || (grow_mapping(handle, shm_stat.st_size) < 0))) {
+        fprintf(stderr, "Error mapping grown shm object (%s)\n", handle->shm_path);
+        return NULL;
+    }
+    while (offset) {
+        struct ShmStateTableShared* shared = (struct ShmStateTableShared*)(handle->mem_map + offset);
+        if (strcmp((char*)(handle->mem_map + shared->description_offset), description) == 0) {
+            return load_state_table(handle, shared);
+        }
+        offset = shared->next_offset;
+    }
+    return NULL;
 }
 
-// ==================
-// Producer functions
-// ==================
+/*
+ * srb_state_table_update
+ *   Sets the latest value of a key, adding the key if it is new. Only one thread or process may update a table,
+ *   readers are never blocked by it.
+ *
+ * params:
+ *   state_table - the state table
+ *   key - the key
+ *   value - the table's value_size bytes to store
+ *
+ * returns:
+ *   0 on success, or -1 if the key is new and the table already holds capacity keys
+ */
+int srb_state_table_update(struct ShmStateTable* state_table, uint64_t key, const void* value)
+{
+    struct ShmStateTableShared* shared = state_table->shared;
+    unsigned int slot;
+    int found = find_state_slot(state_table, key, &slot);
+    if (!found && (shared->num_keys >= shared->capacity)) {
+        return -1;
+    }
+    struct ShmStateEntryShared* entry = get_state_entry(state_table, slot);
+    uint64_t seq = entry->seq;
+    unsigned int copy = (seq / 2 + 1) % 2;
+    if (found) {
+        // Readers of the other copy carry on, those starting on this copy now will see they need to retry
+        __atomic_store_n(&entry->seq, seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+    } else {
+        entry->key = key;
+    }
+    uint64_t change = shared->change_sequence + 1;
+    memcpy(entry->values + copy * get_state_value_stride(shared->value_size), value, shared->value_size);
+    __atomic_store_n(&entry->copy_changed[copy], change, __ATOMIC_RELAXED);
+    __atomic_store_n(&entry->changed, change, __ATOMIC_RELAXED);
+    __atomic_store_n(&entry->seq, seq + 2, __ATOMIC_RELEASE);
+    if (!found) {
+        shared->num_keys++;
+        __atomic_store_n(&entry->in_use, 1, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&state_table->log[change % shared->num_slots], slot, __ATOMIC_RELAXED);
+    __atomic_store_n(&shared->change_sequence, change, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/*
+ * srb_state_table_read
+ *   Copies the latest value of a key, never one torn by an update in progress. This is lock-free, not wait-free:
+ *   it retries whenever the key is updated twice while it copies, so a writer updating one key flat out can keep
+ *   a reader of that key retrying for as long as it does.
+ *
+ * params:
+ *   state_table - the state table
+ *   key - the key
+ *   value - where to copy the table's value_size bytes
+ *   changed - if not NULL, set to the change sequence of the value copied
+ *
+ * returns:
+ *   1 if the key was found, otherwise 0
+ */
+int srb_state_table_read(struct ShmStateTable* state_table, uint64_t key, void* value, uint64_t* changed)
+{
+    unsigned int slot;
+    if (!find_state_slot(state_table, key, &slot)) {
+        return 0;
+    }
+    struct ShmStateEntryShared* entry = get_state_entry(state_table, slot);
+    uint64_t value_size = state_table->shared->value_size;
+    uint64_t stride = get_state_value_stride(value_size);
+    while (1) {
+        uint64_t seq = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+        unsigned int copy = (seq / 2) % 2;
+        memcpy(value, entry->values + copy * stride, value_size);
+        uint64_t copy_changed = __atomic_load_n(&entry->copy_changed[copy], __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        // The copy read is only written again by the update after the next one, so one update meanwhile is fine
+        if (__atomic_load_n(&entry->seq, __ATOMIC_RELAXED) <= (seq & ~(uint64_t)1) + 2) {
+            if (changed) {
+                *changed = copy_changed;
+            }
+            return 1;
+        }
+    }
+}
+
+/*
+ * srb_state_table_get_change_sequence
+ *
+ * params:
+ *   state_table - the state table
+ *
+ * returns:
+ *   the number of updates made to the table so far, compare it with a previous call to see if anything changed
+ */
+uint64_t srb_state_table_get_change_sequence(struct ShmStateTable* state_table)
+{
+    return __atomic_load_n(&state_table->shared->change_sequence, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * srb_state_table_get_changes
+ *   Finds the keys updated since a change sequence, each reported once however often it changed, oldest change
+ *   first. This reads a log of recent changes, and only scans the whole table if the log has moved on too far.
+ *
+ * params:
+ *   state_table - the state table
+ *   since - the change sequence last seen, 0 at first, advanced past the changes reported
+ *   keys - array of at least max_keys to fill with the changed keys
+ *   max_keys - the most keys to report, call again with the advanced since if max_keys are reported
+ *
+ * returns:
+ *   the number of keys filled in
+ */
+unsigned int srb_state_table_get_changes(struct ShmStateTable* state_table, uint64_t* since, uint64_t* keys, unsigned int max_keys)
+{
+    struct ShmStateTableShared* shared = state_table->shared;
+    uint64_t from = *since;
+    uint64_t until = __atomic_load_n(&shared->change_sequence, __ATOMIC_ACQUIRE);
+    if ((until <= from) || (max_keys == 0)) {
+        return 0;
+    }
+
+    unsigned int num_keys = 0;
+    if (until - from <= shared->num_slots) {
+        uint64_t s = from;
+        while ((s < until) && (num_keys < max_keys)) {
+            s++;
+            struct ShmStateEntryShared* entry = get_state_entry(state_table, __atomic_load_n(&state_table->log[s % shared->num_slots], __ATOMIC_RELAXED));
+            // Only a key's latest change is reported, so a key changed many times is reported once
+            if (__atomic_load_n(&entry->changed, __ATOMIC_ACQUIRE) == s) {
+                keys[num_keys++] = entry->key;
+            }
+        }
+        // What was read is good as long as the log has not since wrapped onto from + 1
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&shared->change_sequence, __ATOMIC_RELAXED) - from <= shared->num_slots) {
+            *since = s;
+            return num_keys;
+        }
+    }
+
+    // Too far behind, so scan every slot for keys changed in (from, until] and report the oldest changes first
+    struct StateChange* changes = malloc(sizeof(struct StateChange) * shared->capacity);
+    num_keys = 0;
+    for (unsigned int i = 0; (i < shared->num_slots) && (num_keys < shared->capacity); i++) {
+        struct ShmStateEntryShared* entry = get_state_entry(state_table, i);
+        if (__atomic_load_n(&entry->in_use, __ATOMIC_ACQUIRE)) {
+            uint64_t changed = __atomic_load_n(&entry->changed, __ATOMIC_ACQUIRE);
+            if ((changed > from) && (changed <= until)) {
+                changes[num_keys].changed = changed;
+                changes[num_keys++].key = entry->key;
+            }
+        }
+    }
+    qsort(changes, num_keys, sizeof(struct StateChange), compare_state_changes);
+    if (num_keys > max_keys) {
+        num_keys = max_keys;
+        *since = changes[num_keys - 1].changed;
+    } else {
+        *since = until;
+    }
+    for (unsigned int i = 0; i < num_keys; i++) {
+        keys[i] = changes[i].key;
+    }
+    free(changes);
+    return num_keys;
+}
+
+// =================================================
+// Common functions to producer and subscriber sides
+// =================================================
 
 /*
- * srb_producer_next_write_buffer
- *   this function returns the next shared write buffer.
+ * srb_crc32c
+ *   Computes the CRC32C (Castagnoli) of data, with the SSE4.2 or ARMv8 CRC instructions where the CPU has them.
  *
  * params:
- *   ring_buffer - the ring buffer to get the next shared buffer from
+ *   crc - the CRC32C of the data before this, or 0 to start
+ *   data - the data to checksum
+ *   size - the number of bytes of data
  *
- * return:
- *   pointer to the next shared buffer
+ * returns:
+ *   the CRC32C of everything so far
  */
-uint8_t* srb_producer_next_write_buffer(struct ShmRingBuffer* ring_buffer)
+uint32_t srb_crc32c(uint32_t crc, const void* data, uint64_t size)
 {
-    unsigned int b = ++(ring_buffer->shared->write_ring_pos) % ring_buffer->shared->num_buffers;
-    return ring_buffer->buffers + (b * ring_buffer->shared->buffer_size);
+    return ~get_crc32c_kernel(NULL)(~crc, (const uint8_t*)data, NULL, size);
 }
 
-// =================================================
-// Common functions to producer and subscriber sides
-// =================================================
-
 /*
  * srb_host_new
  *
@@ -147,28 +3059,81 @@ uint8_t* srb_producer_next_write_buffer(struct ShmRingBuffer* ring_buffer)
  *   shm_path - shared memory path
  *   num_defs - the number of ringbuffers you are defining
  *   ring_buffer_defs - array of {struct ShmRingBuffer}s which will be created in the mmap based on the supplied members:
- *        buffer_size, num_buffers, and description. (these can be freed if wanted after this call)
+ *        buffer_size, num_buffers, description, multiplexed, timestamped, checksummed, dirty_tracked, and persist_path. (these can be freed if wanted after this call)
  *
  * returns:
  *   the SRBHandle that references the shared memory ring buffers. This is usually followed up with srb_get_rings call.
  */
 SRBHandle srb_host_new(const char* shm_path, unsigned int num_defs, struct ShmRingBufferDef* ring_buffer_defs)
+{
+    return srb_host_new_with_pool(shm_path, num_defs, ring_buffer_defs, NULL);
+}
+
+/*
+ * srb_host_new_with_pool
+ *   srb_host_new, plus a pool of refcounted blocks that rings can publish references to instead of payloads.
+ *
+ * params:
+ *   shm_path - shared memory path
+ *   num_defs - the number of ringbuffers you are defining
+ *   ring_buffer_defs - as for srb_host_new
+ *   block_pool_def - the block_size and num_blocks of the pool, or NULL for no pool
+ *
+ * returns:
+ *   the SRBHandle that references the shared memory ring buffers. This is usually followed up with srb_get_rings call.
+ */
+SRBHandle srb_host_new_with_pool(const char* shm_path, unsigned int num_defs, struct ShmRingBufferDef* ring_buffer_defs, struct ShmBlockPoolDef* block_pool_def)
 {
     // Ascertain sizes of everything
-    int head_size = sizeof(struct ShmRingBuffersHead);
-    int rb_size = sizeof(struct ShmRingBufferShared);
-    int descriptions_offset = head_size + rb_size * num_defs;
-    int descriptions_size = 0;
-    int buffers_size = 0;
+    uint64_t head_size = sizeof(struct ShmRingBuffersHead);
+    uint64_t rb_size = sizeof(struct ShmRingBufferShared);
+    uint64_t descriptions_offset = head_size + rb_size * num_defs;
+    uint64_t descriptions_size = 0;
+    uint64_t topic_ids_size = 0;
+    uint64_t timestamps_size = 0;
+    uint64_t checksums_size = 0;
+    uint64_t dirty_size = 0;
+    uint64_t buffers_size = 0;
     for (unsigned int i = 0; i < num_defs; i++) {
         if (ring_buffer_defs[i].description) {
             descriptions_size += strlen(ring_buffer_defs[i].description);
         }
         descriptions_size++;
+        if (ring_buffer_defs[i].persist_path) {
+            descriptions_size += strlen(ring_buffer_defs[i].persist_path) + 1; // Kept after the description
+        }
+        if (ring_buffer_defs[i].multiplexed) {
+            topic_ids_size += get_topic_ids_size(ring_buffer_defs[i].num_buffers);
+        }
+        if (ring_buffer_defs[i].timestamped) {
+            timestamps_size += get_timestamps_size(ring_buffer_defs[i].num_buffers);
+        }
+        if (ring_buffer_defs[i].checksummed) {
+            checksums_size += get_checksums_size(ring_buffer_defs[i].num_buffers);
+        }
+        if (ring_buffer_defs[i].dirty_tracked) {
+            dirty_size += get_dirty_size(ring_buffer_defs[i].buffer_size, ring_buffer_defs[i].num_buffers);
+        }
         buffers_size += ring_buffer_defs[i].num_buffers * ring_buffer_defs[i].buffer_size;
     }
-    int buffers_offset = get_aligned_size(descriptions_offset + descriptions_size);
-    int total_size = buffers_offset + buffers_size;
+    uint64_t directory_offset = ((descriptions_offset + descriptions_size + 7) / 8) * 8;
+    uint64_t topic_ids_offset = ((directory_offset + sizeof(struct ShmRingDirectory) + num_defs * sizeof(uint64_t) + 63) / 64) * 64;
+    uint64_t timestamps_offset = topic_ids_offset + topic_ids_size;
+    uint64_t checksums_offset = timestamps_offset + timestamps_size;
+    uint64_t dirty_offset = checksums_offset + checksums_size;
+    uint64_t buffers_offset = get_aligned_size(dirty_offset + dirty_size);
+    uint64_t total_size = buffers_offset + buffers_size;
+    uint64_t block_pool_offset = 0;
+    uint64_t blocks_offset = 0;
+    uint64_t block_size = 0;
+    if (block_pool_def && block_pool_def->num_blocks) {
+        // The pool's block states and then its cache line aligned blocks follow the ring buffers
+        block_size = ((block_pool_def->block_size + 63) / 64) * 64;
+        block_pool_offset = get_aligned_size(total_size);
+        uint64_t block_states_size = block_pool_def->num_blocks * sizeof(struct ShmBlockShared);
+        blocks_offset = ((block_pool_offset + sizeof(struct ShmBlockPoolShared) + block_states_size + 63) / 64) * 64;
+        total_size = blocks_offset + (uint64_t)block_pool_def->num_blocks * block_size;
+    }
 
     // Create shared memory object
     int shmfd = shm_open(shm_path, O_CREAT | O_RDWR, S_IRWXU);
@@ -177,11 +3142,24 @@ SRBHandle srb_host_new(const char* shm_path, unsigned int num_defs, struct ShmRi
         return NULL;
     }
     if (ftruncate(shmfd, total_size) < 0) {
-        fprintf(stderr, "Error truncating shm object (%s) at size: %d\n", shm_path, total_size);
+        fprintf(stderr, "Error truncating shm object (%s) at size: %" PRIu64 "\n", shm_path, total_size);
+        close(shmfd);
+        shm_unlink(shm_path);
+        return NULL;
+    }
+    uint64_t growth = SRB_SEGMENT_GROWTH;
+    if ((total_size <= SIZE_MAX) && (SIZE_MAX - total_size < growth)) {
+        // Whatever is left of size_t, so max_size can always be passed to mmap
+        growth = ((SIZE_MAX - total_size) / 4096) * 4096;
+    }
+    uint64_t max_size = total_size + growth;
+    uint8_t* m = map_segment(shmfd, total_size, max_size);
+    if (m == NULL) {
+        fprintf(stderr, "Error mapping shm object (%s)\n", shm_path);
         close(shmfd);
         shm_unlink(shm_path);
+        return NULL;
     }
-    uint8_t* m = (uint8_t*)mmap(NULL, total_size, PROT_READ | PROT_WRITE, MAP_SHARED, shmfd, 0);
 
     // Create the memory mapped structure
     SRBHandle handle = malloc(sizeof(struct ShmRingBuffersLocal));
@@ -190,34 +3168,78 @@ SRBHandle srb_host_new(const char* shm_path, unsigned int num_defs, struct ShmRi
     handle->mem_map = m;
     handle->shm_path = strdup(shm_path);
     handle->shm_size = total_size;
+    handle->ringbuffers = NULL;
+    handle->num_ringbuffers = 0;
+    handle->old_ringbuffers = NULL;
+    handle->num_old_ringbuffers = 0;
+    handle->retired_rings = NULL;
+    handle->num_retired_rings = 0;
+    handle->state_tables = NULL;
+    handle->ring_files = NULL;
     struct ShmRingBuffersHead* head = handle->ring_buffers_head = (struct ShmRingBuffersHead*)m;
     head->state = SRB_STOPPED;
     head->num_ringbuffers = num_defs;
-    struct ShmRingBuffer* ringbuffers = handle->ringbuffers = malloc(sizeof(struct ShmRingBuffer) * num_defs);
+    head->doorbell = 0;
+    head->doorbell_waiters = 0;
+    head->block_pool_offset = block_pool_offset;
+    head->publish_epoch = 0;
+    head->directory_offset = directory_offset;
+    head->generation = 0;
+    head->max_size = max_size;
+    head->state_tables_offset = 0;
+    handle->block_pool = get_block_pool(head);
+    handle->blocks = blocks_offset ? m + blocks_offset : NULL;
+    if (handle->block_pool) {
+        struct ShmBlockPoolShared* pool = handle->block_pool;
+        pool->block_size = block_size;
+        pool->num_blocks = block_pool_def->num_blocks;
+        pool->blocks_offset = blocks_offset;
+        for (unsigned int i = 0; i < pool->num_blocks; i++) {
+            pool->block_states[i].refcount = 0;
+            pool->block_states[i].next_free = (i + 1 < pool->num_blocks) ? i + 2 : 0;
+        }
+        pool->free_head = 1;
+    }
 
+    struct ShmRingDirectory* directory = (struct ShmRingDirectory*)(m + directory_offset);
+    directory->num_ringbuffers = num_defs;
     char* description = (char*)(m + descriptions_offset);
+    uint16_t* topic_ids = (uint16_t*)(m + topic_ids_offset);
+    uint64_t* timestamps = (uint64_t*)(m + timestamps_offset);
+    struct ShmBufferChecksum* checksums = (struct ShmBufferChecksum*)(m + checksums_offset);
+    uint64_t* dirty_tiles = (uint64_t*)(m + dirty_offset);
     uint8_t* buffer = m + buffers_offset;
     struct ShmRingBufferShared* ringbuffer = (struct ShmRingBufferShared*)(m + head_size);
     for (unsigned int i = 0; i < num_defs; i++) {
-        struct ShmRingBuffer* dest = ringbuffers + i;
-        dest->shared = ringbuffer;
         struct ShmRingBufferDef* src = ring_buffer_defs + i;
-        dest->shared->num_buffers = src->num_buffers;
-        dest->shared->buffer_size = src->buffer_size;
-        dest->shared->write_ring_pos = src->num_buffers - 1;
-        dest->description = description;
-        if (src->description) {
-            strcpy(description, src->description);
-        } else {
-            description[0] = 0; // zero length string for null src description
+        init_ring(m, ringbuffer, src, description, topic_ids, timestamps, checksums, dirty_tiles, buffer);
+        directory->ring_offsets[i] = (uint8_t*)ringbuffer - m;
+        description += strlen(description) + 1;
+        if (src->persist_path) {
+            if (create_ring_file(handle, ringbuffer, src, description) < 0) {
+                srb_close(handle);
+                return NULL;
+            }
+            description += strlen(description) + 1; // Past its file path
         }
-        dest->buffers = buffer;
-
-        if (i < (num_defs - 1)) {
-            description += strlen(description) + 1;
-            buffer += dest->shared->num_buffers * dest->shared->buffer_size;
-            ringbuffer++;
+        ringbuffer++;
+        if (src->multiplexed) {
+            topic_ids += get_topic_ids_size(src->num_buffers) / sizeof(uint16_t);
         }
+        if (src->timestamped) {
+            timestamps += get_timestamps_size(src->num_buffers) / sizeof(uint64_t);
+        }
+        if (src->checksummed) {
+            checksums += get_checksums_size(src->num_buffers) / sizeof(struct ShmBufferChecksum);
+        }
+        if (src->dirty_tracked) {
+            dirty_tiles += get_dirty_size(src->buffer_size, src->num_buffers) / sizeof(uint64_t);
+        }
+        buffer += src->num_buffers * src->buffer_size;
+    }
+    if (load_directory(handle) < 0) {
+        srb_close(handle);
+        return NULL;
     }
     head->state = SRB_RUNNING;
 
@@ -237,7 +3259,393 @@ void srb_host_signal_stopping(SRBHandle ring_buffers_handle)
     SRBHandle handle = ring_buffers_handle;
     if (handle->is_host) {
         handle->ring_buffers_head->state = SRB_STOPPING;
+        ring_doorbell(handle->ring_buffers_head); // Wake ring sets so they notice
+    }
+}
+
+/*
+ * reclaim_ring
+ *   srb_host_reclaim_idle_rings for one ring.
+ *
+ * returns:
+ *   1 if the ring's memory was released, otherwise 0
+ */
+static unsigned int reclaim_ring(SRBHandle handle, struct ShmRingBuffer* rb, int64_t now, unsigned int idle_seconds)
+{
+    struct ShmRingBufferShared* shared = rb->shared;
+    uint64_t pos = __atomic_load_n(&shared->write_ring_pos, __ATOMIC_SEQ_CST);
+    if (pos != rb->last_seen_write_ring_pos) {
+        rb->last_seen_write_ring_pos = pos;
+        rb->last_activity_time = now;
+        return 0;
+    }
+    if ((shared->num_buffers < 3) || ((now - rb->last_activity_time) < idle_seconds) || shared->holds_blocks || shared->persist_path_offset
+        || (__atomic_load_n(&shared->reclaim_state, __ATOMIC_SEQ_CST) != SRB_RING_ACTIVE)) {
+        return 0;
+    }
+
+    // Announce the reclaim, then make sure the producer did not advance in the meantime. A producer that
+    // advances after this point sees SRB_RING_RECLAIMING and waits for us to finish.
+    __atomic_store_n(&shared->reclaim_state, SRB_RING_RECLAIMING, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&shared->write_ring_pos, __ATOMIC_SEQ_CST) != pos) {
+        __atomic_store_n(&shared->reclaim_state, SRB_RING_ACTIVE, __ATOMIC_SEQ_CST);
+        return 0;
+    }
+
+    // Readers skip to the most recent buffer from now on, so they never read a released slot, or check it against
+    // the checksum or timestamp of what was there before
+    __atomic_store_n(&shared->reclaim_floor, pos - 1, __ATOMIC_SEQ_CST);
+
+    // Keep the slot being written and the most recent slot, release the rest (at most two contiguous runs)
+    uint64_t offset = rb->buffers - handle->mem_map;
+    uint64_t size = shared->buffer_size;
+    unsigned int writing = pos % shared->num_buffers;
+    unsigned int recent = (pos - 1) % shared->num_buffers;
+    if (writing < recent) {
+        release_pages(handle, offset + (writing + 1) * size, offset + recent * size);
+    } else {
+        release_pages(handle, offset + (writing + 1) * size, offset + shared->num_buffers * size);
+        release_pages(handle, offset, offset + recent * size);
+    }
+    __atomic_store_n(&shared->reclaim_state, SRB_RING_RECLAIMED, __ATOMIC_SEQ_CST);
+    return 1;
+}
+
+/*
+ * srb_host_reclaim_idle_rings
+ *   Call this periodically from host to release the memory of rings whose write_ring_pos has not advanced for
+ *   idle_seconds. The slot being written and the most recent slot are kept, all other slots have their pages
+ *   released (fallocate PUNCH_HOLE, or MADV_REMOVE). Pages are committed again lazily when the producer resumes.
+ *   Subscribers that had fallen behind skip ahead to the most recent buffer, as the ones before it are gone.
+ *   Rings that hold block pool references are never released, as that would leak their blocks, nor are persisted
+ *   rings, whose files keep their buffers. Retired rings are released like any other once their producers have
+ *   moved on.
+ *
+ * params:
+ *   ring_buffers_handle - the handle to the ring buffer's shared memory
+ *   idle_seconds - how long a ring must be idle before its memory is released
+ *
+ * returns:
+ *   the number of rings released by this call
+ */
+unsigned int srb_host_reclaim_idle_rings(SRBHandle ring_buffers_handle, unsigned int idle_seconds)
+{
+    SRBHandle handle = ring_buffers_handle;
+    if (!handle->is_host) {
+        return 0;
+    }
+    int64_t now = get_monotonic_seconds();
+    unsigned int num_reclaimed = 0;
+    for (unsigned int i = 0; i < handle->num_ringbuffers; i++) {
+        num_reclaimed += reclaim_ring(handle, handle->ringbuffers + i, now, idle_seconds);
+    }
+    for (unsigned int i = 0; i < handle->num_retired_rings; i++) {
+        num_reclaimed += reclaim_ring(handle, handle->retired_rings + i, now, idle_seconds);
+    }
+    return num_reclaimed;
+}
+
+/*
+ * write_file
+ *   pwrite, carrying on after short writes.
+ *
+ * returns:
+ *   0 on success, or -1 on a write error
+ */
+static int write_file(int fd, const void* src, uint64_t size, uint64_t offset)
+{
+    const uint8_t* bytes = (const uint8_t*)src;
+    while (size) {
+        ssize_t written = pwrite(fd, bytes, size, offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        bytes += written;
+        size -= written;
+        offset += written;
+    }
+    return 0;
+}
+
+/*
+ * write_ring_file_slots
+ *   Copies slots [from, to) of a persisted ring from the segment to its file, the buffers as one sequential run
+ *   and then their topic ids, timestamps, checksums and dirty tiles.
+ *
+ * returns:
+ *   0 on success, or -1 on a write error
+ */
+static int write_ring_file_slots(SRBHandle handle, struct ShmRingBufferFile* file, uint64_t from, uint64_t to)
+{
+    struct ShmRingBufferShared* shared = file->shared;
+    struct ShmRingBufferShared* persisted = &file->persisted;
+    uint8_t* m = handle->mem_map;
+    uint64_t size = shared->buffer_size;
+    int result = write_file(file->fd, m + shared->buffers_offset + from * size, (to - from) * size, persisted->buffers_offset + from * size);
+    if (shared->topic_ids_offset) {
+        size = sizeof(uint16_t);
+        result |= write_file(file->fd, m + shared->topic_ids_offset + from * size, (to - from) * size, persisted->topic_ids_offset + from * size);
+    }
+    if (shared->timestamps_offset) {
+        size = sizeof(uint64_t);
+        result |= write_file(file->fd, m + shared->timestamps_offset + from * size, (to - from) * size, persisted->timestamps_offset + from * size);
+    }
+    if (shared->checksums_offset) {
+        size = sizeof(struct ShmBufferChecksum);
+        result |= write_file(file->fd, m + shared->checksums_offset + from * size, (to - from) * size, persisted->checksums_offset + from * size);
+    }
+    if (shared->dirty_offset) {
+        size = get_dirty_words(shared->buffer_size) * sizeof(uint64_t);
+        result |= write_file(file->fd, m + shared->dirty_offset + from * size, (to - from) * size, persisted->dirty_offset + from * size);
+    }
+    return result ? -1 : 0;
+}
+
+/*
+ * srb_host_flush_rings
+ *   Copies the buffers published to persisted rings since the last flush from the segment to their files, as one or
+ *   two sequential runs per ring, fdatasyncs them so they are out of the drive's cache too, and only then advances
+ *   each file's write position past them. The flusher is the only writer of the files, so after a crash or power cut
+ *   a file holds exactly the buffers of its last completed flush. Buffers the producer overwrote while they were
+ *   being copied, when it got a whole ring ahead of the flusher, are left out of the file rather than saved torn.
+ *   Call it from one thread at a time, srb_flusher_new starts a thread that calls it periodically.
+ *
+ * params:
+ *   ring_buffers_handle - the host's handle to the ring buffer's shared memory
+ *
+ * returns:
+ *   0 on success, or -1 if a file could not be written, in which case its buffers are written again next time
+ */
+int srb_host_flush_rings(SRBHandle ring_buffers_handle)
+{
+    SRBHandle handle = ring_buffers_handle;
+    if (!handle->is_host) {
+        return -1;
+    }
+    int result = 0;
+    struct ShmRingBufferFile* files = __atomic_load_n(&handle->ring_files, __ATOMIC_ACQUIRE);
+    for (struct ShmRingBufferFile* file = files; file; file = file->next) {
+        struct ShmRingBufferShared* shared = file->shared;
+        uint64_t n = shared->num_buffers;
+        // The buffer at write_ring_pos is still being written, everything before it is complete
+        uint64_t to = __atomic_load_n(&shared->write_ring_pos, __ATOMIC_ACQUIRE);
+        if (to == file->flushed_write_ring_pos) {
+            continue;
+        }
+        // Only the newest num_buffers - 1 buffers are still in the ring, and there are none before num_buffers
+        uint64_t from = file->flushed_write_ring_pos;
+        from = (from < to - n + 1) ? to - n + 1 : from;
+        from = (from < n) ? n : from;
+        int written = 0;
+        if (from < to) {
+            if (from % n < to % n) {
+                written = write_ring_file_slots(handle, file, from % n, to % n);
+            } else {
+                written = write_ring_file_slots(handle, file, from % n, n) | write_ring_file_slots(handle, file, 0, to % n);
+            }
+        }
+        // Slots the producer moved on to while they were copied may be torn, the file only claims what came after
+        uint64_t moved_on = __atomic_load_n(&shared->write_ring_pos, __ATOMIC_ACQUIRE) - n + 1;
+        if ((moved_on > from) && (moved_on > file->persisted.reclaim_floor)) {
+            file->persisted.reclaim_floor = (moved_on < to) ? moved_on : to;
+        }
+        if (written < 0) {
+            result = -1;
+            continue;
+        }
+        file->flushing_write_ring_pos = to;
+    }
+    for (struct ShmRingBufferFile* file = files; file; file = file->next) {
+        if (file->flushing_write_ring_pos == file->flushed_write_ring_pos) {
+            continue;
+        }
+        // The data is on disk, drive cache included, before the file claims it
+        file->persisted.write_ring_pos = file->flushing_write_ring_pos;
+        if ((fdatasync(file->fd) < 0) || (write_file(file->fd, &file->persisted, sizeof(struct ShmRingBufferShared), sizeof(struct ShmRingBuffersHead)) < 0)) {
+            file->flushing_write_ring_pos = file->flushed_write_ring_pos;
+            result = -1;
+        }
+    }
+    for (struct ShmRingBufferFile* file = files; file; file = file->next) {
+        if (file->flushing_write_ring_pos == file->flushed_write_ring_pos) {
+            continue;
+        }
+        if (fdatasync(file->fd) < 0) {
+            file->flushing_write_ring_pos = file->flushed_write_ring_pos;
+            result = -1;
+            continue;
+        }
+        file->flushed_write_ring_pos = file->flushing_write_ring_pos;
+    }
+    return result;
+}
+
+/*
+ * srb_host_add_ring
+ *   Adds a ring to a live segment. The segment grows to fit it, nothing already in it moves, so every other
+ *   ring carries on undisturbed. Clients see the new ring once they call srb_client_refresh.
+ *   Space is never reused, as clients may still hold rings from before a change, so each add, retire and resize
+ *   uses up part of the growth reserved when the segment was created, see srb_host_get_growth_headroom.
+ *
+ * params:
+ *   ring_buffers_handle - the handle to the ring buffer's shared memory
+ *   ring_buffer_def - the buffer_size, num_buffers, description, multiplexed, timestamped, checksummed, dirty_tracked, and persist_path of the new ring
+ *
+ * returns:
+ *   the new ring buffer, or NULL if the segment could not grow to fit it or its file could not be created
+ */
+struct ShmRingBuffer* srb_host_add_ring(SRBHandle ring_buffers_handle, struct ShmRingBufferDef* ring_buffer_def)
+{
+    SRBHandle handle = ring_buffers_handle;
+    if (!handle->is_host || (ring_buffer_def->num_buffers < 3)) {
+        return NULL;
     }
+    struct ShmRingBufferShared* shared = change_rings(handle, ring_buffer_def, NULL);
+    if ((shared == NULL) || (load_directory(handle) < 0)) {
+        return NULL;
+    }
+    return find_local_ring(handle, shared);
+}
+
+/*
+ * srb_host_retire_ring
+ *   Removes a ring from the segment's directory. Clients still using it can keep doing so until they refresh,
+ *   and its memory is released by srb_host_reclaim_idle_rings once it goes idle.
+ *
+ * params:
+ *   ring_buffers_handle - the handle to the ring buffer's shared memory
+ *   description - the description of the ring to retire
+ *
+ * returns:
+ *   0 on success, or -1 if there is no such ring or the segment could not grow to fit the new directory
+ */
+int srb_host_retire_ring(SRBHandle ring_buffers_handle, const char* description)
+{
+    SRBHandle handle = ring_buffers_handle;
+    struct ShmRingBuffer* ring = srb_get_ring_by_description(handle, (char*)description);
+    if (!handle->is_host || (ring == NULL) || (change_rings(handle, NULL, ring->shared) == NULL)) {
+        return -1;
+    }
+    keep_retired_ring(handle, ring);
+    return load_directory(handle);
+}
+
+/*
+ * srb_host_resize_ring
+ *   Replaces a ring with a copy that has num_buffers buffers, in the same place in the directory. The replacement
+ *   starts with the old ring's most recent buffer, and the old ring is retired. The replacement and a new directory
+ *   are appended to the segment like srb_host_add_ring, so resizing large rings repeatedly runs out of growth.
+ *
+ * params:
+ *   ring_buffers_handle - the handle to the ring buffer's shared memory
+ *   description - the description of the ring to resize
+ *   num_buffers - the new number of buffers, at least 3
+ *
+ * returns:
+ *   the replacement ring buffer, or NULL if there is no such ring, it is persisted, or the segment could not grow to fit it
+ */
+struct ShmRingBuffer* srb_host_resize_ring(SRBHandle ring_buffers_handle, const char* description, unsigned int num_buffers)
+{
+    SRBHandle handle = ring_buffers_handle;
+    struct ShmRingBuffer* ring = srb_get_ring_by_description(handle, (char*)description);
+    if (!handle->is_host || (ring == NULL) || (num_buffers < 3) || ring->shared->persist_path_offset) {
+        return NULL;
+    }
+    struct ShmRingBufferDef def = {
+        .buffer_size = ring->shared->buffer_size,
+        .num_buffers = num_buffers,
+        .description = ring->description,
+        .multiplexed = ring->topic_ids != NULL,
+        .timestamped = ring->timestamps != NULL,
+        .checksummed = ring->checksums != NULL,
+        .dirty_tracked = ring->dirty_tiles != NULL,
+    };
+    struct ShmRingBufferShared* shared = change_rings(handle, &def, ring->shared);
+    if (shared == NULL) {
+        return NULL;
+    }
+    keep_retired_ring(handle, ring);
+    if (load_directory(handle) < 0) {
+        return NULL;
+    }
+    return find_local_ring(handle, shared);
+}
+
+/*
+ * srb_host_get_growth_headroom
+ *   How much further the segment can grow for ring changes. This is reserved when the segment is created, 64 GiB
+ *   on 64-bit targets and 256 MiB on 32-bit ones, and is never given back while the host runs.
+ *
+ * params:
+ *   ring_buffers_handle - the handle to the ring buffer's shared memory
+ *
+ * returns:
+ *   the number of bytes the segment can still grow by
+ */
+uint64_t srb_host_get_growth_headroom(SRBHandle ring_buffers_handle)
+{
+    SRBHandle handle = ring_buffers_handle;
+    uint64_t used = get_aligned_size(handle->shm_size); // Changes start a fresh region here
+    uint64_t max_size = handle->ring_buffers_head->max_size;
+    return (used < max_size) ? max_size - used : 0;
+}
+
+/*
+ * srb_host_add_state_table
+ *   Adds a keyed table of latest values to the segment, for state that only matters as of its latest update.
+ *
+ * params:
+ *   ring_buffers_handle - the handle to the ring buffer's shared memory
+ *   state_table_def - the capacity, value_size and description of the table (these can be freed after this call)
+ *
+ * returns:
+ *   the new state table, or NULL if the description is taken or the segment could not grow to fit it
+ */
+struct ShmStateTable* srb_host_add_state_table(SRBHandle ring_buffers_handle, struct ShmStateTableDef* state_table_def)
+{
+    SRBHandle handle = ring_buffers_handle;
+    const char* description = state_table_def->description ? state_table_def->description : "";
+    if (!handle->is_host || (state_table_def->capacity < 1) || (state_table_def->capacity > (1u << 30)) || (state_table_def->value_size < 1)
+        || srb_get_state_table(handle, description)) {
+        return NULL;
+    }
+
+    // Ascertain sizes of everything
+    unsigned int num_slots = 2;
+    while (num_slots < 2 * state_table_def->capacity) {
+        num_slots *= 2;
+    }
+    uint64_t entry_size = get_state_entry_size(state_table_def->value_size);
+    uint64_t region_offset = get_aligned_size(handle->shm_size);
+    uint64_t description_offset = region_offset + sizeof(struct ShmStateTableShared);
+    uint64_t entries_offset = ((description_offset + strlen(description) + 1 + 63) / 64) * 64;
+    uint64_t log_offset = entries_offset + num_slots * entry_size;
+    uint64_t total_size = log_offset + num_slots * sizeof(uint32_t);
+    struct ShmRingBuffersHead* head = handle->ring_buffers_head;
+    if ((total_size > head->max_size) || (ftruncate(handle->shm_fd, total_size) < 0) || (grow_mapping(handle, total_size) < 0)) {
+        fprintf(stderr, "Error growing shm object (%s) to size: %" PRIu64 "\n", handle->shm_path, total_size);
+        return NULL;
+    }
+
+    // The region is freshly truncated in, so every entry starts zeroed and unused
+    uint8_t* m = handle->mem_map;
+    struct ShmStateTableShared* shared = (struct ShmStateTableShared*)(m + region_offset);
+    strcpy((char*)(m + description_offset), description);
+    shared->next_offset = head->state_tables_offset;
+    shared->description_offset = description_offset;
+    shared->entries_offset = entries_offset;
+    shared->log_offset = log_offset;
+    shared->value_size = state_table_def->value_size;
+    shared->entry_size = entry_size;
+    shared->num_slots = num_slots;
+    shared->capacity = state_table_def->capacity;
+    shared->num_keys = 0;
+    shared->change_sequence = 0;
+    __atomic_store_n(&head->state_tables_offset, region_offset, __ATOMIC_RELEASE);
+    return load_state_table(handle, shared);
 }
 
 /*
@@ -251,8 +3659,8 @@ void srb_host_signal_stopping(SRBHandle ring_buffers_handle)
  */
 SRBHandle srb_client_new(const char* shm_path)
 {
-    unsigned int head_size = sizeof(struct ShmRingBuffersHead);
-    unsigned int rb_size = sizeof(struct ShmRingBufferShared);
+    uint64_t head_size = sizeof(struct ShmRingBuffersHead);
+    uint64_t rb_size = sizeof(struct ShmRingBufferShared);
 
     // Create shared memory object
     int shmfd = shm_open(shm_path, O_RDWR, 0);
@@ -262,18 +3670,25 @@ SRBHandle srb_client_new(const char* shm_path)
     }
     struct stat shm_stat;
     fstat(shmfd, &shm_stat);
-    unsigned int total_size = shm_stat.st_size;
-    if (total_size < get_aligned_size(head_size + rb_size)) {
+    uint64_t total_size = shm_stat.st_size;
+    struct ShmRingBuffersHead head_copy;
+    if ((total_size < get_aligned_size(head_size + rb_size))
+        || (pread(shmfd, &head_copy, head_size, 0) != (ssize_t)head_size) || (head_copy.max_size < total_size)) {
         // Failed sanity check.
         fprintf(stderr, "Failed sanity check opening shared memory!\n");
         close(shmfd);
         return NULL;
     }
-    uint8_t* m = (uint8_t*)mmap(NULL, total_size, PROT_READ | PROT_WRITE, MAP_SHARED, shmfd, 0);
+    uint8_t* m = map_segment(shmfd, total_size, head_copy.max_size);
+    if (m == NULL) {
+        fprintf(stderr, "Error mapping shm object (%s)\n", shm_path);
+        close(shmfd);
+        return NULL;
+    }
     struct ShmRingBuffersHead* head = (struct ShmRingBuffersHead*)m;
     if (head->state != SRB_RUNNING) {
         fprintf(stderr, "Ring buffer producer not in running state!\n");
-        munmap(m, total_size);
+        munmap(m, head_copy.max_size);
         close(shmfd);
         return NULL;
     }
@@ -286,38 +3701,135 @@ SRBHandle srb_client_new(const char* shm_path)
     handle->shm_path = strdup(shm_path);
     handle->shm_size = total_size;
     handle->ring_buffers_head = head;
-    struct ShmRingBuffer* ringbuffers = handle->ringbuffers = malloc(
-        sizeof(struct ShmRingBuffer)
-        * head->num_ringbuffers);
-    unsigned int rbs_offset = head_size;
-    unsigned int descriptions_offset = rbs_offset + head->num_ringbuffers * rb_size;
-    unsigned int descriptions_size = 0;
+    handle->block_pool = get_block_pool(head);
+    handle->blocks = handle->block_pool ? m + handle->block_pool->blocks_offset : NULL;
+    handle->ringbuffers = NULL;
+    handle->num_ringbuffers = 0;
+    handle->old_ringbuffers = NULL;
+    handle->num_old_ringbuffers = 0;
+    handle->retired_rings = NULL;
+    handle->num_retired_rings = 0;
+    handle->state_tables = NULL;
+    handle->ring_files = NULL;
+    if (load_directory(handle) < 0) {
+        srb_close(handle);
+        return NULL;
+    }
 
-    char* description = (char*)(m + descriptions_offset);
-    struct ShmRingBufferShared* rb = (struct ShmRingBufferShared*)(m + rbs_offset);
-    for (unsigned int i = 0; i < head->num_ringbuffers; i++) {
-        unsigned int description_length = strlen(description) + 1;
-        ringbuffers[i].shared = rb;
-        ringbuffers[i].description = description;
-        if (i < (head->num_ringbuffers - 1)) {
-            rb++;
-            description += description_length;
-            descriptions_size += description_length;
-        }
+    return handle;
+}
+
+/*
+ * srb_client_open_file
+ *   Opens the file of a persisted ring, for example after a crash, as a read-only segment holding only that ring.
+ *   Its buffers up to the last flush are read, oldest first, with the usual srb_get_rings and subscriber functions, and
+ *   srb_client_get_state gives SRB_STOPPED if the host closed it cleanly. The file itself is never changed.
+ *
+ * params:
+ *   file_path - path of the file given as the ring's persist_path
+ *
+ * returns:
+ *   the SRBHandle that references the file's ring, to be closed with srb_close, or NULL if it is not a ring file
+ */
+SRBHandle srb_client_open_file(const char* file_path)
+{
+    uint64_t head_size = sizeof(struct ShmRingBuffersHead);
+    uint64_t rb_size = sizeof(struct ShmRingBufferShared);
+
+    int fd = open(file_path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error opening ring file (%s)\n", file_path);
+        return NULL;
+    }
+    struct stat file_stat;
+    struct ShmRingBuffersHead head_copy;
+    if ((fstat(fd, &file_stat) < 0) || ((uint64_t)file_stat.st_size < get_aligned_size(head_size + rb_size))
+        || (pread(fd, &head_copy, head_size, 0) != (ssize_t)head_size) || (head_copy.max_size != (uint64_t)file_stat.st_size) || (head_copy.max_size > SIZE_MAX)
+        || (head_copy.num_ringbuffers != 1) || (head_copy.directory_offset >= head_copy.max_size)) {
+        // Failed sanity check.
+        fprintf(stderr, "Failed sanity check opening ring file!\n");
+        close(fd);
+        return NULL;
+    }
+    // Private, so reading never writes back to the file
+    uint8_t* m = (uint8_t*)mmap(NULL, head_copy.max_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (m == MAP_FAILED) {
+        fprintf(stderr, "Error mapping ring file (%s)\n", file_path);
+        close(fd);
+        return NULL;
     }
 
-    unsigned int buffers_offset = get_aligned_size(descriptions_offset + descriptions_size);
-    uint8_t* buffers = m + buffers_offset;
-    for (unsigned int i = 0; i < head->num_ringbuffers; i++) {
-        ringbuffers[i].buffers = buffers;
-        if (i < (head->num_ringbuffers - 1)) {
-            buffers += ringbuffers[i].shared->num_buffers * ringbuffers[i].shared->buffer_size;
+    // Create the memory mapped structure
+    SRBHandle handle = malloc(sizeof(struct ShmRingBuffersLocal));
+    handle->is_host = 0;
+    handle->shm_fd = fd;
+    handle->mem_map = m;
+    handle->shm_path = strdup(file_path);
+    handle->shm_size = head_copy.max_size;
+    handle->ring_buffers_head = (struct ShmRingBuffersHead*)m;
+    handle->block_pool = NULL;
+    handle->blocks = NULL;
+    handle->ringbuffers = NULL;
+    handle->num_ringbuffers = 0;
+    handle->old_ringbuffers = NULL;
+    handle->num_old_ringbuffers = 0;
+    handle->retired_rings = NULL;
+    handle->num_retired_rings = 0;
+    handle->state_tables = NULL;
+    handle->ring_files = NULL;
+    if (load_directory(handle) < 0) {
+        srb_close(handle);
+        return NULL;
+    }
+    // Read from the oldest buffer the file holds, rather than jumping to the newest
+    for (unsigned int i = 0; i < handle->num_ringbuffers; i++) {
+        struct ShmRingBuffer* ring = handle->ringbuffers + i;
+        uint64_t n = ring->shared->num_buffers;
+        uint64_t oldest = (ring->shared->write_ring_pos > 2 * n - 1) ? ring->shared->write_ring_pos - n + 1 : n;
+        if (oldest < ring->shared->reclaim_floor) {
+            oldest = ring->shared->reclaim_floor; // Older buffers were overwritten while they were being flushed
         }
+        ring->last_read_ring_pos = oldest - 1;
     }
 
     return handle;
 }
 
+/*
+ * srb_client_refresh
+ *   Picks up rings added, retired or resized since the handle was created or last refreshed. This is cheap when
+ *   nothing changed, so it can be called often. Ring pointers from before the refresh stay valid, rings that are
+ *   still in the directory keep their read position, and srb_get_rings must be called again to see the changes.
+ *
+ * params:
+ *   ring_buffers_handle - the handle to the ring buffer's shared memory
+ *
+ * returns:
+ *   1 if the rings changed, 0 if not, or -1 if the grown segment could not be mapped
+ */
+int srb_client_refresh(SRBHandle ring_buffers_handle)
+{
+    SRBHandle handle = ring_buffers_handle;
+    if (__atomic_load_n(&handle->ring_buffers_head->generation, __ATOMIC_ACQUIRE) == handle->generation) {
+        return 0;
+    }
+    return (load_directory(handle) < 0) ? -1 : 1;
+}
+
+/*
+ * srb_ring_is_retired
+ *
+ * params:
+ *   ring_buffer - the ring buffer to check
+ *
+ * returns:
+ *   non-zero if the host has retired or resized the ring, its replacement is found by description after a refresh
+ */
+int srb_ring_is_retired(struct ShmRingBuffer* ring_buffer)
+{
+    return __atomic_load_n(&ring_buffer->shared->retired, __ATOMIC_ACQUIRE);
+}
+
 /*
  * srb_get_rings
  *
@@ -331,7 +3843,7 @@ SRBHandle srb_client_new(const char* shm_path)
 unsigned int srb_get_rings(SRBHandle ring_buffers_handle, struct ShmRingBuffer** ring_buffers)
 {
     *ring_buffers = ring_buffers_handle->ringbuffers;
-    return ring_buffers_handle->ring_buffers_head->num_ringbuffers;
+    return ring_buffers_handle->num_ringbuffers;
 }
 
 /*
@@ -347,7 +3859,7 @@ unsigned int srb_get_rings(SRBHandle ring_buffers_handle, struct ShmRingBuffer**
 struct ShmRingBuffer SHM_RINGBUFFERS_PUBLIC* srb_get_ring_by_description(SRBHandle ring_buffers_handle, char* description)
 {
     struct ShmRingBuffer* b = ring_buffers_handle->ringbuffers;
-    for (unsigned int i = 0; i < ring_buffers_handle->ring_buffers_head->num_ringbuffers; i++) {
+    for (unsigned int i = 0; i < ring_buffers_handle->num_ringbuffers; i++) {
         if (strcmp(b[i].description, description) == 0) {
             return &(b[i]);
         }
@@ -355,6 +3867,39 @@ struct ShmRingBuffer SHM_RINGBUFFERS_PUBLIC* srb_get_ring_by_description(SRBHand
     return NULL;
 }
 
+/*
+ * srb_get_ring_resident_size
+ *
+ * params:
+ *   ring_buffer - the ring buffer to measure
+ *
+ * returns:
+ *   the number of bytes of the ring's buffers currently committed in memory, counted in whole pages and
+ *   clamped to num_buffers * buffer_size
+ */
+uint64_t srb_get_ring_resident_size(struct ShmRingBuffer* ring_buffer)
+{
+    uint64_t reserved = ring_buffer->shared->num_buffers * ring_buffer->shared->buffer_size;
+    uintptr_t page_size = sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)ring_buffer->buffers;
+    uintptr_t end = start + reserved;
+    start = (start / page_size) * page_size;
+    size_t num_pages = (end - start + page_size - 1) / page_size;
+    unsigned char* vec = malloc(num_pages);
+    if ((vec == NULL) || (mincore((void*)start, end - start, vec) < 0)) {
+        free(vec);
+        return 0;
+    }
+    uint64_t resident = 0;
+    for (size_t i = 0; i < num_pages; i++) {
+        if (vec[i] & 1) {
+            resident += page_size;
+        }
+    }
+    free(vec);
+    return (resident < reserved) ? resident : reserved;
+}
+
 /*
  * srb_close
  *   unmaps all ring buffers and closes the shared memory, if producer first signals SRB_STOPPED
@@ -366,14 +3911,37 @@ void srb_close(SRBHandle ring_buffers_handle)
 {
     SRBHandle handle = ring_buffers_handle;
     if (handle->is_host) {
+        srb_host_flush_rings(handle);
         handle->ring_buffers_head->state = SRB_STOPPED;
+        ring_doorbell(handle->ring_buffers_head);
     }
-    munmap((void*)handle->mem_map, handle->shm_size);
+    munmap((void*)handle->mem_map, handle->ring_buffers_head->max_size);
     close(handle->shm_fd);
     if (handle->is_host) {
         shm_unlink(handle->shm_path);
     }
+    for (unsigned int i = 0; i < handle->num_old_ringbuffers; i++) {
+        free((void*)(handle->old_ringbuffers[i]));
+    }
+    free((void*)(handle->old_ringbuffers));
+    free((void*)(handle->retired_rings));
     free((void*)(handle->ringbuffers));
+    while (handle->state_tables) {
+        struct ShmStateTable* next = handle->state_tables->next;
+        free(handle->state_tables);
+        handle->state_tables = next;
+    }
+    while (handle->ring_files) {
+        struct ShmRingBufferFile* file = handle->ring_files;
+        // Marks the file as closed cleanly, after its last buffers were flushed
+        enum EShmRingBuffersState stopped = SRB_STOPPED;
+        if (write_file(file->fd, &stopped, sizeof(stopped), offsetof(struct ShmRingBuffersHead, state)) == 0) {
+            fdatasync(file->fd);
+        }
+        close(file->fd);
+        handle->ring_files = file->next;
+        free(file);
+    }
     free((void*)(handle->shm_path));
     free(handle);
 }
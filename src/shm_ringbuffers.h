@@ -25,8 +25,13 @@
 #ifndef SHM_RINGBUFFERS_H
 #define SHM_RINGBUFFERS_H
 
+#include <pthread.h>
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #if defined _WIN32 || defined __CYGWIN__
 #ifdef BUILDING_SHM_RINGBUFFERS
 #define SHM_RINGBUFFERS_PUBLIC __declspec(dllexport)
@@ -41,48 +46,279 @@
 #endif
 #endif
 
+// Marks the flexible array members of the shared structs, which C++ only has as an extension
+#ifdef __cplusplus
+#define SRB_FLEXIBLE_ARRAY __extension__
+#else
+#define SRB_FLEXIBLE_ARRAY
+#endif
+
 enum EShmRingBuffersState {
     SRB_STOPPED = 0,
     SRB_RUNNING = 1,
     SRB_STOPPING = 2,
 };
 
+enum EShmRingBufferReclaimState {
+    SRB_RING_ACTIVE = 0,
+    SRB_RING_RECLAIMING = 1, // Host is releasing the ring's idle pages, producer must wait.
+    SRB_RING_RECLAIMED = 2, // Idle pages released, they are committed again on the next write.
+};
+
+// Most topics a subscriber can filter a multiplexed ring on at once
+#define SRB_MAX_TOPIC_FILTER (8)
+
+// Most tiles a dirty tracked ring splits each buffer into, tiles are a power of two of at least 64 bytes
+#define SRB_MAX_DIRTY_TILES (4096)
+
+// Times srb_subscriber_get_most_recent_buffers waits out a multi-ring publish before giving up on a snapshot
+#define SRB_SNAPSHOT_MAX_TRIES (100000)
+
+// Returned by srb_subscriber_get_most_recent_buffers when no snapshot could be taken
+#define SRB_SNAPSHOT_FAILED (UINT64_MAX)
+
 struct ShmRingBufferDef {
-    unsigned int buffer_size;
+    uint64_t buffer_size;
     unsigned int num_buffers;
     char* description;
+    int multiplexed; // Non-zero to carry a topic id with every buffer
+    int timestamped; // Non-zero to keep an index of every buffer's timestamp, for srb_subscriber_seek_timestamp
+    int checksummed; // Non-zero to publish a CRC32C with every buffer
+    int dirty_tracked; // Non-zero to keep a bitmap of the tiles each buffer changed, for srb_subscriber_apply_deltas
+    char* persist_path; // A file on local disk to flush the ring to, NULL for none. One already there is kept as persist_path.prev, replacing any older
+};
+
+struct ShmBlockPoolDef {
+    uint64_t block_size;
+    unsigned int num_blocks;
+};
+
+struct ShmStateTableDef {
+    unsigned int capacity; // Most keys the table can hold, keys are never removed
+    uint64_t value_size;
+    char* description;
+};
+
+// What a ring slot holds when it references a pool block instead of embedding its payload
+struct ShmBlockRef {
+    uint64_t length; // Bytes of the block in use
+    uint32_t block; // Block id, 0 for none
+    uint32_t reserved;
+};
+
+// What a checksummed ring keeps for each slot
+struct ShmBufferChecksum {
+    uint64_t length; // Bytes from the start of the buffer covered by crc
+    uint32_t crc; // CRC32C
+    uint32_t reserved;
+};
+
+struct ShmBlockShared {
+    uint32_t refcount; // 0 while the block is in the free list
+    uint32_t next_free; // Block id of the next free block, while in the free list
+};
+
+struct ShmBlockPoolShared {
+    uint64_t block_size;
+    uint64_t blocks_offset;
+    unsigned int num_blocks;
+    uint64_t free_head; // Block id of the first free block in the low half, ABA tag in the high half
+    SRB_FLEXIBLE_ARRAY struct ShmBlockShared block_states[]; // Indexed by block id - 1
+};
+
+// Each slot of a state table, followed by two copies of its value so a reader never copies one being written
+struct ShmStateEntryShared {
+    uint64_t key;
+    uint64_t seq; // Twice the number of updates, plus one while an update is being written
+    uint64_t changed; // The table's change sequence at this key's latest update
+    uint64_t copy_changed[2]; // The change sequence each copy of the value was written at
+    uint32_t in_use; // Set once key and the first value are written, slots are never freed
+    uint32_t reserved;
+    SRB_FLEXIBLE_ARRAY uint8_t values[]; // The latest value is copy (seq / 2) % 2, each copy is rounded up to 8 bytes
+};
+
+struct ShmStateTableShared {
+    uint64_t next_offset; // The state table added before this one, 0 if none
+    uint64_t description_offset;
+    uint64_t entries_offset; // num_slots struct ShmStateEntryShared, entry_size bytes apart
+    uint64_t log_offset; // num_slots uint32_t slot indices, the slot of change sequence s is at s % num_slots
+    uint64_t value_size;
+    uint64_t entry_size;
+    unsigned int num_slots; // A power of two of at least twice capacity, so probing stays short
+    unsigned int capacity;
+    unsigned int num_keys;
+    uint64_t change_sequence; // Incremented by every update
 };
 
 struct ShmRingBufferShared {
-    unsigned int buffer_size;
+    uint64_t buffer_size;
+    uint64_t write_ring_pos; // Monotonically increasing sequence, the buffer being written is write_ring_pos % num_buffers
+    uint64_t buffers_offset;
+    uint64_t topic_ids_offset; // Dense array of num_buffers uint16_t topic ids, 0 if not multiplexed
+    uint64_t timestamps_offset; // Dense array of num_buffers uint64_t timestamps, 0 if not timestamped
+    uint64_t checksums_offset; // Dense array of num_buffers struct ShmBufferChecksum, 0 if not checksummed
     unsigned int num_buffers;
-    unsigned int write_ring_pos;
+    unsigned int reclaim_state; // enum EShmRingBufferReclaimState
+    uint64_t reclaim_floor; // Oldest sequence left intact when the ring's memory was last released, readers skip older ones
+    unsigned int holds_blocks; // Non-zero once block references are published to the ring, they are never reclaimed
+    uint64_t description_offset;
+    unsigned int retired; // Non-zero once the ring has been removed from the directory, or replaced by a resize
+    uint64_t write_progress; // Bytes of the buffer at write_ring_pos that are complete
+    uint64_t dirty_offset; // num_buffers bitmaps of the tiles changed since the buffer before, 0 if not dirty tracked
+    uint64_t dirty_tile_size; // Bytes per tile of a dirty tracked ring
+    uint64_t persist_path_offset; // Path of the file the ring is flushed to, 0 if none
+};
+
+// The rings currently in a segment. A directory is never changed once published, a new one is written instead.
+struct ShmRingDirectory {
+    unsigned int num_ringbuffers;
+    SRB_FLEXIBLE_ARRAY uint64_t ring_offsets[]; // struct ShmRingBufferShared of each ring
+};
+
+struct ShmRingBuffersHead {
+    enum EShmRingBuffersState state;
+    unsigned int num_ringbuffers;
+    uint64_t block_pool_offset; // struct ShmBlockPoolShared, 0 if there is no block pool
+    uint64_t publish_epoch; // Even when idle, odd while a multi-ring publish is in progress.
+    uint64_t directory_offset; // struct ShmRingDirectory of the current rings
+    uint64_t generation; // Incremented whenever the directory changes.
+    uint64_t max_size; // The segment only grows up to this size, so each process can reserve its address space. Fits in the host's size_t.
+    uint64_t state_tables_offset; // The most recently added struct ShmStateTableShared, 0 if none
+    // Rung by every publish to every ring, so it has a cache line of its own, away from the fields readers check
+    unsigned int doorbell __attribute__((aligned(64))); // Incremented whenever any ring in the segment advances.
+    unsigned int doorbell_waiters; // Number of ring sets blocked on the doorbell.
 };
 
 struct ShmRingBuffer {
     char* description;
     uint8_t* buffers;
-    unsigned int last_read_ring_pos; // Local to each process.
+    uint64_t last_read_ring_pos; // Local to each process.
     struct ShmRingBufferShared* shared;
+    uint16_t* topic_ids; // NULL if not multiplexed
+    uint64_t* timestamps; // NULL if not timestamped
+    struct ShmBufferChecksum* checksums; // NULL if not checksummed
+    int checksum_set; // Local to the producer, the buffer being written has had its checksum set.
+    uint64_t* dirty_tiles; // NULL if not dirty tracked
+    uint64_t dirty_words; // Words in each buffer's dirty tile bitmap
+    int dirty_set; // Local to the producer, the buffer being written has had dirty ranges marked.
+    uint16_t topic_filter[SRB_MAX_TOPIC_FILTER]; // Local to each process.
+    unsigned int num_topic_filter; // Local to each process, 0 reads all topics.
+    uint64_t last_seen_write_ring_pos; // Local to host, used for idle detection.
+    int64_t last_activity_time; // Local to host, CLOCK_MONOTONIC seconds of last seen write.
+    struct ShmRingBuffersHead* head; // The segment this ring lives in.
 };
 
-struct ShmRingBuffersHead {
-    enum EShmRingBuffersState state;
-    unsigned int num_ringbuffers;
+struct ShmRingBufferSet {
+    struct ShmRingBuffersHead* head; // All rings in a set share one segment, and so one doorbell.
+    unsigned int num_rings;
+    unsigned int capacity;
+    unsigned int next_scan; // Where the next scan starts, so a short ready array is filled fairly.
+    struct ShmRingBuffer** rings;
+    uint64_t** write_ring_pos; // Dense array of pointers to each ring's shared write_ring_pos.
+    uint64_t* seen_write_ring_pos; // Dense array of the write_ring_pos last reported for each ring.
+};
+
+// Gives the key a merge orders a buffer by, such as an event time or global sequence number in its payload
+typedef uint64_t (*SRBMergeKey)(struct ShmRingBuffer* ring_buffer, uint8_t* buffer, void* user_data);
+
+struct ShmRingBufferMerge {
+    unsigned int num_rings;
+    unsigned int capacity;
+    unsigned int num_leaves; // A power of two of at least num_rings
+    unsigned int num_pending; // Rings with a buffer waiting in the tree
+    unsigned int emitted; // The ring whose buffer was last returned, num_rings if none
+    struct ShmRingBuffer** rings;
+    uint8_t** pending; // Dense array of each ring's next buffer, NULL if it had nothing unread
+    unsigned int* slots; // Dense array of the slot of each ring's last read buffer
+    uint64_t* num_lost; // Dense array of the buffers each ring was overwritten before they were merged
+    uint64_t* keys; // The key of each leaf's pending buffer, UINT64_MAX if it has none
+    unsigned int* winners; // Tournament tree, node i is won by the ring with the lowest key below it, leaves from num_leaves
+    SRBMergeKey key; // NULL to order by buffer timestamps
+    void* user_data;
+};
+
+// The file a persisted ring is flushed to, laid out as a segment holding only that ring so it can be opened offline.
+// Local to the host, whose flusher is the only writer of the file, the ring's live buffers stay in the segment.
+struct ShmRingBufferFile {
+    struct ShmRingBufferShared* shared; // The ring's live shared state, in the segment
+    struct ShmRingBufferShared persisted; // The file's copy, offsets are from the start of the file and write_ring_pos only covers flushed buffers
+    int fd;
+    uint64_t flushed_write_ring_pos; // The live write_ring_pos as of the last flush
+    uint64_t flushing_write_ring_pos; // The live write_ring_pos being flushed
+    struct ShmRingBufferFile* next;
+};
+
+struct ShmStateTable {
+    char* description;
+    struct ShmStateTableShared* shared;
+    uint8_t* entries;
+    uint32_t* log;
+    unsigned int slot_shift; // 64 - log2(num_slots), for hashing keys to slots
+    struct ShmStateTable* next; // Local to each process, the handle's other state tables.
 };
 
 struct ShmRingBuffersLocal {
     struct ShmRingBuffersHead* ring_buffers_head;
     struct ShmRingBuffer* ringbuffers;
+    unsigned int num_ringbuffers; // As of generation.
+    uint64_t generation; // Of the directory ringbuffers was loaded from.
+    struct ShmRingBuffer** old_ringbuffers; // Earlier ringbuffers arrays, kept until close as callers may hold them.
+    unsigned int num_old_ringbuffers;
+    struct ShmRingBuffer* retired_rings; // Local to host, retired rings still get their memory reclaimed.
+    unsigned int num_retired_rings;
     int is_host;
     int shm_fd;
-    uint8_t* mem_map;
+    uint8_t* mem_map; // Reserved up to the head's max_size, mapped up to shm_size.
     const char* shm_path;
-    unsigned int shm_size;
+    uint64_t shm_size;
+    struct ShmBlockPoolShared* block_pool; // NULL if there is no block pool
+    uint8_t* blocks;
+    struct ShmStateTable* state_tables; // Those looked up or added through this handle, freed on close.
+    struct ShmRingBufferFile* ring_files; // Files of the host's persisted rings, closed on close.
 };
 
 typedef struct ShmRingBuffersLocal* SRBHandle;
 
+// Called by a dispatcher worker with each buffer read from ring_buffer, in ring order
+typedef void (*SRBDispatchCallback)(struct ShmRingBuffer* ring_buffer, uint8_t* buffer, void* user_data);
+
+struct ShmRingBufferDispatcher;
+
+struct ShmRingBufferDispatchWorker {
+    struct ShmRingBufferDispatcher* dispatcher;
+    unsigned int index;
+    pthread_t thread;
+};
+
+struct ShmRingBufferDispatcher {
+    struct ShmRingBuffersHead* head; // All rings share one segment, idle workers wait on its doorbell.
+    SRBDispatchCallback callback;
+    void* user_data;
+    unsigned int num_rings;
+    unsigned int capacity;
+    struct ShmRingBuffer** rings; // Ring i is owned by worker i % num_workers, others may steal it.
+    unsigned int* ring_claimed; // Non-zero while a worker is consuming the ring.
+    unsigned int num_workers;
+    struct ShmRingBufferDispatchWorker* workers;
+    int running;
+};
+
+struct ShmRingBufferNotifier {
+    struct ShmRingBuffersHead* head; // The segment whose doorbell is forwarded.
+    int read_fd; // Readable while notified, handed to epoll, io_uring or poll.
+    int write_fd; // The same eventfd as read_fd, or the write end of a pipe where there is no eventfd.
+    unsigned int pending; // Non-zero while read_fd has been signalled and not yet cleared.
+    pthread_t thread;
+    int running;
+};
+
+struct ShmRingBufferFlusher {
+    SRBHandle handle;
+    unsigned int interval_ms;
+    pthread_t thread;
+    int running;
+};
+
 // ====================
 // Subscriber functions
 // ====================
@@ -96,7 +332,7 @@ typedef struct ShmRingBuffersLocal* SRBHandle;
  * returns:
  *   the most recent buffer id, that is not currently set as the write_ring_pos, or 0 if no valid buffers exist
  */
-SHM_RINGBUFFERS_PUBLIC unsigned int srb_subscriber_get_most_recent_buffer_id(struct ShmRingBuffer* ring_buffer);
+SHM_RINGBUFFERS_PUBLIC uint64_t srb_subscriber_get_most_recent_buffer_id(struct ShmRingBuffer* ring_buffer);
 
 /*
  * srb_subscriber_get_most_recent_buffer
@@ -116,107 +352,1006 @@ SHM_RINGBUFFERS_PUBLIC uint8_t* srb_subscriber_get_most_recent_buffer(struct Shm
  *   ring_buffer - the ring buffer to get the next unread buffer
  *
  * returns:
- *   the next unread buffer up until to write_ring_pos - 1, or NULL if no buffers meet this criteria
+ *   the next unread buffer up until to write_ring_pos - 1, or NULL if no buffers meet this criteria. On a
+ *   multiplexed ring with a topic filter set, buffers of other topics are skipped without being touched.
  */
 SHM_RINGBUFFERS_PUBLIC uint8_t* srb_subscriber_get_next_unread_buffer(struct ShmRingBuffer* ring_buffer);
 
+/*
+ * srb_subscriber_set_topic_filter
+ *   Restricts srb_subscriber_get_next_unread_buffer on a multiplexed ring to the given topics.
+ *
+ * params:
+ *   ring_buffer - the multiplexed ring buffer to filter
+ *   num_topics - the number of topics, up to SRB_MAX_TOPIC_FILTER, or 0 to receive all topics again
+ *   topics - the topic ids to receive
+ *
+ * returns:
+ *   0 on success, or -1 if the ring is not multiplexed or too many topics were given
+ */
+SHM_RINGBUFFERS_PUBLIC int srb_subscriber_set_topic_filter(struct ShmRingBuffer* ring_buffer, unsigned int num_topics, const uint16_t* topics);
+
+/*
+ * srb_subscriber_get_buffer_topic
+ *
+ * params:
+ *   ring_buffer - the multiplexed ring buffer the buffer belongs to
+ *   buffer - a buffer returned from one of the subscriber functions
+ *
+ * returns:
+ *   the topic id the buffer was written with, or 0 if the ring is not multiplexed
+ */
+SHM_RINGBUFFERS_PUBLIC uint16_t srb_subscriber_get_buffer_topic(struct ShmRingBuffer* ring_buffer, uint8_t* buffer);
+
+/*
+ * srb_subscriber_get_next_unread_block
+ *   Like srb_subscriber_get_next_unread_buffer, for a ring whose slots hold struct ShmBlockRef, but also takes a
+ *   reference to the block so it stays valid after the slot is reused. Release it with srb_block_release.
+ *
+ * params:
+ *   ring_buffer - the ring buffer to get the next unread block from
+ *   length - will be set to the bytes of the block in use
+ *
+ * returns:
+ *   the block id of the next unread block, or 0 if none
+ */
+SHM_RINGBUFFERS_PUBLIC uint32_t srb_subscriber_get_next_unread_block(struct ShmRingBuffer* ring_buffer, uint64_t* length);
+
+/*
+ * srb_subscriber_get_most_recent_buffers
+ *   Gets the most recent buffer of each of several rings as one consistent snapshot: every ring is seen as of the
+ *   same publish epoch, so buffers published together by srb_producer_next_write_buffers are returned together.
+ *   This never blocks the producer, it only retries if a multi-ring publish happens while it reads. It gives up
+ *   after SRB_SNAPSHOT_MAX_TRIES, such as when a producer died part way through a publish.
+ *
+ * params:
+ *   ring_buffers - the ring buffers to read, all in the same segment
+ *   num_rings - the number of ring buffers
+ *   buffers - will be set to each ring's most recent buffer, or NULL for rings with no buffers yet
+ *   sequences - if not NULL, will be set to each buffer's write sequence number
+ *
+ * returns:
+ *   the publish epoch the snapshot was taken at, or SRB_SNAPSHOT_FAILED if a publish never finished, in which
+ *   case buffers and sequences should not be used
+ */
+SHM_RINGBUFFERS_PUBLIC uint64_t srb_subscriber_get_most_recent_buffers(struct ShmRingBuffer** ring_buffers, unsigned int num_rings, uint8_t** buffers, uint64_t* sequences);
+
+/*
+ * srb_subscriber_seek_timestamp
+ *   Finds the published buffer whose timestamp is closest to timestamp, by binary search of the ring's timestamp
+ *   index over the buffers that are still intact. Timestamps within a ring must not decrease. On a tie the
+ *   earlier buffer is returned. This does not change the ring's read position.
+ *
+ * params:
+ *   ring_buffer - the timestamped ring buffer to search
+ *   timestamp - the time to look for, CLOCK_MONOTONIC nanoseconds unless the producer sets its own
+ *   sequence - will be set to the write sequence number of the buffer found
+ *
+ * returns:
+ *   the closest buffer, or NULL if the ring is not timestamped or has no buffers yet
+ */
+SHM_RINGBUFFERS_PUBLIC uint8_t* srb_subscriber_seek_timestamp(struct ShmRingBuffer* ring_buffer, uint64_t timestamp, uint64_t* sequence);
+
+/*
+ * srb_subscriber_get_buffer_timestamp
+ *
+ * params:
+ *   ring_buffer - the timestamped ring buffer the buffer came from
+ *   buffer - a buffer returned by one of the srb_subscriber_get functions
+ *
+ * returns:
+ *   the timestamp of the buffer, or 0 if the ring is not timestamped
+ */
+SHM_RINGBUFFERS_PUBLIC uint64_t srb_subscriber_get_buffer_timestamp(struct ShmRingBuffer* ring_buffer, uint8_t* buffer);
+
+/*
+ * srb_subscriber_verify_buffer
+ *   Checks a buffer against the CRC32C its producer published with it. A buffer overwritten while being checked,
+ *   by a subscriber num_buffers - 1 behind, also fails.
+ *
+ * params:
+ *   ring_buffer - the checksummed ring buffer the buffer came from
+ *   buffer - a buffer returned by one of the srb_subscriber_get functions
+ *
+ * returns:
+ *   1 if the buffer matches its checksum, 0 if not, or -1 if the ring is not checksummed
+ */
+SHM_RINGBUFFERS_PUBLIC int srb_subscriber_verify_buffer(struct ShmRingBuffer* ring_buffer, uint8_t* buffer);
+
+/*
+ * srb_subscriber_get_buffer_checksum
+ *
+ * params:
+ *   ring_buffer - the checksummed ring buffer the buffer came from
+ *   buffer - a buffer returned by one of the srb_subscriber_get functions
+ *   length - will be set to the number of bytes from the start of the buffer the checksum covers
+ *
+ * returns:
+ *   the CRC32C of the buffer, or 0 with length 0 if the ring is not checksummed
+ */
+SHM_RINGBUFFERS_PUBLIC uint32_t srb_subscriber_get_buffer_checksum(struct ShmRingBuffer* ring_buffer, uint8_t* buffer, uint64_t* length);
+
+/*
+ * srb_subscriber_apply_deltas
+ *   Brings the caller's own copy of a dirty tracked ring's buffer up to date with the most recent buffer, copying
+ *   only the tiles that changed since the buffer the copy holds. The whole buffer is copied if the copy holds
+ *   nothing yet, is num_buffers - 1 or more behind, or the ring is not dirty tracked.
+ *
+ * params:
+ *   ring_buffer - the ring buffer to copy from
+ *   copy - buffer_size bytes, holding the buffer of sequence
+ *   sequence - the sequence number of the buffer copy holds, 0 if none, will be set to the one it now holds
+ *
+ * returns:
+ *   the number of bytes copied, 0 if the copy is already up to date or there are no buffers yet
+ */
+SHM_RINGBUFFERS_PUBLIC uint64_t srb_subscriber_apply_deltas(struct ShmRingBuffer* ring_buffer, uint8_t* copy, uint64_t* sequence);
+
+/*
+ * srb_subscriber_get_buffer_dirty_tiles
+ *   Gets which tiles of a buffer changed since the buffer published before it, for forwarding only the changes.
+ *   Tile i covers bytes [i * tile_size, (i + 1) * tile_size) of the buffer, and is changed if bit i % 64 of word
+ *   i / 64 is set. Like the buffer itself, the bitmap is overwritten once the subscriber is num_buffers - 1 behind.
+ *
+ * params:
+ *   ring_buffer - the dirty tracked ring buffer the buffer came from
+ *   buffer - a buffer returned by one of the srb_subscriber_get functions
+ *   tile_size - will be set to the bytes per tile
+ *
+ * returns:
+ *   the buffer's bitmap of changed tiles, or NULL if the ring is not dirty tracked
+ */
+SHM_RINGBUFFERS_PUBLIC const uint64_t* srb_subscriber_get_buffer_dirty_tiles(struct ShmRingBuffer* ring_buffer, uint8_t* buffer, uint64_t* tile_size);
+
+/*
+ * srb_subscriber_get_next_partial_buffer
+ *   Gets the buffer the producer is writing right now, before it is published, and marks it as read so
+ *   srb_subscriber_get_next_unread_buffer moves on past it. Use srb_subscriber_get_buffer_progress to find how
+ *   much of it is complete, so the regions can be processed as the producer lands them. A subscriber that is
+ *   behind gets the published buffers it has not read first, as srb_subscriber_get_next_unread_buffer would, and
+ *   only gets the buffer being written once it has caught up.
+ *
+ * params:
+ *   ring_buffer - the ring buffer to get the partial buffer from
+ *   sequence - will be set to the buffer's write sequence number
+ *
+ * returns:
+ *   the next unread published buffer, or else the buffer being written, or NULL if that has already been read or
+ *   the producer has not started
+ */
+SHM_RINGBUFFERS_PUBLIC uint8_t* srb_subscriber_get_next_partial_buffer(struct ShmRingBuffer* ring_buffer, uint64_t* sequence);
+
+/*
+ * srb_subscriber_get_buffer_progress
+ *
+ * params:
+ *   ring_buffer - the ring buffer the buffer is from
+ *   sequence - the buffer's write sequence number, from srb_subscriber_get_next_partial_buffer
+ *
+ * returns:
+ *   how many bytes from the start of the buffer are complete, buffer_size once it has been published. As with any
+ *   buffer, it may be overwritten once the subscriber is num_buffers - 1 behind.
+ */
+SHM_RINGBUFFERS_PUBLIC uint64_t srb_subscriber_get_buffer_progress(struct ShmRingBuffer* ring_buffer, uint64_t sequence);
+
+/*
+ * srb_subscriber_prefetch_next_unread_buffer
+ *   Hints the CPU to start loading the buffer srb_subscriber_get_next_unread_buffer would return next, without
+ *   consuming it, so it is on its way into cache while the current buffer is processed.
+ *
+ * params:
+ *   ring_buffer - the ring buffer to prefetch from
+ *   bytes - how much of the start of the buffer to prefetch (capped at buffer_size)
+ */
+SHM_RINGBUFFERS_PUBLIC void srb_subscriber_prefetch_next_unread_buffer(struct ShmRingBuffer* ring_buffer, uint64_t bytes);
+
 // ==================
-// Producer functions
+// Ring set functions
 // ==================
 
 /*
- * srb_producer_next_write_buffer
- *   this function returns the next shared write buffer.
+ * srb_ring_set_new
+ *
+ * returns:
+ *   a new empty ring set, to be freed with srb_ring_set_free
+ */
+SHM_RINGBUFFERS_PUBLIC struct ShmRingBufferSet* srb_ring_set_new(void);
+
+/*
+ * srb_ring_set_add
+ *   Adds a ring to the set. If the ring already has unread buffers it is reported by the next srb_ring_set_wait.
  *
  * params:
- *   ring_buffer - the ring buffer to get the next shared buffer from
+ *   ring_set - the ring set to add to
+ *   ring_buffer - the ring buffer to add, it must be in the same segment as the rings already in the set
  *
- * return:
- *   pointer to the next shared buffer
+ * returns:
+ *   0 on success, or -1 if the ring is from a different segment
  */
-SHM_RINGBUFFERS_PUBLIC uint8_t* srb_producer_next_write_buffer(struct ShmRingBuffer* ring_buffer);
+SHM_RINGBUFFERS_PUBLIC int srb_ring_set_add(struct ShmRingBufferSet* ring_set, struct ShmRingBuffer* ring_buffer);
 
-// =================================================
-// Common functions to producer and subscriber sides
-// =================================================
+/*
+ * srb_ring_set_wait
+ *   Blocks on the segment's doorbell until any ring in the set has advanced since it was last reported. Each
+ *   advance is reported once, so drain a reported ring with srb_subscriber_get_next_unread_buffer.
+ *
+ * params:
+ *   ring_set - the ring set to wait on
+ *   ready - will be filled with the rings that advanced
+ *   max_ready - the number of entries in ready
+ *   timeout_ms - how long to wait, 0 to only poll, or -1 to wait until a ring advances or the host stops running
+ *
+ * returns:
+ *   the number of rings put in ready, 0 on timeout or if the host is no longer running
+ */
+SHM_RINGBUFFERS_PUBLIC unsigned int srb_ring_set_wait(struct ShmRingBufferSet* ring_set, struct ShmRingBuffer** ready, unsigned int max_ready, int timeout_ms);
 
 /*
- * srb_host_new
+ * srb_ring_set_free
  *
  * params:
- *   shm_path - shared memory path
- *   num_defs - the number of ringbuffers you are defining
- *   ring_buffer_defs - array of {struct ShmRingBuffer}s which will be created in the mmap based on the supplied members:
- *        buffer_size, num_buffers, and description. (these can be freed if wanted after this call)
+ *   ring_set - the ring set to free, its rings are left untouched
+ */
+SHM_RINGBUFFERS_PUBLIC void srb_ring_set_free(struct ShmRingBufferSet* ring_set);
+
+// ===============
+// Merge functions
+// ===============
+
+/*
+ * srb_merge_new
+ *
+ * params:
+ *   key - gives the key each buffer is ordered by, or NULL to order by buffer timestamps
+ *   user_data - passed to key
  *
  * returns:
- *   the SRBHandle that references the shared memory ring buffers. This is usually followed up with srb_get_rings call.
+ *   a new empty merge, to be freed with srb_merge_free
  */
-SHM_RINGBUFFERS_PUBLIC SRBHandle srb_host_new(const char* shm_path, unsigned int num_defs, struct ShmRingBufferDef* ring_buffer_defs);
+SHM_RINGBUFFERS_PUBLIC struct ShmRingBufferMerge* srb_merge_new(SRBMergeKey key, void* user_data);
 
 /*
- * srb_host_signal_stopping
- *   Call this from host to give clients time to shutdown.
+ * srb_merge_add
+ *   Adds a ring to the merge, which then reads it as srb_subscriber_get_next_unread_buffer would, except that a
+ *   ring not read before starts at its newest buffer and is read in full after it rather than jumping ahead, and
+ *   topic filters are not applied.
  *
  * params:
- *   ring_buffers_handle - the handle to the ring buffer's shared memory'
+ *   merge - the merge to add to
+ *   ring_buffer - the ring buffer to add, its buffers' keys must not decrease and must be below UINT64_MAX
  *
+ * returns:
+ *   0 on success, or -1 if the merge orders by timestamps and the ring is not timestamped
  */
-SHM_RINGBUFFERS_PUBLIC void srb_host_signal_stopping(SRBHandle ring_buffers_handle);
+SHM_RINGBUFFERS_PUBLIC int srb_merge_add(struct ShmRingBufferMerge* merge, struct ShmRingBuffer* ring_buffer);
 
 /*
- * srb_client_new
+ * srb_merge_next
+ *   Gives the unread buffer with the lowest key across all the merge's rings, ties going to the ring added first.
+ *   The rings are merged through a tournament tree, so each buffer costs a comparison per level of the tree.
  *
  * params:
- *   shm_path - shared memory path
+ *   merge - the merge to read
+ *   require_all - non-zero to only give a buffer while every ring has one unread, so a ring that is slow to
+ *     publish can never have a lower key come after it. Otherwise the rings that have something unread are merged.
+ *   ring_buffer - if not NULL, set to the ring the buffer came from
+ *   key - if not NULL, set to the buffer's key
  *
  * returns:
- *   the SRBHandle that references the shared memory ring buffers. This is usually followed up with srb_get_rings call.
+ *   the buffer, which is valid until its ring's producer laps it, or NULL if there is nothing to give yet
  */
-SHM_RINGBUFFERS_PUBLIC SRBHandle srb_client_new(const char* shm_path);
+SHM_RINGBUFFERS_PUBLIC uint8_t* srb_merge_next(struct ShmRingBufferMerge* merge, int require_all, struct ShmRingBuffer** ring_buffer, uint64_t* key);
 
 /*
- * srb_client_get_state
+ * srb_merge_get_num_lost
  *
  * params:
- *   ring_buffers_handle - the handle to the ring buffer's shared memory
+ *   merge - the merge
+ *   ring_buffer - the ring to count for, or NULL for all rings
  *
  * returns:
- *   the run state of the host
+ *   the number of buffers overwritten by their producer before the merge could give them
  */
-SHM_RINGBUFFERS_PUBLIC enum EShmRingBuffersState srb_client_get_state(SRBHandle ring_buffers_handle);
+SHM_RINGBUFFERS_PUBLIC uint64_t srb_merge_get_num_lost(struct ShmRingBufferMerge* merge, struct ShmRingBuffer* ring_buffer);
 
 /*
- * srb_get_rings
+ * srb_merge_free
  *
  * params:
- *   ring_buffers_handle - the handle to the ring buffer's shared memory
- *   ring_buffers - will be set to the memory mapped ring_buffers
+ *   merge - the merge to free, its rings are left untouched
+ */
+SHM_RINGBUFFERS_PUBLIC void srb_merge_free(struct ShmRingBufferMerge* merge);
+
+// ==================
+// Dispatcher functions
+// ==================
+
+/*
+ * srb_dispatcher_new
+ *
+ * params:
+ *   num_workers - the number of worker threads to consume rings with
+ *   callback - called with every buffer read, concurrently for different rings but never for the same ring
+ *   user_data - passed through to callback
  *
  * returns:
- *   the number of ring_buffers
+ *   a new dispatcher with no rings, to be freed with srb_dispatcher_free
  */
-SHM_RINGBUFFERS_PUBLIC unsigned int srb_get_rings(SRBHandle ring_buffers_handle, struct ShmRingBuffer** ring_buffers);
+SHM_RINGBUFFERS_PUBLIC struct ShmRingBufferDispatcher* srb_dispatcher_new(unsigned int num_workers, SRBDispatchCallback callback, void* user_data);
 
 /*
- * srb_get_ring_by_description
+ * srb_dispatcher_add
+ *   Adds a ring for the dispatcher to consume. Rings can only be added while the dispatcher is stopped.
  *
  * params:
- *   ring_buffers_handle - the handle to the ring buffer's shared memory
- *   description - will be set to the memory mapped ring_buffers
+ *   dispatcher - the dispatcher to add to
+ *   ring_buffer - the ring buffer to consume, it must be in the same segment as the rings already added
  *
  * returns:
- *   a pointer to the ring buffer or NULL if not found
+ *   0 on success, or -1 if the ring is from a different segment or the dispatcher is running
  */
-SHM_RINGBUFFERS_PUBLIC struct ShmRingBuffer* srb_get_ring_by_description(SRBHandle ring_buffers_handle, char* description);
+SHM_RINGBUFFERS_PUBLIC int srb_dispatcher_add(struct ShmRingBufferDispatcher* dispatcher, struct ShmRingBuffer* ring_buffer);
 
 /*
- * srb_close
- *   unmaps all ring buffers and closes the shared memory, if producer first signals SRB_STOPPED
+ * srb_dispatcher_start
+ *   Starts the worker threads. Each worker drains the rings it owns, and when those are empty steals any other
+ *   ring with unread buffers that no worker is consuming. A ring is consumed by one worker at a time, in order.
+ *
+ * params:
+ *   dispatcher - the dispatcher to start
+ *
+ * returns:
+ *   0 on success, or -1 if the worker threads could not be started
+ */
+SHM_RINGBUFFERS_PUBLIC int srb_dispatcher_start(struct ShmRingBufferDispatcher* dispatcher);
+
+/*
+ * srb_dispatcher_stop
+ *   Stops and joins the worker threads, callbacks already running are finished first.
+ *
+ * params:
+ *   dispatcher - the dispatcher to stop
+ */
+SHM_RINGBUFFERS_PUBLIC void srb_dispatcher_stop(struct ShmRingBufferDispatcher* dispatcher);
+
+/*
+ * srb_dispatcher_free
+ *
+ * params:
+ *   dispatcher - the dispatcher to free, it is stopped first if running
+ */
+SHM_RINGBUFFERS_PUBLIC void srb_dispatcher_free(struct ShmRingBufferDispatcher* dispatcher);
+
+// ==================
+// Notifier functions
+// ==================
+
+/*
+ * srb_notifier_new
+ *   Forwards the segment's doorbell to a file descriptor, so an event loop can wait for rings to advance with epoll,
+ *   io_uring or poll alongside its other descriptors. One thread per notifier blocks on the doorbell, and the file
+ *   descriptor is signalled once per batch of advances until it is cleared.
  *
  * params:
  *   ring_buffers_handle - the handle to the ring buffer's shared memory
+ *
+ * returns:
+ *   a new notifier, to be freed with srb_notifier_free, or NULL if its descriptor or thread could not be created
  */
-SHM_RINGBUFFERS_PUBLIC void srb_close(SRBHandle ring_buffers_handle);
+SHM_RINGBUFFERS_PUBLIC struct ShmRingBufferNotifier* srb_notifier_new(SRBHandle ring_buffers_handle);
+
+/*
+ * srb_notifier_get_fd
+ *
+ * params:
+ *   notifier - the notifier to get the file descriptor of
+ *
+ * returns:
+ *   a non-blocking file descriptor that becomes readable when any ring in the segment advances, or the host state
+ *   changes, and stays readable until srb_notifier_clear
+ */
+SHM_RINGBUFFERS_PUBLIC int srb_notifier_get_fd(struct ShmRingBufferNotifier* notifier);
+
+/*
+ * srb_notifier_clear
+ *   Rearms the notifier. Call this before checking the rings, so an advance during the check signals again.
+ *
+ * params:
+ *   notifier - the notifier to clear
+ */
+SHM_RINGBUFFERS_PUBLIC void srb_notifier_clear(struct ShmRingBufferNotifier* notifier);
+
+/*
+ * srb_notifier_free
+ *
+ * params:
+ *   notifier - the notifier to stop and free, along with its file descriptor
+ */
+SHM_RINGBUFFERS_PUBLIC void srb_notifier_free(struct ShmRingBufferNotifier* notifier);
+
+// =================
+// Flusher functions
+// =================
+
+/*
+ * srb_flusher_new
+ *   Starts a thread that calls srb_host_flush_rings every interval_ms, so producers of persisted rings never wait
+ *   on the disk. Free it before closing the handle.
+ *
+ * params:
+ *   ring_buffers_handle - the host's handle to the ring buffer's shared memory
+ *   interval_ms - how often to flush, which bounds how much a power cut can lose
+ *
+ * returns:
+ *   a new flusher, to be freed with srb_flusher_free, or NULL if the handle is not the host's or the thread could
+ *   not be started
+ */
+SHM_RINGBUFFERS_PUBLIC struct ShmRingBufferFlusher* srb_flusher_new(SRBHandle ring_buffers_handle, unsigned int interval_ms);
+
+/*
+ * srb_flusher_free
+ *   Stops the flusher's thread, and flushes once more.
+ *
+ * params:
+ *   flusher - the flusher to stop and free
+ */
+SHM_RINGBUFFERS_PUBLIC void srb_flusher_free(struct ShmRingBufferFlusher* flusher);
+
+// ==================
+// Producer functions
+// ==================
+
+/*
+ * srb_producer_next_write_buffer
+ *   this function returns the next shared write buffer.
+ *
+ * params:
+ *   ring_buffer - the ring buffer to get the next shared buffer from
+ *
+ * return:
+ *   pointer to the next shared buffer
+ */
+SHM_RINGBUFFERS_PUBLIC uint8_t* srb_producer_next_write_buffer(struct ShmRingBuffer* ring_buffer);
+
+/*
+ * srb_producer_set_buffer_timestamp
+ *   Sets the timestamp of the buffer being written, such as the capture time of a sensor reading, in place of the
+ *   time it was started. Timestamps within a ring must not decrease.
+ *
+ * params:
+ *   ring_buffer - the timestamped ring buffer being written
+ *   timestamp - the buffer's timestamp
+ */
+SHM_RINGBUFFERS_PUBLIC void srb_producer_set_buffer_timestamp(struct ShmRingBuffer* ring_buffer, uint64_t timestamp);
+
+/*
+ * srb_producer_set_buffer_checksum
+ *   Sets the CRC32C of the first length bytes of the buffer being written on a checksummed ring. Without this,
+ *   the CRC32C of the whole buffer is computed when it is published.
+ *
+ * params:
+ *   ring_buffer - the checksummed ring buffer being written
+ *   crc - the CRC32C, from srb_producer_stream_copy_checksum or srb_crc32c
+ *   length - the number of bytes from the start of the buffer it covers
+ */
+SHM_RINGBUFFERS_PUBLIC void srb_producer_set_buffer_checksum(struct ShmRingBuffer* ring_buffer, uint32_t crc, uint64_t length);
+
+/*
+ * srb_producer_mark_dirty
+ *   Marks a range of the buffer being written on a dirty tracked ring as changed from the buffer before it. The
+ *   buffer must still be written in full, marking only saves subscribers copying the rest. Without any marks, the
+ *   changed tiles are found by comparing the buffer with the one before it when it is published.
+ *
+ * params:
+ *   ring_buffer - the dirty tracked ring buffer being written
+ *   offset - the start of the changed range in the buffer
+ *   length - the number of bytes changed
+ */
+SHM_RINGBUFFERS_PUBLIC void srb_producer_mark_dirty(struct ShmRingBuffer* ring_buffer, uint64_t offset, uint64_t length);
+
+/*
+ * srb_producer_set_write_progress
+ *   Tells subscribers that the first bytes of the buffer being written are complete, such as the rows of a frame
+ *   written so far. Progress starts at 0 for every new buffer and should only increase.
+ *
+ * params:
+ *   ring_buffer - the ring buffer being written
+ *   bytes - how many bytes from the start of the current write buffer are complete
+ */
+SHM_RINGBUFFERS_PUBLIC void srb_producer_set_write_progress(struct ShmRingBuffer* ring_buffer, uint64_t bytes);
+
+/*
+ * srb_producer_next_write_buffers
+ *   srb_producer_next_write_buffer for several rings as one transaction: the buffers previously written to all of
+ *   the rings are published together, in a single publish epoch. Rings read with
+ *   srb_subscriber_get_most_recent_buffers should only be written this way. Checksums and dirty tiles of the
+ *   buffers are worked out first, so other producers and readers only wait on the write positions being advanced.
+ *
+ * params:
+ *   ring_buffers - the ring buffers to publish, all in the same segment
+ *   num_rings - the number of ring buffers
+ *   buffers - will be set to each ring's next shared buffer
+ *
+ * return:
+ *   the publish epoch of this transaction
+ */
+SHM_RINGBUFFERS_PUBLIC uint64_t srb_producer_next_write_buffers(struct ShmRingBuffer** ring_buffers, unsigned int num_rings, uint8_t** buffers);
+
+/*
+ * srb_producer_next_write_topic_buffer
+ *   this function returns the next shared write buffer of a multiplexed ring, tagged with topic.
+ *
+ * params:
+ *   ring_buffer - the multiplexed ring buffer to get the next shared buffer from
+ *   topic - the topic id subscribers will see for this buffer (ignored if the ring is not multiplexed)
+ *
+ * return:
+ *   pointer to the next shared buffer
+ */
+SHM_RINGBUFFERS_PUBLIC uint8_t* srb_producer_next_write_topic_buffer(struct ShmRingBuffer* ring_buffer, uint16_t topic);
+
+/*
+ * srb_producer_publish_block
+ *   Writes a reference to block into the next write buffer of a ring whose buffer_size fits a struct ShmBlockRef.
+ *   The ring holds its own reference to the block until the slot is reused, so the same block can be published
+ *   to any number of rings. The caller's reference is left untouched.
+ *
+ * params:
+ *   ring_buffer - the ring buffer to publish to
+ *   block - the block id to publish, the caller must hold a reference to it
+ *   length - the bytes of the block in use
+ *
+ * returns:
+ *   0 on success, or -1 if the ring's buffers are too small or the segment has no block pool
+ */
+SHM_RINGBUFFERS_PUBLIC int srb_producer_publish_block(struct ShmRingBuffer* ring_buffer, uint32_t block, uint64_t length);
+
+/*
+ * srb_producer_stream_copy
+ *   Copies size bytes into a write buffer with non-temporal (cache bypassing) stores, using the widest of
+ *   AVX-512, AVX2 or SSE2 the CPU supports, then fences so the data is visible before the buffer is published.
+ *   Use this for large buffers subscribers won't read straight away, so filling them doesn't evict the
+ *   producer's working set. Small copies, and CPUs without streaming stores, fall back to memcpy.
+ *
+ * params:
+ *   buffer - the write buffer (or block) to copy into
+ *   src - the data to copy
+ *   size - the number of bytes to copy
+ */
+SHM_RINGBUFFERS_PUBLIC void srb_producer_stream_copy(uint8_t* buffer, const void* src, uint64_t size);
+
+/*
+ * srb_producer_stream_fill
+ *   Like srb_producer_stream_copy, but sets size bytes of the buffer to value.
+ *
+ * params:
+ *   buffer - the write buffer (or block) to fill
+ *   value - the byte to fill with
+ *   size - the number of bytes to fill
+ */
+SHM_RINGBUFFERS_PUBLIC void srb_producer_stream_fill(uint8_t* buffer, uint8_t value, uint64_t size);
+
+/*
+ * srb_producer_stream_copy_checksum
+ *   srb_producer_stream_copy, computing the CRC32C of the bytes as they are copied, so checksumming needs no
+ *   pass of its own over memory.
+ *
+ * params:
+ *   buffer - the write buffer (or block) to copy into
+ *   src - the data to copy
+ *   size - the number of bytes to copy
+ *   crc - the CRC32C of the buffer's bytes before these, or 0 to start
+ *
+ * returns:
+ *   the CRC32C of the buffer up to and including the copied bytes, for srb_producer_set_buffer_checksum
+ */
+SHM_RINGBUFFERS_PUBLIC uint32_t srb_producer_stream_copy_checksum(uint8_t* buffer, const void* src, uint64_t size, uint32_t crc);
+
+// ====================
+// Block pool functions
+// ====================
+
+/*
+ * srb_block_alloc
+ *
+ * params:
+ *   ring_buffers_handle - the handle to the ring buffer's shared memory
+ *
+ * returns:
+ *   the block id of a free block, referenced once by the caller, or 0 if the pool is exhausted or missing
+ */
+SHM_RINGBUFFERS_PUBLIC uint32_t srb_block_alloc(SRBHandle ring_buffers_handle);
+
+/*
+ * srb_block_get
+ *
+ * params:
+ *   ring_buffers_handle - the handle to the ring buffer's shared memory
+ *   block - the block id, the caller must hold a reference to it
+ *
+ * returns:
+ *   pointer to the block's block_size bytes
+ */
+SHM_RINGBUFFERS_PUBLIC uint8_t* srb_block_get(SRBHandle ring_buffers_handle, uint32_t block);
+
+/*
+ * srb_block_acquire
+ *   Takes another reference to a block, e.g. to hand it on to another stage.
+ *
+ * params:
+ *   ring_buffers_handle - the handle to the ring buffer's shared memory
+ *   block - the block id, the caller must already hold a reference to it
+ */
+SHM_RINGBUFFERS_PUBLIC void srb_block_acquire(SRBHandle ring_buffers_handle, uint32_t block);
+
+/*
+ * srb_block_release
+ *   Drops a reference to a block, the last one returns it to the pool.
+ *
+ * params:
+ *   ring_buffers_handle - the handle to the ring buffer's shared memory
+ *   block - the block id
+ */
+SHM_RINGBUFFERS_PUBLIC void srb_block_release(SRBHandle ring_buffers_handle, uint32_t block);
+
+/*
+ * srb_block_pool_num_free
+ *
+ * params:
+ *   ring_buffers_handle - the handle to the ring buffer's shared memory
+ *
+ * returns:
+ *   the number of blocks currently in the pool's free list
+ */
+SHM_RINGBUFFERS_PUBLIC unsigned int srb_block_pool_num_free(SRBHandle ring_buffers_handle);
+
+// =====================
+// State table functions
+// =====================
+
+/*
+ * srb_get_state_table
+ *
+ * params:
+ *   ring_buffers_handle - the handle to the ring buffer's shared memory
+ *   description - the description the table was added with
+ *
+ * returns:
+ *   the state table, or NULL if there is no such table or the grown segment could not be mapped
+ */
+SHM_RINGBUFFERS_PUBLIC struct ShmStateTable* srb_get_state_table(SRBHandle ring_buffers_handle, const char* description);
+
+/*
+ * srb_state_table_update
+ *   Sets the latest value of a key, adding the key if it is new. Only one thread or process may update a table,
+ *   readers are never blocked by it.
+ *
+ * params:
+ *   state_table - the state table
+ *   key - the key
+ *   value - the table's value_size bytes to store
+ *
+ * returns:
+ *   0 on success, or -1 if the key is new and the table already holds capacity keys
+ */
+SHM_RINGBUFFERS_PUBLIC int srb_state_table_update(struct ShmStateTable* state_table, uint64_t key, const void* value);
+
+/*
+ * srb_state_table_read
+ *   Copies the latest value of a key, never one torn by an update in progress. This is lock-free, not wait-free:
+ *   it retries whenever the key is updated twice while it copies, so a writer updating one key flat out can keep
+ *   a reader of that key retrying for as long as it does.
+ *
+ * params:
+ *   state_table - the state table
+ *   key - the key
+ *   value - where to copy the table's value_size bytes
+ *   changed - if not NULL, set to the change sequence of the value copied
+ *
+ * returns:
+ *   1 if the key was found, otherwise 0
+ */
+SHM_RINGBUFFERS_PUBLIC int srb_state_table_read(struct ShmStateTable* state_table, uint64_t key, void* value, uint64_t* changed);
+
+/*
+ * srb_state_table_get_change_sequence
+ *
+ * params:
+ *   state_table - the state table
+ *
+ * returns:
+ *   the number of updates made to the table so far, compare it with a previous call to see if anything changed
+ */
+SHM_RINGBUFFERS_PUBLIC uint64_t srb_state_table_get_change_sequence(struct ShmStateTable* state_table);
+
+/*
+ * srb_state_table_get_changes
+ *   Finds the keys updated since a change sequence, each reported once however often it changed, oldest change
+ *   first. This reads a log of recent changes, and only scans the whole table if the log has moved on too far.
+ *
+ * params:
+ *   state_table - the state table
+ *   since - the change sequence last seen, 0 at first, advanced past the changes reported
+ *   keys - array of at least max_keys to fill with the changed keys
+ *   max_keys - the most keys to report, call again with the advanced since if max_keys are reported
+ *
+ * returns:
+ *   the number of keys filled in
+ */
+SHM_RINGBUFFERS_PUBLIC unsigned int srb_state_table_get_changes(struct ShmStateTable* state_table, uint64_t* since, uint64_t* keys, unsigned int max_keys);
+
+// =================================================
+// Common functions to producer and subscriber sides
+// =================================================
+
+/*
+ * srb_crc32c
+ *   Computes the CRC32C (Castagnoli) of data, with the SSE4.2 or ARMv8 CRC instructions where the CPU has them.
+ *
+ * params:
+ *   crc - the CRC32C of the data before this, or 0 to start
+ *   data - the data to checksum
+ *   size - the number of bytes of data
+ *
+ * returns:
+ *   the CRC32C of everything so far
+ */
+SHM_RINGBUFFERS_PUBLIC uint32_t srb_crc32c(uint32_t crc, const void* data, uint64_t size);
+
+/*
+ * srb_host_new
+ *
+ * params:
+ *   shm_path - shared memory path
+ *   num_defs - the number of ringbuffers you are defining
+ *   ring_buffer_defs - array of {struct ShmRingBuffer}s which will be created in the mmap based on the supplied members:
+ *        buffer_size, num_buffers, description, multiplexed, timestamped, checksummed, dirty_tracked, and persist_path. (these can be freed if wanted after this call)
+ *
+ * returns:
+ *   the SRBHandle that references the shared memory ring buffers. This is usually followed up with srb_get_rings call.
+ */
+SHM_RINGBUFFERS_PUBLIC SRBHandle srb_host_new(const char* shm_path, unsigned int num_defs, struct ShmRingBufferDef* ring_buffer_defs);
+
+/*
+ * srb_host_new_with_pool
+ *   srb_host_new, plus a pool of refcounted blocks that rings can publish references to instead of payloads.
+ *
+ * params:
+ *   shm_path - shared memory path
+ *   num_defs - the number of ringbuffers you are defining
+ *   ring_buffer_defs - as for srb_host_new
+ *   block_pool_def - the block_size and num_blocks of the pool, or NULL for no pool
+ *
+ * returns:
+ *   the SRBHandle that references the shared memory ring buffers. This is usually followed up with srb_get_rings call.
+ */
+SHM_RINGBUFFERS_PUBLIC SRBHandle srb_host_new_with_pool(const char* shm_path, unsigned int num_defs, struct ShmRingBufferDef* ring_buffer_defs, struct ShmBlockPoolDef* block_pool_def);
+
+/*
+ * srb_host_signal_stopping
+ *   Call this from host to give clients time to shutdown.
+ *
+ * params:
+ *   ring_buffers_handle - the handle to the ring buffer's shared memory'
+ *
+ */
+SHM_RINGBUFFERS_PUBLIC void srb_host_signal_stopping(SRBHandle ring_buffers_handle);
+
+/*
+ * srb_host_reclaim_idle_rings
+ *   Call this periodically from host to release the memory of rings whose write_ring_pos has not advanced for
+ *   idle_seconds. The slot being written and the most recent slot are kept, all other slots have their pages
+ *   released (fallocate PUNCH_HOLE, or MADV_REMOVE). Pages are committed again lazily when the producer resumes.
+ *   Subscribers that had fallen behind skip ahead to the most recent buffer, as the ones before it are gone.
+ *   Rings that hold block pool references are never released, as that would leak their blocks, nor are persisted
+ *   rings, whose files keep their buffers.
+ *
+ * params:
+ *   ring_buffers_handle - the handle to the ring buffer's shared memory
+ *   idle_seconds - how long a ring must be idle before its memory is released
+ *
+ * returns:
+ *   the number of rings released by this call
+ */
+SHM_RINGBUFFERS_PUBLIC unsigned int srb_host_reclaim_idle_rings(SRBHandle ring_buffers_handle, unsigned int idle_seconds);
+
+/*
+ * srb_host_flush_rings
+ *   Copies the buffers published to persisted rings since the last flush from the segment to their files, as one or
+ *   two sequential runs per ring, fdatasyncs them so they are out of the drive's cache too, and only then advances
+ *   each file's write position past them. The flusher is the only writer of the files, so after a crash or power cut
+ *   a file holds exactly the buffers of its last completed flush. Buffers the producer overwrote while they were
+ *   being copied, when it got a whole ring ahead of the flusher, are left out of the file rather than saved torn.
+ *   Call it from one thread at a time, srb_flusher_new starts a thread that calls it periodically.
+ *
+ * params:
+ *   ring_buffers_handle - the host's handle to the ring buffer's shared memory
+ *
+ * returns:
+ *   0 on success, or -1 if a file could not be written, in which case its buffers are written again next time
+ */
+SHM_RINGBUFFERS_PUBLIC int srb_host_flush_rings(SRBHandle ring_buffers_handle);
+
+/*
+ * srb_host_add_ring
+ *   Adds a ring to a live segment. The segment grows to fit it, nothing already in it moves, so every other
+ *   ring carries on undisturbed. Clients see the new ring once they call srb_client_refresh.
+ *   Space is never reused, as clients may still hold rings from before a change, so each add, retire and resize
+ *   uses up part of the growth reserved when the segment was created, see srb_host_get_growth_headroom.
+ *
+ * params:
+ *   ring_buffers_handle - the handle to the ring buffer's shared memory
+ *   ring_buffer_def - the buffer_size, num_buffers, description, multiplexed, timestamped, checksummed, dirty_tracked, and persist_path of the new ring
+ *
+ * returns:
+ *   the new ring buffer, or NULL if the segment could not grow to fit it or its file could not be created
+ */
+SHM_RINGBUFFERS_PUBLIC struct ShmRingBuffer* srb_host_add_ring(SRBHandle ring_buffers_handle, struct ShmRingBufferDef* ring_buffer_def);
+
+/*
+ * srb_host_retire_ring
+ *   Removes a ring from the segment's directory. Clients still using it can keep doing so until they refresh,
+ *   and its memory is released by srb_host_reclaim_idle_rings once it goes idle.
+ *
+ * params:
+ *   ring_buffers_handle - the handle to the ring buffer's shared memory
+ *   description - the description of the ring to retire
+ *
+ * returns:
+ *   0 on success, or -1 if there is no such ring or the segment could not grow to fit the new directory
+ */
+SHM_RINGBUFFERS_PUBLIC int srb_host_retire_ring(SRBHandle ring_buffers_handle, const char* description);
+
+/*
+ * srb_host_resize_ring
+ *   Replaces a ring with a copy that has num_buffers buffers, in the same place in the directory. The replacement
+ *   starts with the old ring's most recent buffer, and the old ring is retired. The replacement and a new directory
+ *   are appended to the segment like srb_host_add_ring, so resizing large rings repeatedly runs out of growth.
+ *
+ * params:
+ *   ring_buffers_handle - the handle to the ring buffer's shared memory
+ *   description - the description of the ring to resize
+ *   num_buffers - the new number of buffers, at least 3
+ *
+ * returns:
+ *   the replacement ring buffer, or NULL if there is no such ring, it is persisted, or the segment could not grow to fit it
+ */
+SHM_RINGBUFFERS_PUBLIC struct ShmRingBuffer* srb_host_resize_ring(SRBHandle ring_buffers_handle, const char* description, unsigned int num_buffers);
+
+/*
+ * srb_host_get_growth_headroom
+ *   How much further the segment can grow for ring changes. This is reserved when the segment is created, 64 GiB
+ *   on 64-bit targets and 256 MiB on 32-bit ones, and is never given back while the host runs.
+ *
+ * params:
+ *   ring_buffers_handle - the handle to the ring buffer's shared memory
+ *
+ * returns:
+ *   the number of bytes the segment can still grow by
+ */
+SHM_RINGBUFFERS_PUBLIC uint64_t srb_host_get_growth_headroom(SRBHandle ring_buffers_handle);
+
+/*
+ * srb_host_add_state_table
+ *   Adds a keyed table of latest values to the segment, for state that only matters as of its latest update.
+ *
+ * params:
+ *   ring_buffers_handle - the handle to the ring buffer's shared memory
+ *   state_table_def - the capacity, value_size and description of the table (these can be freed after this call)
+ *
+ * returns:
+ *   the new state table, or NULL if the description is taken or the segment could not grow to fit it
+ */
+SHM_RINGBUFFERS_PUBLIC struct ShmStateTable* srb_host_add_state_table(SRBHandle ring_buffers_handle, struct ShmStateTableDef* state_table_def);
+
+/*
+ * srb_client_new
+ *
+ * params:
+ *   shm_path - shared memory path
+ *
+ * returns:
+ *   the SRBHandle that references the shared memory ring buffers. This is usually followed up with srb_get_rings call.
+ */
+SHM_RINGBUFFERS_PUBLIC SRBHandle srb_client_new(const char* shm_path);
+
+/*
+ * srb_client_open_file
+ *   Opens the file of a persisted ring, for example after a crash, as a read-only segment holding only that ring.
+ *   Its buffers up to the last flush are read, oldest first, with the usual srb_get_rings and subscriber functions, and
+ *   srb_client_get_state gives SRB_STOPPED if the host closed it cleanly. The file itself is never changed.
+ *
+ * params:
+ *   file_path - path of the file given as the ring's persist_path
+ *
+ * returns:
+ *   the SRBHandle that references the file's ring, to be closed with srb_close, or NULL if it is not a ring file
+ */
+SHM_RINGBUFFERS_PUBLIC SRBHandle srb_client_open_file(const char* file_path);
+
+/*
+ * srb_client_get_state
+ *
+ * params:
+ *   ring_buffers_handle - the handle to the ring buffer's shared memory
+ *
+ * returns:
+ *   the run state of the host
+ */
+SHM_RINGBUFFERS_PUBLIC enum EShmRingBuffersState srb_client_get_state(SRBHandle ring_buffers_handle);
+
+/*
+ * srb_client_refresh
+ *   Picks up rings added, retired or resized since the handle was created or last refreshed. This is cheap when
+ *   nothing changed, so it can be called often. Ring pointers from before the refresh stay valid, rings that are
+ *   still in the directory keep their read position, and srb_get_rings must be called again to see the changes.
+ *
+ * params:
+ *   ring_buffers_handle - the handle to the ring buffer's shared memory
+ *
+ * returns:
+ *   1 if the rings changed, 0 if not, or -1 if the grown segment could not be mapped
+ */
+SHM_RINGBUFFERS_PUBLIC int srb_client_refresh(SRBHandle ring_buffers_handle);
+
+/*
+ * srb_ring_is_retired
+ *
+ * params:
+ *   ring_buffer - the ring buffer to check
+ *
+ * returns:
+ *   non-zero if the host has retired or resized the ring, its replacement is found by description after a refresh
+ */
+SHM_RINGBUFFERS_PUBLIC int srb_ring_is_retired(struct ShmRingBuffer* ring_buffer);
+
+/*
+ * srb_get_rings
+ *
+ * params:
+ *   ring_buffers_handle - the handle to the ring buffer's shared memory
+ *   ring_buffers - will be set to the memory mapped ring_buffers
+ *
+ * returns:
+ *   the number of ring_buffers
+ */
+SHM_RINGBUFFERS_PUBLIC unsigned int srb_get_rings(SRBHandle ring_buffers_handle, struct ShmRingBuffer** ring_buffers);
+
+/*
+ * srb_get_ring_by_description
+ *
+ * params:
+ *   ring_buffers_handle - the handle to the ring buffer's shared memory
+ *   description - will be set to the memory mapped ring_buffers
+ *
+ * returns:
+ *   a pointer to the ring buffer or NULL if not found
+ */
+SHM_RINGBUFFERS_PUBLIC struct ShmRingBuffer* srb_get_ring_by_description(SRBHandle ring_buffers_handle, char* description);
+
+/*
+ * srb_get_ring_resident_size
+ *
+ * params:
+ *   ring_buffer - the ring buffer to measure
+ *
+ * returns:
+ *   the number of bytes of the ring's buffers currently committed in memory, counted in whole pages and
+ *   clamped to num_buffers * buffer_size
+ */
+SHM_RINGBUFFERS_PUBLIC uint64_t srb_get_ring_resident_size(struct ShmRingBuffer* ring_buffer);
+
+/*
+ * srb_close
+ *   unmaps all ring buffers and closes the shared memory, if producer first signals SRB_STOPPED
+ *
+ * params:
+ *   ring_buffers_handle - the handle to the ring buffer's shared memory
+ */
+SHM_RINGBUFFERS_PUBLIC void srb_close(SRBHandle ring_buffers_handle);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
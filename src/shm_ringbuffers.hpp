@@ -0,0 +1,328 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2025-present Edward Andrew Flick.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/*
+ * C++20 coroutine layer for subscribers, on Linux. A Reactor waits on the segment's doorbell through a notifier
+ * file descriptor, and resumes coroutines awaiting Ring::next or RingSet::any through an Executor:
+ *
+ *   srb::Reactor reactor(handle);
+ *   srb::Ring frames(reactor, ring_buffer);
+ *   ...
+ *   while (uint8_t* buffer = co_await frames.next()) {
+ *       ...
+ *   }
+ *
+ * One thread calling Reactor::run, or polling Reactor::fd from its own epoll or io_uring loop, serves any number
+ * of awaiting coroutines. Like the C subscriber functions, a ring's read position belongs to whoever reads it, so
+ * only await a ring from one coroutine at a time.
+ */
+
+#ifndef SHM_RINGBUFFERS_HPP
+#define SHM_RINGBUFFERS_HPP
+
+#include "shm_ringbuffers.h"
+
+#include <atomic>
+#include <cerrno>
+#include <coroutine>
+#include <cstdint>
+#include <mutex>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <system_error>
+#include <unistd.h>
+#include <vector>
+
+namespace srb {
+
+// Resumes coroutines whose wait is over. Implement post to hand them to a thread pool, strand or another loop.
+class Executor {
+public:
+    virtual ~Executor() = default;
+    virtual void post(std::coroutine_handle<> handle) = 0;
+};
+
+// Resumes coroutines right away, on the thread polling the Reactor.
+class InlineExecutor : public Executor {
+public:
+    void post(std::coroutine_handle<> handle) override { handle.resume(); }
+};
+
+// A suspended co_await, checked by the Reactor whenever the segment's doorbell rings.
+class Waiter {
+public:
+    virtual ~Waiter() = default;
+
+    // Returns true once the wait is over, stopping is set when the host is no longer running
+    virtual bool try_complete(bool stopping) = 0;
+
+    std::coroutine_handle<> handle;
+};
+
+class Reactor {
+public:
+    explicit Reactor(SRBHandle handle)
+        : Reactor(handle, inline_executor_)
+    {
+    }
+
+    Reactor(SRBHandle handle, Executor& executor)
+        : handle_(handle)
+        , executor_(executor)
+    {
+        notifier_ = srb_notifier_new(handle);
+        if (notifier_ == nullptr) {
+            throw std::system_error(errno, std::system_category(), "srb_notifier_new");
+        }
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if ((epoll_fd_ < 0) || (wake_fd_ < 0) || (watch(srb_notifier_get_fd(notifier_)) < 0) || (watch(wake_fd_) < 0)) {
+            int error = errno;
+            close_all();
+            throw std::system_error(error, std::system_category(), "Reactor epoll");
+        }
+    }
+
+    Reactor(const Reactor&) = delete;
+    Reactor& operator=(const Reactor&) = delete;
+
+    ~Reactor() { close_all(); }
+
+    // An epoll descriptor that is readable when poll has work, for nesting in another epoll or io_uring loop
+    int fd() const { return epoll_fd_; }
+
+    bool stopping() const { return srb_client_get_state(handle_) != SRB_RUNNING; }
+
+    std::size_t num_waiting()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return waiters_.size();
+    }
+
+    // Resumes every waiter whose ring is ready, without blocking
+    void poll()
+    {
+        srb_notifier_clear(notifier_);
+        uint64_t count;
+        while (read(wake_fd_, &count, sizeof(count)) > 0) {
+        }
+
+        bool is_stopping = stopping();
+        ready_.clear();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (std::size_t i = 0; i < waiters_.size();) {
+                if (waiters_[i]->try_complete(is_stopping)) {
+                    ready_.push_back(waiters_[i]->handle);
+                    waiters_[i] = waiters_.back();
+                    waiters_.pop_back();
+                } else {
+                    i++;
+                }
+            }
+        }
+        // Posted outside the lock, so resumed coroutines can await again straight away
+        std::vector<std::coroutine_handle<>> resuming;
+        resuming.swap(ready_);
+        for (std::coroutine_handle<> handle : resuming) {
+            executor_.post(handle);
+        }
+        resuming.swap(ready_);
+    }
+
+    // Waits up to timeout_ms (-1 for no limit) for the doorbell or stop, then polls
+    void run_once(int timeout_ms)
+    {
+        struct epoll_event events[2];
+        if (epoll_wait(epoll_fd_, events, 2, timeout_ms) > 0) {
+            poll();
+        }
+    }
+
+    // Polls until stop is called, or the host stops running and nothing is left waiting
+    void run()
+    {
+        poll();
+        while (!stop_requested_.load()) {
+            if (stopping() && (num_waiting() == 0)) {
+                break;
+            }
+            run_once(-1);
+        }
+        stop_requested_.store(false);
+    }
+
+    // Makes run return, callable from any thread or coroutine
+    void stop()
+    {
+        stop_requested_.store(true);
+        uint64_t one = 1;
+        if (write(wake_fd_, &one, sizeof(one)) < 0) {
+            // Already readable
+        }
+    }
+
+    // Called from await_suspend, returns false if the waiter completed already and should not suspend
+    bool suspend(Waiter* waiter, std::coroutine_handle<> handle)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // Checked again under the lock, in case the ring advanced after await_ready while poll was already running
+        if (waiter->try_complete(stopping())) {
+            return false;
+        }
+        waiter->handle = handle;
+        waiters_.push_back(waiter);
+        return true;
+    }
+
+private:
+    int watch(int fd)
+    {
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        return epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event);
+    }
+
+    void close_all()
+    {
+        if (epoll_fd_ >= 0) {
+            ::close(epoll_fd_);
+        }
+        if (wake_fd_ >= 0) {
+            ::close(wake_fd_);
+        }
+        if (notifier_ != nullptr) {
+            srb_notifier_free(notifier_);
+        }
+    }
+
+    InlineExecutor inline_executor_;
+    SRBHandle handle_;
+    Executor& executor_;
+    struct ShmRingBufferNotifier* notifier_ = nullptr;
+    int epoll_fd_ = -1;
+    int wake_fd_ = -1; // Signalled by stop
+    std::atomic<bool> stop_requested_ { false };
+    std::mutex mutex_; // Guards waiters_, which coroutines resumed on other threads may add to
+    std::vector<Waiter*> waiters_;
+    std::vector<std::coroutine_handle<>> ready_; // Reused by poll
+};
+
+// co_await gives the next unread buffer, as srb_subscriber_get_next_unread_buffer, or nullptr once the host stops.
+class NextBufferAwaiter : public Waiter {
+public:
+    NextBufferAwaiter(Reactor& reactor, struct ShmRingBuffer* ring_buffer)
+        : reactor_(reactor)
+        , ring_buffer_(ring_buffer)
+    {
+    }
+
+    bool await_ready() { return try_complete(reactor_.stopping()); }
+    bool await_suspend(std::coroutine_handle<> handle) { return reactor_.suspend(this, handle); }
+    uint8_t* await_resume() { return buffer_; }
+
+    bool try_complete(bool stopping) override
+    {
+        buffer_ = srb_subscriber_get_next_unread_buffer(ring_buffer_);
+        return (buffer_ != nullptr) || stopping;
+    }
+
+private:
+    Reactor& reactor_;
+    struct ShmRingBuffer* ring_buffer_;
+    uint8_t* buffer_ = nullptr;
+};
+
+class Ring {
+public:
+    Ring(Reactor& reactor, struct ShmRingBuffer* ring_buffer)
+        : reactor_(reactor)
+        , ring_buffer_(ring_buffer)
+    {
+    }
+
+    struct ShmRingBuffer* get() const { return ring_buffer_; }
+
+    NextBufferAwaiter next() { return NextBufferAwaiter(reactor_, ring_buffer_); }
+
+private:
+    Reactor& reactor_;
+    struct ShmRingBuffer* ring_buffer_;
+};
+
+// co_await gives a ring that advanced, as srb_ring_set_wait, or nullptr once the host stops.
+class AnyRingAwaiter : public Waiter {
+public:
+    AnyRingAwaiter(Reactor& reactor, struct ShmRingBufferSet* ring_set)
+        : reactor_(reactor)
+        , ring_set_(ring_set)
+    {
+    }
+
+    bool await_ready() { return try_complete(reactor_.stopping()); }
+    bool await_suspend(std::coroutine_handle<> handle) { return reactor_.suspend(this, handle); }
+    struct ShmRingBuffer* await_resume() { return ring_buffer_; }
+
+    bool try_complete(bool stopping) override
+    {
+        if (srb_ring_set_wait(ring_set_, &ring_buffer_, 1, 0) == 0) {
+            ring_buffer_ = nullptr;
+        }
+        return (ring_buffer_ != nullptr) || stopping;
+    }
+
+private:
+    Reactor& reactor_;
+    struct ShmRingBufferSet* ring_set_;
+    struct ShmRingBuffer* ring_buffer_ = nullptr;
+};
+
+// Awaits many rings at once, each advance is reported once so drain a reported ring before awaiting again.
+class RingSet {
+public:
+    explicit RingSet(Reactor& reactor)
+        : reactor_(reactor)
+        , ring_set_(srb_ring_set_new())
+    {
+    }
+
+    RingSet(const RingSet&) = delete;
+    RingSet& operator=(const RingSet&) = delete;
+
+    ~RingSet() { srb_ring_set_free(ring_set_); }
+
+    // Returns false if the ring is from a different segment than the rings already added
+    bool add(struct ShmRingBuffer* ring_buffer) { return srb_ring_set_add(ring_set_, ring_buffer) == 0; }
+
+    AnyRingAwaiter any() { return AnyRingAwaiter(reactor_, ring_set_); }
+
+private:
+    Reactor& reactor_;
+    struct ShmRingBufferSet* ring_set_;
+};
+
+} // namespace srb
+
+#endif
@@ -22,6 +22,8 @@
  *
  */
 
+#include <inttypes.h>
+#include <poll.h>
 #include <shm_ringbuffers.h>
 #include <signal.h>
 #include <stdio.h>
@@ -30,10 +32,48 @@
 #include <unistd.h>
 
 SRBHandle h = NULL;
+struct ShmRingBufferFlusher* flusher = NULL;
 
 void printUsage(char* progName)
 {
-    printf("Usage:\n %s SHMNAME (RINGNAME BUFFERSIZE NUMBUFFERS)+\n\nAttaches to shared memory SHMNAME, and creates a ring for each RINGNAME BUFFERSIZE and NUMBUFFERS set provided. example:\n\n %s /srb_video_test video_frames 8294400 10\n\n ... will attach to /srb_video_test and create one ring named video_frames with 10 buffers of size 8294400 bytes.\n", progName, progName);
+    printf("Usage:\n %s [-i IDLESECONDS] [-m RINGNAME]... [-t RINGNAME]... [-c RINGNAME]... [-d RINGNAME]... [-p BLOCKSIZE,NUMBLOCKS] [-f RINGNAME,FILE]... SHMNAME (RINGNAME BUFFERSIZE NUMBUFFERS)+\n\nAttaches to shared memory SHMNAME, and creates a ring for each RINGNAME BUFFERSIZE and NUMBUFFERS set provided. example:\n\n %s /srb_video_test video_frames 8294400 10\n\n ... will attach to /srb_video_test and create one ring named video_frames with 10 buffers of size 8294400 bytes.\n\n -i IDLESECONDS releases the memory of rings that have not been written for IDLESECONDS (it is committed again when writes resume).\n -m RINGNAME makes RINGNAME a multiplexed ring, carrying a topic id with every buffer.\n -t RINGNAME makes RINGNAME a timestamped ring, with an index of buffer timestamps for seeking.\n -c RINGNAME makes RINGNAME a checksummed ring, carrying a CRC32C of every buffer.\n -d RINGNAME makes RINGNAME a dirty tracked ring, recording which tiles of every buffer changed.\n -p BLOCKSIZE,NUMBLOCKS adds a pool of NUMBLOCKS refcounted blocks of BLOCKSIZE bytes, which rings can publish by reference.\n -f RINGNAME,FILE flushes RINGNAME to FILE on disk every 100 ms, so its buffers can be read with srbinfo -f after a crash.\n\nWhile hosting, rings can be changed by entering these commands:\n\n add RINGNAME BUFFERSIZE NUMBUFFERS\n retire RINGNAME\n resize RINGNAME NUMBUFFERS\n table TABLENAME CAPACITY VALUESIZE\n", progName, progName);
+}
+
+void runCommand(char* line)
+{
+    char ringName[256];
+    uint64_t bufferSize = 0;
+    int numBuffers = 0;
+    if (sscanf(line, "add %255s %" SCNu64 " %d", ringName, &bufferSize, &numBuffers) == 3) {
+        struct ShmRingBufferDef srbd = { .buffer_size = bufferSize, .num_buffers = numBuffers, .description = ringName };
+        if ((bufferSize < 1) || (numBuffers < 3) || (srb_host_add_ring(h, &srbd) == NULL)) {
+            printf("Could not add %s (%" PRIu64 " bytes of growth left)\n", ringName, srb_host_get_growth_headroom(h));
+        } else {
+            printf("Added %s (%" PRIu64 " bytes x %d buffers)\n", ringName, bufferSize, numBuffers);
+        }
+    } else if (sscanf(line, "retire %255s", ringName) == 1) {
+        if (srb_host_retire_ring(h, ringName) < 0) {
+            printf("Could not retire %s (%" PRIu64 " bytes of growth left)\n", ringName, srb_host_get_growth_headroom(h));
+        } else {
+            printf("Retired %s\n", ringName);
+        }
+    } else if (sscanf(line, "resize %255s %d", ringName, &numBuffers) == 2) {
+        if (srb_host_resize_ring(h, ringName, numBuffers) == NULL) {
+            printf("Could not resize %s (%" PRIu64 " bytes of growth left)\n", ringName, srb_host_get_growth_headroom(h));
+        } else {
+            printf("Resized %s to %d buffers\n", ringName, numBuffers);
+        }
+    } else if (sscanf(line, "table %255s %d %" SCNu64, ringName, &numBuffers, &bufferSize) == 3) {
+        struct ShmStateTableDef stdef = { .capacity = numBuffers, .value_size = bufferSize, .description = ringName };
+        if ((numBuffers < 1) || (srb_host_add_state_table(h, &stdef) == NULL)) {
+            printf("Could not add state table %s (%" PRIu64 " bytes of growth left)\n", ringName, srb_host_get_growth_headroom(h));
+        } else {
+            printf("Added state table %s (%d keys x %" PRIu64 " bytes)\n", ringName, numBuffers, bufferSize);
+        }
+    } else {
+        printf("Unknown command, expected: add RINGNAME BUFFERSIZE NUMBUFFERS | retire RINGNAME | resize RINGNAME NUMBUFFERS | table TABLENAME CAPACITY VALUESIZE\n");
+    }
+    fflush(stdout);
 }
 
 void hostCloseSRB(int signum)
@@ -41,6 +81,9 @@ void hostCloseSRB(int signum)
     printf("Signalling (%d) that host is shutting down...\n", signum);
     srb_host_signal_stopping(h);
     sleep(5);
+    if (flusher) {
+        srb_flusher_free(flusher);
+    }
     printf("Closing shared buffers.\n");
     srb_close(h);
     exit(0);
@@ -49,13 +92,82 @@ void hostCloseSRB(int signum)
 int main(int argc, char** argv)
 {
     char* shmName;
+    int idleSeconds = 0;
+    char** args = argv + 1;
+    char** muxNames = malloc(sizeof(char*) * argc);
+    int numMuxNames = 0;
+    char** timestampedNames = malloc(sizeof(char*) * argc);
+    int numTimestampedNames = 0;
+    char** checksummedNames = malloc(sizeof(char*) * argc);
+    int numChecksummedNames = 0;
+    char** dirtyNames = malloc(sizeof(char*) * argc);
+    int numDirtyNames = 0;
+    char** persistNames = malloc(sizeof(char*) * argc);
+    char** persistPaths = malloc(sizeof(char*) * argc);
+    int numPersistNames = 0;
+    struct ShmBlockPoolDef blockPoolDef = { 0, 0 };
+
+    while ((argc > 2) && (args[0][0] == '-')) {
+        if (strcmp(args[0], "-i") == 0) {
+            idleSeconds = atoi(args[1]);
+            if (idleSeconds < 1) {
+                free(muxNames);
+                free(timestampedNames);
+                free(checksummedNames);
+                free(dirtyNames);
+                free(persistNames);
+                free(persistPaths);
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(args[0], "-m") == 0) {
+            muxNames[numMuxNames++] = args[1];
+        } else if (strcmp(args[0], "-t") == 0) {
+            timestampedNames[numTimestampedNames++] = args[1];
+        } else if (strcmp(args[0], "-c") == 0) {
+            checksummedNames[numChecksummedNames++] = args[1];
+        } else if (strcmp(args[0], "-d") == 0) {
+            dirtyNames[numDirtyNames++] = args[1];
+        } else if (strcmp(args[0], "-p") == 0) {
+            uint64_t blockSize = 0;
+            int numBlocks = 0;
+            if ((sscanf(args[1], "%" SCNu64 ",%d", &blockSize, &numBlocks) != 2) || (blockSize < 1) || (numBlocks < 1)) {
+                free(muxNames);
+                free(timestampedNames);
+                free(checksummedNames);
+                free(dirtyNames);
+                free(persistNames);
+                free(persistPaths);
+                printUsage(argv[0]);
+                return 1;
+            }
+            blockPoolDef.block_size = blockSize;
+            blockPoolDef.num_blocks = numBlocks;
+        } else if ((strcmp(args[0], "-f") == 0) && strchr(args[1], ',')) {
+            // Split RINGNAME,FILE in place
+            persistNames[numPersistNames] = args[1];
+            persistPaths[numPersistNames] = strchr(args[1], ',') + 1;
+            persistPaths[numPersistNames++][-1] = 0;
+        } else {
+            free(muxNames);
+            free(timestampedNames);
+            free(checksummedNames);
+            free(dirtyNames);
+            free(persistNames);
+            free(persistPaths);
+            printUsage(argv[0]);
+            return 1;
+        }
+        args += 2;
+        argc -= 2;
+    }
 
     if (argc < 5) {
         printUsage(argv[0]);
         return 1;
     }
 
-    shmName = argv[1];
+    shmName = args[0];
 
     if ((argc - 2) % 3) {
         // Wrong number of args supplied
@@ -66,14 +178,20 @@ int main(int argc, char** argv)
     int numChannels = (argc - 2) / 3;
     struct ShmRingBufferDef* srbd = malloc(sizeof(struct ShmRingBuffer) * numChannels);
 
-    char** rings = argv + 2;
+    char** rings = args + 1;
     for (int channelNum = 0; channelNum < numChannels; channelNum++) {
         char* channelName = *(rings++);
-        int bufferSize = atoi(*(rings++));
+        uint64_t bufferSize = strtoull(*(rings++), NULL, 10);
         int numBuffers = atoi(*(rings++));
 
         if ((bufferSize < 1) || (numBuffers < 3)) {
             free(srbd);
+            free(muxNames);
+            free(timestampedNames);
+            free(checksummedNames);
+            free(dirtyNames);
+            free(persistNames);
+            free(persistPaths);
             printUsage(argv[0]);
             return 2;
         }
@@ -81,23 +199,89 @@ int main(int argc, char** argv)
         srbd[channelNum].buffer_size = bufferSize;
         srbd[channelNum].num_buffers = numBuffers;
         srbd[channelNum].description = channelName;
+        srbd[channelNum].multiplexed = 0;
+        for (int i = 0; i < numMuxNames; i++) {
+            if (strcmp(muxNames[i], channelName) == 0) {
+                srbd[channelNum].multiplexed = 1;
+            }
+        }
+        srbd[channelNum].timestamped = 0;
+        for (int i = 0; i < numTimestampedNames; i++) {
+            if (strcmp(timestampedNames[i], channelName) == 0) {
+                srbd[channelNum].timestamped = 1;
+            }
+        }
+        srbd[channelNum].checksummed = 0;
+        for (int i = 0; i < numChecksummedNames; i++) {
+            if (strcmp(checksummedNames[i], channelName) == 0) {
+                srbd[channelNum].checksummed = 1;
+            }
+        }
+        srbd[channelNum].dirty_tracked = 0;
+        for (int i = 0; i < numDirtyNames; i++) {
+            if (strcmp(dirtyNames[i], channelName) == 0) {
+                srbd[channelNum].dirty_tracked = 1;
+            }
+        }
+        srbd[channelNum].persist_path = NULL;
+        for (int i = 0; i < numPersistNames; i++) {
+            if (strcmp(persistNames[i], channelName) == 0) {
+                srbd[channelNum].persist_path = persistPaths[i];
+            }
+        }
     }
+    free(muxNames);
+    free(timestampedNames);
+    free(checksummedNames);
+    free(dirtyNames);
+    free(persistNames);
+    free(persistPaths);
 
-    h = srb_host_new(shmName, numChannels, srbd);
+    h = srb_host_new_with_pool(shmName, numChannels, srbd, &blockPoolDef);
     if (h == NULL) {
         return 3;
     }
+    for (int channelNum = 0; channelNum < numChannels; channelNum++) {
+        if (srbd[channelNum].persist_path && (flusher == NULL)) {
+            flusher = srb_flusher_new(h, 100);
+        }
+    }
     signal(SIGINT, hostCloseSRB);
 
     // Host needs to be run before and while all clients are run.
     printf("Hosting (at \"%s\") buffers:\n", shmName);
     for (int channelNum = 0; channelNum < numChannels; channelNum++) {
-        printf("\t%s (%d bytes x %d buffers)\n", srbd[channelNum].description, srbd[channelNum].buffer_size, srbd[channelNum].num_buffers);
+        printf("\t%s (%" PRIu64 " bytes x %d buffers%s%s%s%s)", srbd[channelNum].description, srbd[channelNum].buffer_size, srbd[channelNum].num_buffers, srbd[channelNum].multiplexed ? ", multiplexed" : "", srbd[channelNum].timestamped ? ", timestamped" : "", srbd[channelNum].checksummed ? ", checksummed" : "", srbd[channelNum].dirty_tracked ? ", dirty tracked" : "");
+        if (srbd[channelNum].persist_path) {
+            printf(" in %s", srbd[channelNum].persist_path);
+        }
+        printf("\n");
+    }
+    if (blockPoolDef.num_blocks) {
+        printf("\tblock pool (%" PRIu64 " bytes x %d blocks)\n", blockPoolDef.block_size, blockPoolDef.num_blocks);
     }
-    printf("\nPress Ctrl+C to stop.\n");
+    if (idleSeconds) {
+        printf("Releasing memory of rings idle for %d seconds.\n", idleSeconds);
+    }
+    printf("\nEnter add, retire or resize commands to change rings, or table to add a state table. Press Ctrl+C to stop.\n");
+    fflush(stdout);
 
+    // Wait on commands from stdin, for up to a second at a time, until it is closed
+    struct pollfd commands = { .fd = STDIN_FILENO, .events = POLLIN };
+    char line[512];
     while (1) {
-        sleep(1);
+        if (commands.fd < 0) {
+            sleep(1);
+        } else if (poll(&commands, 1, 1000) > 0) {
+            if (fgets(line, sizeof(line), stdin)) {
+                runCommand(line);
+            } else {
+                commands.fd = -1;
+            }
+        }
+        if (idleSeconds) {
+            srb_host_reclaim_idle_rings(h, idleSeconds);
+        }
     };
 
     return 0;
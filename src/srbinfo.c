@@ -22,6 +22,7 @@
  *
  */
 
+#include <inttypes.h>
 #include <shm_ringbuffers.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -32,7 +33,51 @@ SRBHandle h = NULL;
 
 void printUsage(char* progName)
 {
-    printf("Usage:\n %s SHMNAME\n\nShows info about SRBs at shared memory location SHMNAME.\n\n", progName);
+    printf("Usage:\n %s SHMNAME\n %s -f FILE\n\nShows info about SRBs at shared memory location SHMNAME, or in the file FILE of a persisted ring.\n\n", progName, progName);
+}
+
+int showFile(char* fileName)
+{
+    h = srb_client_open_file(fileName);
+    if (h == NULL) {
+        return 1;
+    }
+    printf("SRB file \"%s\" (%s):\n", fileName, (srb_client_get_state(h) == SRB_RUNNING) ? "host did not close it" : "closed cleanly");
+
+    struct ShmRingBuffer* srb;
+    int numRings = srb_get_rings(h, &srb);
+    for (int i = 0; i < numRings; i++) {
+        printf("\t%s (%" PRIu64 " bytes x %d buffers%s%s%s%s)\n", srb[i].description, srb[i].shared->buffer_size, srb[i].shared->num_buffers, srb[i].topic_ids ? ", multiplexed" : "", srb[i].timestamps ? ", timestamped" : "", srb[i].checksums ? ", checksummed" : "", srb[i].dirty_tiles ? ", dirty tracked" : "");
+        uint64_t numBuffers = 0;
+        uint64_t numFailed = 0;
+        uint64_t firstTimestamp = 0;
+        uint64_t lastTimestamp = 0;
+        uint64_t firstSequence = srb[i].last_read_ring_pos + 1;
+        uint8_t* buffer;
+        while ((buffer = srb_subscriber_get_next_unread_buffer(&srb[i]))) {
+            if (srb_subscriber_verify_buffer(&srb[i], buffer) == 0) {
+                numFailed++;
+            }
+            lastTimestamp = srb_subscriber_get_buffer_timestamp(&srb[i], buffer);
+            firstTimestamp = numBuffers ? firstTimestamp : lastTimestamp;
+            numBuffers++;
+        }
+        if (numBuffers == 0) {
+            printf("\t\tno buffers flushed\n");
+            continue;
+        }
+        printf("\t\tbuffers %" PRIu64 " to %" PRIu64 " flushed", firstSequence, firstSequence + numBuffers - 1);
+        if (srb[i].timestamps) {
+            printf(", timestamps %" PRIu64 " to %" PRIu64 " ns", firstTimestamp, lastTimestamp);
+        }
+        if (srb[i].checksums) {
+            printf(", %" PRIu64 " failed checksums", numFailed);
+        }
+        printf("\n");
+    }
+
+    srb_close(h);
+    return 0;
 }
 
 int main(int argc, char** argv)
@@ -46,6 +91,14 @@ int main(int argc, char** argv)
         return 1;
     }
 
+    if (strcmp(argv[1], "-f") == 0) {
+        if (argc < 3) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        return showFile(argv[2]);
+    }
+
     shmName = argv[1];
 
     h = srb_client_new(shmName);
@@ -55,8 +108,23 @@ int main(int argc, char** argv)
     printf("SRB buffers at \"%s\":\n", shmName);
 
     int numRings = srb_get_rings(h, &srb);
-    while (numRings--) {
-        printf("\t%s (%d bytes x %d buffers)\n", srb->description, srb->shared->buffer_size, srb->shared->num_buffers);
+    for (int i = 0; i < numRings; i++) {
+        uint64_t reserved = srb[i].shared->buffer_size * srb[i].shared->num_buffers;
+        printf("\t%s (%" PRIu64 " bytes x %d buffers%s%s%s%s, %" PRIu64 " of %" PRIu64 " bytes resident", srb[i].description, srb[i].shared->buffer_size, srb[i].shared->num_buffers, srb[i].topic_ids ? ", multiplexed" : "", srb[i].timestamps ? ", timestamped" : "", srb[i].checksums ? ", checksummed" : "", srb[i].dirty_tiles ? ", dirty tracked" : "", srb_get_ring_resident_size(&srb[i]), reserved);
+        if (srb[i].shared->persist_path_offset) {
+            printf(", persisted to %s", (char*)(h->mem_map + srb[i].shared->persist_path_offset));
+        }
+        printf(")\n");
+    }
+
+    if (h->block_pool) {
+        printf("\tblock pool (%" PRIu64 " bytes x %u blocks, %u free)\n", h->block_pool->block_size, h->block_pool->num_blocks, srb_block_pool_num_free(h));
+    }
+
+    for (uint64_t offset = h->ring_buffers_head->state_tables_offset; offset;) {
+        struct ShmStateTableShared* table = (struct ShmStateTableShared*)(h->mem_map + offset);
+        printf("\tstate table %s (%u of %u keys x %" PRIu64 " bytes, %" PRIu64 " changes)\n", (char*)(h->mem_map + table->description_offset), table->num_keys, table->capacity, table->value_size, table->change_sequence);
+        offset = table->next_offset;
     }
 
     srb_close(h);
@@ -0,0 +1,162 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2025-present Edward Andrew Flick.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <inttypes.h>
+#include <shm_ringbuffers.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+SRBHandle h = NULL;
+
+void printUsage(char* progName)
+{
+    printf("Usage:\n %s [-b] [-d SECONDS] [-n COUNT] SHMNAME\n\nShows live rates of the SRBs at shared memory location SHMNAME, by sampling each ring's write position.\n\n -b batch mode, prints one logfmt line per ring per sample instead of redrawing the screen, for scraping. Times are -1 for idle rings.\n -d SECONDS is the time between samples (default 1).\n -n COUNT stops after COUNT samples (default runs until the host stops or Ctrl+C).\n", progName);
+}
+
+double getCurTime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec + (double)ts.tv_nsec / 1000000000.0);
+}
+
+int main(int argc, char** argv)
+{
+    char* shmName;
+    char** args = argv + 1;
+    int batch = 0;
+    double delay = 1.0;
+    long count = 0;
+
+    while ((argc > 2) && (args[0][0] == '-')) {
+        int consumed = 2;
+        if (strcmp(args[0], "-b") == 0) {
+            batch = 1;
+            consumed = 1;
+        } else if (strcmp(args[0], "-d") == 0) {
+            delay = atof(args[1]);
+            if (delay <= 0) {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(args[0], "-n") == 0) {
+            count = atol(args[1]);
+            if (count < 1) {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+        args += consumed;
+        argc -= consumed;
+    }
+
+    if (argc != 2) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    shmName = args[0];
+
+    h = srb_client_new(shmName);
+    if (h == NULL) {
+        return 1;
+    }
+
+    // Only the write positions are read, so the producers and subscribers never see us
+    struct ShmRingBuffer* srb;
+    int numRings = srb_get_rings(h, &srb);
+    uint64_t* lastPos = malloc(sizeof(uint64_t) * numRings);
+    for (int i = 0; i < numRings; i++) {
+        lastPos[i] = __atomic_load_n(&srb[i].shared->write_ring_pos, __ATOMIC_RELAXED);
+    }
+    double lastTime = getCurTime();
+
+    for (long sample = 1; (count == 0) || (sample <= count); sample++) {
+        usleep((useconds_t)(delay * 1000000.0));
+        if (srb_client_get_state(h) != SRB_RUNNING) {
+            fprintf(stderr, "Host at \"%s\" has stopped.\n", shmName);
+            break;
+        }
+        if (srb_client_refresh(h) > 0) {
+            // Rings were added, retired or resized, carry the positions of the rings that are still there over
+            struct ShmRingBuffer* oldSrb = srb;
+            int oldNumRings = numRings;
+            uint64_t* oldLastPos = lastPos;
+            numRings = srb_get_rings(h, &srb);
+            lastPos = malloc(sizeof(uint64_t) * numRings);
+            for (int i = 0; i < numRings; i++) {
+                lastPos[i] = __atomic_load_n(&srb[i].shared->write_ring_pos, __ATOMIC_RELAXED);
+                for (int j = 0; j < oldNumRings; j++) {
+                    if (oldSrb[j].shared == srb[i].shared) {
+                        lastPos[i] = oldLastPos[j];
+                    }
+                }
+            }
+            free(oldLastPos);
+        }
+        double curTime = getCurTime();
+        double elapsed = curTime - lastTime;
+        lastTime = curTime;
+        struct timespec wallTime;
+        clock_gettime(CLOCK_REALTIME, &wallTime);
+
+        if (!batch) {
+            printf("\033[H\033[2JSRB rings at \"%s\", every %.2fs:\n\n", shmName, delay);
+            printf("%-24s %12s %12s %12s %12s %16s\n", "RING", "MSGS/S", "MB/S", "TURNOVER S", "HEADROOM S", "PUBLISHED");
+        }
+        for (int i = 0; i < numRings; i++) {
+            struct ShmRingBufferShared* shared = srb[i].shared;
+            uint64_t pos = __atomic_load_n(&shared->write_ring_pos, __ATOMIC_RELAXED);
+            double msgsPerSec = (pos - lastPos[i]) / elapsed;
+            double mbPerSec = msgsPerSec * shared->buffer_size / 1000000.0;
+            lastPos[i] = pos;
+
+            // The ring is rewritten every num_buffers messages, and a subscriber can fall num_buffers - 1 behind
+            // before srb_subscriber_get_next_unread_buffer skips ahead
+            double turnover = (msgsPerSec > 0) ? shared->num_buffers / msgsPerSec : -1;
+            double headroom = (msgsPerSec > 0) ? (shared->num_buffers - 1) / msgsPerSec : -1;
+            uint64_t published = (pos > shared->num_buffers) ? pos - shared->num_buffers : 0;
+
+            if (batch) {
+                printf("time=%.3f shm=%s ring=%s msgs_per_sec=%.3f mb_per_sec=%.3f turnover_sec=%.6f headroom_sec=%.6f published=%" PRIu64 "\n", wallTime.tv_sec + wallTime.tv_nsec / 1000000000.0, shmName, srb[i].description, msgsPerSec, mbPerSec, turnover, headroom, published);
+            } else if (msgsPerSec > 0) {
+                printf("%-24s %12.1f %12.3f %12.4f %12.4f %16" PRIu64 "\n", srb[i].description, msgsPerSec, mbPerSec, turnover, headroom, published);
+            } else {
+                printf("%-24s %12.1f %12.3f %12s %12s %16" PRIu64 "\n", srb[i].description, msgsPerSec, mbPerSec, "-", "-", published);
+            }
+        }
+        fflush(stdout);
+    }
+
+    free(lastPos);
+    srb_close(h);
+
+    return 0;
+}
@@ -0,0 +1,135 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2025-present Edward Andrew Flick.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <shm_ringbuffers.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Stand-in for the producer's own data, which it wants to keep in cache between buffers
+#define WORKING_SET_SIZE (512 * 1024)
+// Bytes written per measurement, and the most ring memory used, so the ring never fits in cache
+#define BYTES_PER_RUN (1024ull * 1024 * 1024)
+#define RING_MEMORY (512ull * 1024 * 1024)
+
+double get_cur_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec + (double)ts.tv_nsec / 1000000000.0);
+}
+
+volatile uint64_t sink;
+
+uint64_t touch_working_set(const uint64_t* working_set)
+{
+    uint64_t sum = 0;
+    for (size_t i = 0; i < WORKING_SET_SIZE / sizeof(uint64_t); i += 8) {
+        sum += working_set[i];
+    }
+    return sum;
+}
+
+enum CopyMode {
+    COPY_MEMCPY,
+    COPY_STREAM,
+    COPY_MEMCPY_THEN_CRC, // memcpy, then a separate CRC32C pass over the buffer
+    COPY_STREAM_CRC, // srb_producer_stream_copy_checksum
+};
+
+/*
+ * Publishes BYTES_PER_RUN worth of buffer_size buffers copied from src in the given mode, touching the producer's
+ * working set between buffers.
+ *
+ * returns:
+ *   copy throughput in GB/s, and via working_set_ns the mean time to walk the working set after each copy
+ */
+double run(struct ShmRingBuffer* ring, const uint8_t* src, const uint64_t* working_set, enum CopyMode mode, double* working_set_ns)
+{
+    uint64_t size = ring->shared->buffer_size;
+    uint64_t iterations = BYTES_PER_RUN / size;
+    double copy_time = 0, touch_time = 0;
+    for (uint64_t i = 0; i < iterations; i++) {
+        uint8_t* buffer = srb_producer_next_write_buffer(ring);
+        double t0 = get_cur_time();
+        switch (mode) {
+        case COPY_MEMCPY:
+            memcpy(buffer, src, size);
+            break;
+        case COPY_STREAM:
+            srb_producer_stream_copy(buffer, src, size);
+            break;
+        case COPY_MEMCPY_THEN_CRC:
+            memcpy(buffer, src, size);
+            sink += srb_crc32c(0, buffer, size);
+            break;
+        case COPY_STREAM_CRC:
+            sink += srb_producer_stream_copy_checksum(buffer, src, size, 0);
+            break;
+        }
+        double t1 = get_cur_time();
+        sink += touch_working_set(working_set);
+        double t2 = get_cur_time();
+        copy_time += t1 - t0;
+        touch_time += t2 - t1;
+    }
+    *working_set_ns = touch_time / iterations * 1e9;
+    return (iterations * size) / copy_time / 1e9;
+}
+
+int main(void)
+{
+    uint64_t* working_set = malloc(WORKING_SET_SIZE);
+    memset(working_set, 1, WORKING_SET_SIZE);
+
+    printf("%10s %14s %14s %18s %18s %18s %18s\n", "slot size", "memcpy GB/s", "stream GB/s", "memcpy ws ns", "stream ws ns", "memcpy+crc GB/s", "stream crc GB/s");
+    for (uint64_t size = 64 * 1024; size <= 32 * 1024 * 1024; size *= 2) {
+        unsigned int num_buffers = RING_MEMORY / size;
+        struct ShmRingBufferDef srbd = { .buffer_size = size, .num_buffers = num_buffers, .description = "bench" };
+        SRBHandle h = srb_host_new("/srb_bench_stream_copy", 1, &srbd);
+        if (h == NULL) {
+            return 1;
+        }
+        struct ShmRingBuffer* ring;
+        srb_get_rings(h, &ring);
+        uint8_t* src = malloc(size);
+        memset(src, 0x5A, size);
+        for (unsigned int i = 0; i < num_buffers; i++) {
+            memset(srb_producer_next_write_buffer(ring), 0, size); // Commit the pages before timing anything
+        }
+
+        double memcpy_ws_ns, stream_ws_ns, crc_ws_ns;
+        double memcpy_rate = run(ring, src, working_set, COPY_MEMCPY, &memcpy_ws_ns);
+        double stream_rate = run(ring, src, working_set, COPY_STREAM, &stream_ws_ns);
+        double memcpy_crc_rate = run(ring, src, working_set, COPY_MEMCPY_THEN_CRC, &crc_ws_ns);
+        double stream_crc_rate = run(ring, src, working_set, COPY_STREAM_CRC, &crc_ws_ns);
+        printf("%8luKB %14.2f %14.2f %18.0f %18.0f %18.2f %18.2f\n", (unsigned long)(size / 1024), memcpy_rate, stream_rate, memcpy_ws_ns, stream_ws_ns, memcpy_crc_rate, stream_crc_rate);
+
+        free(src);
+        srb_close(h);
+    }
+    free(working_set);
+    return 0;
+}
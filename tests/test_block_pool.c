@@ -0,0 +1,114 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2025-present Edward Andrew Flick.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include "test_check.h"
+#include <shm_ringbuffers.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_BLOCKS (8)
+#define BLOCK_SIZE (8294400)
+
+int main(void)
+{
+    struct ShmRingBufferDef srbd[2] = {
+        { .buffer_size = sizeof(struct ShmBlockRef), .num_buffers = 3, .description = "stage1" },
+        { .buffer_size = sizeof(struct ShmBlockRef), .num_buffers = 3, .description = "stage2" },
+    };
+    struct ShmBlockPoolDef pool_def = { .block_size = BLOCK_SIZE, .num_blocks = NUM_BLOCKS };
+
+    SRBHandle h = srb_host_new_with_pool("/srb_test_block_pool", 2, srbd, &pool_def);
+    if (h == NULL) {
+        return 1;
+    }
+    SRBHandle c = srb_client_new("/srb_test_block_pool");
+    if (c == NULL) {
+        srb_close(h);
+        return 1;
+    }
+    struct ShmRingBuffer* stage1 = srb_get_ring_by_description(h, "stage1");
+    struct ShmRingBuffer* stage2 = srb_get_ring_by_description(h, "stage2");
+    struct ShmRingBuffer* sub1 = srb_get_ring_by_description(c, "stage1");
+    struct ShmRingBuffer* sub2 = srb_get_ring_by_description(c, "stage2");
+    check(srb_block_pool_num_free(c) == NUM_BLOCKS, "client sees the whole pool free");
+
+    // Fan one block out to both rings, then drop the producer's own reference
+    uint32_t block = srb_block_alloc(h);
+    check(block != 0, "allocate a block");
+    memset(srb_block_get(h, block), 0xAB, BLOCK_SIZE);
+    check(srb_producer_publish_block(stage1, block, BLOCK_SIZE) == 0, "publish to stage1");
+    check(srb_producer_publish_block(stage2, block, BLOCK_SIZE) == 0, "publish to stage2");
+    srb_block_release(h, block);
+    check(srb_block_pool_num_free(h) == NUM_BLOCKS - 1, "rings keep the block alive");
+
+    // Publishing a second block makes the first readable
+    uint32_t block2 = srb_block_alloc(h);
+    srb_producer_publish_block(stage1, block2, 16);
+    srb_producer_publish_block(stage2, block2, 16);
+    srb_block_release(h, block2);
+
+    uint64_t length = 0;
+    uint32_t got1 = srb_subscriber_get_next_unread_block(sub1, &length);
+    check(got1 == block, "stage1 reads the block by reference");
+    check(length == BLOCK_SIZE, "length travels with the reference");
+    check(srb_block_get(c, got1)[BLOCK_SIZE - 1] == 0xAB, "block contents are shared, not copied");
+    uint32_t got2 = srb_subscriber_get_next_unread_block(sub2, &length);
+    check(got2 == block, "stage2 reads the same block");
+
+    // Once both rings have moved on, only the readers' references keep the block out of the pool
+    for (int i = 0; i < 3; i++) {
+        uint32_t b = srb_block_alloc(h);
+        srb_producer_publish_block(stage1, b, 0);
+        srb_producer_publish_block(stage2, b, 0);
+        srb_block_release(h, b);
+    }
+    unsigned int num_free = srb_block_pool_num_free(h);
+    srb_block_release(c, got1);
+    check(srb_block_pool_num_free(h) == num_free, "still referenced by the second reader");
+    srb_block_release(c, got2);
+    check(srb_block_pool_num_free(h) == num_free + 1, "last release returns the block to the pool");
+
+    // Exhaust the pool
+    uint32_t held[NUM_BLOCKS];
+    unsigned int num_held = 0;
+    while ((num_held < NUM_BLOCKS) && (held[num_held] = srb_block_alloc(h))) {
+        num_held++;
+    }
+    check(srb_block_alloc(h) == 0, "an exhausted pool allocates nothing");
+    check(num_held == num_free + 1, "every free block can be allocated");
+    while (num_held--) {
+        srb_block_release(h, held[num_held]);
+    }
+
+    srb_close(c);
+    srb_close(h);
+
+    if (failures) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("All block pool checks passed.\n");
+    return 0;
+}
@@ -0,0 +1,137 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2025-present Edward Andrew Flick.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include "test_check.h"
+#include <shm_ringbuffers.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BUFFER_SIZE (1024 * 1024 + 64)
+
+// Bit at a time CRC32C, to check the library's kernels against
+uint32_t reference_crc32c(uint32_t crc, const uint8_t* data, uint64_t size)
+{
+    crc = ~crc;
+    for (uint64_t i = 0; i < size; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78u : crc >> 1;
+        }
+    }
+    return ~crc;
+}
+
+int main(void)
+{
+    check(srb_crc32c(0, "123456789", 9) == 0xE3069283u, "CRC32C check value");
+    check(srb_crc32c(0, "", 0) == 0, "CRC32C of nothing");
+
+    uint8_t* src = malloc(BUFFER_SIZE);
+    uint32_t seed = 12345;
+    for (int i = 0; i < BUFFER_SIZE; i++) {
+        seed = seed * 1103515245 + 12345;
+        src[i] = (uint8_t)(seed >> 16);
+    }
+
+    // Sizes either side of the 3 lane fold, and unaligned starts
+    uint64_t sizes[] = { 1, 7, 16, 100, 3 * 4096 - 1, 3 * 4096, 3 * 4096 + 5, 100000, BUFFER_SIZE - 64 };
+    uint64_t offsets[] = { 0, 1, 13, 63 };
+    int matches = 1, chained = 1;
+    for (int o = 0; o < 4; o++) {
+        for (int s = 0; s < 9; s++) {
+            uint32_t expected = reference_crc32c(0, src + offsets[o], sizes[s]);
+            matches &= srb_crc32c(0, src + offsets[o], sizes[s]) == expected;
+            uint64_t half = sizes[s] / 2;
+            chained &= srb_crc32c(srb_crc32c(0, src + offsets[o], half), src + offsets[o] + half, sizes[s] - half) == expected;
+        }
+    }
+    check(matches, "CRC32C matches reference");
+    check(chained, "CRC32C can be computed in parts");
+
+    struct ShmRingBufferDef srbd[2] = {
+        { .buffer_size = BUFFER_SIZE, .num_buffers = 4, .description = "recorded", .checksummed = 1 },
+        { .buffer_size = 64, .num_buffers = 4, .description = "plain" },
+    };
+    SRBHandle h = srb_host_new("/srb_test_checksums", 2, srbd);
+    if (h == NULL) {
+        return 1;
+    }
+    SRBHandle c = srb_client_new("/srb_test_checksums");
+    if (c == NULL) {
+        srb_close(h);
+        return 1;
+    }
+    struct ShmRingBuffer* producer_rings;
+    srb_get_rings(h, &producer_rings);
+    struct ShmRingBuffer* rings;
+    srb_get_rings(c, &rings);
+
+    // Copying with a checksum gives the same bytes and CRC as copying and checksumming separately
+    uint8_t* buffer = srb_producer_next_write_buffer(producer_rings);
+    int copies = 1, copy_crcs = 1;
+    for (int o = 0; o < 4; o++) {
+        for (int s = 0; s < 9; s++) {
+            memset(buffer, 0xEE, BUFFER_SIZE);
+            uint32_t crc = srb_producer_stream_copy_checksum(buffer + offsets[o], src, sizes[s], 0);
+            copies &= (memcmp(buffer + offsets[o], src, sizes[s]) == 0) && (buffer[offsets[o] + sizes[s]] == 0xEE);
+            copy_crcs &= crc == reference_crc32c(0, src, sizes[s]);
+        }
+    }
+    check(copies, "checksum copy matches memcpy");
+    check(copy_crcs, "checksum copy CRC matches reference");
+
+    // A buffer copied in two parts, checksummed as it is copied
+    uint32_t crc = srb_producer_stream_copy_checksum(buffer, src, 5000, 0);
+    crc = srb_producer_stream_copy_checksum(buffer + 5000, src + 5000, 20000, crc);
+    srb_producer_set_buffer_checksum(producer_rings, crc, 25000);
+    buffer = srb_producer_next_write_buffer(producer_rings);
+    uint8_t* read = srb_subscriber_get_next_unread_buffer(rings);
+    uint64_t length;
+    check(srb_subscriber_get_buffer_checksum(rings, read, &length) == reference_crc32c(0, src, 25000) && length == 25000, "published checksum");
+    check(srb_subscriber_verify_buffer(rings, read) == 1, "buffer verifies");
+    read[100] ^= 1;
+    check(srb_subscriber_verify_buffer(rings, read) == 0, "corrupted buffer fails to verify");
+    read[100] ^= 1;
+
+    // Without a checksum from the producer, the whole buffer is checksummed on publish
+    memcpy(buffer, src, BUFFER_SIZE);
+    srb_producer_next_write_buffer(producer_rings);
+    read = srb_subscriber_get_next_unread_buffer(rings);
+    check(srb_subscriber_get_buffer_checksum(rings, read, &length) == reference_crc32c(0, src, BUFFER_SIZE) && length == BUFFER_SIZE, "checksum computed on publish");
+    check(srb_subscriber_verify_buffer(rings, read) == 1, "buffer checksummed on publish verifies");
+
+    srb_producer_next_write_buffer(producer_rings + 1);
+    srb_producer_next_write_buffer(producer_rings + 1);
+    check(srb_subscriber_verify_buffer(rings + 1, srb_subscriber_get_next_unread_buffer(rings + 1)) == -1, "ring without checksums");
+
+    free(src);
+    srb_close(c);
+    srb_close(h);
+
+    if (failures == 0) {
+        printf("All checksum checks passed.\n");
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,233 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2025-present Edward Andrew Flick.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include "test_check.h"
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <shm_ringbuffers.hpp>
+#include <sys/resource.h>
+#include <thread>
+#include <unistd.h>
+
+#define NUM_RINGS (1000)
+#define NUM_PUBLISHES (20)
+#define NUM_SET_RINGS (8)
+
+double get_cpu_seconds(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0;
+}
+
+// Starts running straight away and frees itself when done
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() { }
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+// Resumes coroutines later, from whoever calls drain
+class QueueExecutor : public srb::Executor {
+public:
+    void post(std::coroutine_handle<> handle) override { queue.push_back(handle); }
+
+    unsigned int drain()
+    {
+        unsigned int num_resumed = 0;
+        while (!queue.empty()) {
+            std::coroutine_handle<> handle = queue.front();
+            queue.pop_front();
+            handle.resume();
+            num_resumed++;
+        }
+        return num_resumed;
+    }
+
+    std::deque<std::coroutine_handle<>> queue;
+};
+
+int num_done = 0;
+int num_out_of_order = 0;
+
+// Reads until the last published buffer, a new subscriber starts at the newest buffer and then reads each in turn
+Detached consume(srb::Reactor& reactor, srb::Ring ring, int expected_ring)
+{
+    int last = -1;
+    while (last < NUM_PUBLISHES - 1) {
+        uint8_t* buffer = co_await ring.next();
+        if ((buffer == nullptr) || (((int*)buffer)[0] != expected_ring) || ((last >= 0) && (((int*)buffer)[1] != last + 1))) {
+            num_out_of_order++;
+            break;
+        }
+        last = ((int*)buffer)[1];
+    }
+    if (++num_done == NUM_RINGS) {
+        reactor.stop();
+    }
+}
+
+int num_set_buffers = 0;
+int num_set_done = 0;
+
+Detached consume_set(srb::RingSet& ring_set, int expected_buffers)
+{
+    while (num_set_buffers < expected_buffers) {
+        struct ShmRingBuffer* ring_buffer = co_await ring_set.any();
+        if (ring_buffer == nullptr) {
+            break;
+        }
+        while (srb_subscriber_get_next_unread_buffer(ring_buffer)) {
+            num_set_buffers++;
+        }
+    }
+    num_set_done = 1;
+}
+
+int num_stopped = 0;
+
+Detached await_stop(srb::Ring ring)
+{
+    uint8_t* buffer = co_await ring.next();
+    if (buffer == nullptr) {
+        num_stopped++;
+    }
+}
+
+int main(void)
+{
+    static struct ShmRingBufferDef srbd[NUM_RINGS];
+    static char names[NUM_RINGS][16];
+    for (int i = 0; i < NUM_RINGS; i++) {
+        snprintf(names[i], sizeof(names[i]), "ring%d", i);
+        srbd[i] = ShmRingBufferDef {};
+        srbd[i].buffer_size = 2 * sizeof(int);
+        srbd[i].num_buffers = NUM_PUBLISHES + 2;
+        srbd[i].description = names[i];
+    }
+
+    SRBHandle h = srb_host_new("/srb_test_coroutines", NUM_RINGS, srbd);
+    if (h == NULL) {
+        return 1;
+    }
+    SRBHandle c = srb_client_new("/srb_test_coroutines");
+    if (c == NULL) {
+        srb_close(h);
+        return 1;
+    }
+    struct ShmRingBuffer* producer_rings;
+    struct ShmRingBuffer* rings;
+    srb_get_rings(h, &producer_rings);
+    srb_get_rings(c, &rings);
+
+    {
+        // Thousands of coroutines on one thread, each suspended until its own ring has something
+        srb::Reactor reactor(c);
+        for (int i = 0; i < NUM_RINGS; i++) {
+            consume(reactor, srb::Ring(reactor, rings + i), i);
+        }
+        check(reactor.num_waiting() == NUM_RINGS, "every consumer suspends on an empty ring");
+
+        // Nothing published, so the reactor thread sleeps rather than spinning
+        double cpu_before = get_cpu_seconds();
+        for (int i = 0; i < 3; i++) {
+            reactor.run_once(100);
+        }
+        double idle_cpu = get_cpu_seconds() - cpu_before;
+        check(idle_cpu < 0.1, "idle reactor does not spin");
+        check(reactor.num_waiting() == NUM_RINGS, "idle consumers stay suspended");
+
+        std::thread producer([producer_rings]() {
+            for (int i = 0; i <= NUM_PUBLISHES; i++) {
+                for (int r = 0; r < NUM_RINGS; r++) {
+                    int* buffer = (int*)srb_producer_next_write_buffer(producer_rings + r); // Publishes the last one
+                    buffer[0] = r;
+                    buffer[1] = i;
+                }
+                if ((i % 4) == 0) {
+                    usleep(1000);
+                }
+            }
+        });
+        reactor.run();
+        producer.join();
+        check(num_done == NUM_RINGS, "every consumer received all its buffers");
+        check(num_out_of_order == 0, "buffers arrive in order");
+        check(reactor.num_waiting() == 0, "no consumer left waiting");
+    }
+
+    {
+        // any() over a set, resumed through a pluggable executor
+        QueueExecutor executor;
+        srb::Reactor reactor(c, executor);
+        srb::RingSet ring_set(reactor);
+        for (int i = 0; i < NUM_SET_RINGS; i++) {
+            check(ring_set.add(rings + i), "ring added to set");
+        }
+        consume_set(ring_set, NUM_SET_RINGS);
+        check(reactor.num_waiting() == 1, "set consumer suspends when no ring has advanced");
+        for (int i = 0; i < NUM_SET_RINGS; i++) {
+            srb_producer_next_write_buffer(producer_rings + i); // Publishes one buffer in each
+        }
+        unsigned int num_resumed = 0;
+        for (int tries = 0; (tries < 100) && !num_set_done; tries++) {
+            reactor.run_once(100);
+            num_resumed += executor.drain();
+        }
+        check(num_resumed > 0, "set consumer resumed through the executor");
+        check(num_set_done, "set consumer saw every ring advance");
+        check(num_set_buffers == NUM_SET_RINGS, "set consumer read one buffer from each ring");
+    }
+
+    {
+        // Awaiting coroutines are resumed with nullptr once the host stops
+        srb::Reactor reactor(c);
+        for (int i = 0; i < 4; i++) {
+            await_stop(srb::Ring(reactor, rings + i));
+        }
+        check(reactor.num_waiting() == 4, "waiting for a buffer that never comes");
+        std::thread stopper([h]() {
+            usleep(50000);
+            srb_host_signal_stopping(h);
+        });
+        reactor.run();
+        stopper.join();
+        check(num_stopped == 4, "waiters resumed with nullptr when the host stops");
+    }
+
+    srb_close(c);
+    srb_close(h);
+
+    if (failures) {
+        fprintf(stderr, "%d coroutine checks failed.\n", failures);
+        return 1;
+    }
+    printf("All coroutine checks passed.\n");
+    return 0;
+}
@@ -0,0 +1,179 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2025-present Edward Andrew Flick.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include "test_check.h"
+#include <shm_ringbuffers.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BUFFER_SIZE (1024 * 1024 + 100)
+#define NUM_BUFFERS (8)
+
+struct ShmRingBuffer* producer;
+uint8_t* frame; // The producer's own copy of what it publishes
+uint8_t* write_buffer;
+
+// Writes the whole frame to the buffer being written and publishes it
+void publish(void)
+{
+    memcpy(write_buffer, frame, BUFFER_SIZE);
+    write_buffer = srb_producer_next_write_buffer(producer);
+}
+
+int is_tile_set(const uint64_t* dirty, uint64_t tile)
+{
+    return (dirty[tile / 64] >> (tile % 64)) & 1;
+}
+
+unsigned int count_tiles(const uint64_t* dirty, uint64_t num_tiles)
+{
+    unsigned int count = 0;
+    for (uint64_t tile = 0; tile < num_tiles; tile++) {
+        count += is_tile_set(dirty, tile);
+    }
+    return count;
+}
+
+int main(void)
+{
+    struct ShmRingBufferDef srbd[] = {
+        { .buffer_size = BUFFER_SIZE, .num_buffers = NUM_BUFFERS, .description = "frames", .dirty_tracked = 1 },
+        { .buffer_size = 4096, .num_buffers = 3, .description = "plain" },
+    };
+    SRBHandle h = srb_host_new("/srb_test_dirty_tiles", 2, srbd);
+    if (h == NULL) {
+        return 1;
+    }
+    SRBHandle c = srb_client_new("/srb_test_dirty_tiles");
+    if (c == NULL) {
+        srb_close(h);
+        return 1;
+    }
+    producer = srb_get_ring_by_description(h, "frames");
+    struct ShmRingBuffer* subscriber = srb_get_ring_by_description(c, "frames");
+    uint64_t tile_size = subscriber->shared->dirty_tile_size;
+    uint64_t num_tiles = (BUFFER_SIZE + tile_size - 1) / tile_size;
+    check((tile_size >= 64) && ((tile_size & (tile_size - 1)) == 0), "tile size is a power of two of at least 64");
+    check(num_tiles <= SRB_MAX_DIRTY_TILES, "buffer split into at most SRB_MAX_DIRTY_TILES tiles");
+
+    frame = malloc(BUFFER_SIZE);
+    uint8_t* copy = malloc(BUFFER_SIZE);
+    uint32_t seed = 777;
+    for (int i = 0; i < BUFFER_SIZE; i++) {
+        seed = seed * 1103515245 + 12345;
+        frame[i] = (uint8_t)(seed >> 16);
+    }
+    uint64_t sequence = 0;
+    check(srb_subscriber_apply_deltas(subscriber, copy, &sequence) == 0, "nothing to copy before the first buffer");
+
+    // The first buffer has nothing before it, so it is copied in full
+    write_buffer = srb_producer_next_write_buffer(producer);
+    publish();
+    check(srb_subscriber_apply_deltas(subscriber, copy, &sequence) == BUFFER_SIZE, "first buffer copied in full");
+    check(memcmp(copy, frame, BUFFER_SIZE) == 0, "first copy matches");
+    check(srb_subscriber_apply_deltas(subscriber, copy, &sequence) == 0, "up to date copy is left alone");
+
+    // Unmarked changes are found by comparing with the buffer before, down to single bytes and the short last tile
+    frame[10] ^= 1;
+    frame[5 * tile_size + 3] ^= 0x80;
+    frame[5 * tile_size + 4] ^= 0x80;
+    frame[BUFFER_SIZE - 1] ^= 0xff;
+    publish();
+    uint64_t last_tile_size = BUFFER_SIZE - (num_tiles - 1) * tile_size;
+    uint64_t tile_size_got;
+    const uint64_t* dirty = srb_subscriber_get_buffer_dirty_tiles(subscriber, srb_subscriber_get_most_recent_buffer(subscriber), &tile_size_got);
+    check(dirty && (tile_size_got == tile_size), "dirty tiles of a buffer");
+    check(dirty && is_tile_set(dirty, 0) && is_tile_set(dirty, 5) && is_tile_set(dirty, num_tiles - 1), "changed tiles found");
+    check(dirty && (count_tiles(dirty, num_tiles) == 3), "unchanged tiles left clean");
+    check(srb_subscriber_apply_deltas(subscriber, copy, &sequence) == 2 * tile_size + last_tile_size, "only changed tiles copied");
+    check(memcmp(copy, frame, BUFFER_SIZE) == 0, "copy matches after found changes");
+
+    // Marked ranges are used as they are, without comparing
+    memset(frame + 100 * tile_size + 7, 0x55, 3 * tile_size);
+    srb_producer_mark_dirty(producer, 100 * tile_size + 7, 3 * tile_size);
+    publish();
+    dirty = srb_subscriber_get_buffer_dirty_tiles(subscriber, srb_subscriber_get_most_recent_buffer(subscriber), &tile_size_got);
+    check(dirty && (count_tiles(dirty, num_tiles) == 4) && is_tile_set(dirty, 100) && is_tile_set(dirty, 103), "marked range covers its tiles");
+    check(srb_subscriber_apply_deltas(subscriber, copy, &sequence) == 4 * tile_size, "only marked tiles copied");
+    check(memcmp(copy, frame, BUFFER_SIZE) == 0, "copy matches after marked changes");
+
+    // Catching up over several buffers copies the tiles changed in any of them, once
+    uint64_t changed[] = { 200, 201, 300, 200 };
+    for (int i = 0; i < 4; i++) {
+        frame[changed[i] * tile_size] ^= 0x0f;
+        publish();
+    }
+    check(srb_subscriber_apply_deltas(subscriber, copy, &sequence) == 3 * tile_size, "union of changes copied");
+    check(memcmp(copy, frame, BUFFER_SIZE) == 0, "copy matches after catching up");
+    check(sequence == srb_subscriber_get_most_recent_buffer_id(subscriber) + NUM_BUFFERS - 1, "sequence of the most recent buffer");
+
+    // Too far behind for the dirty tiles to still be there, so the whole buffer is copied
+    for (int i = 0; i < NUM_BUFFERS; i++) {
+        frame[i] ^= 1;
+        publish();
+    }
+    check(srb_subscriber_apply_deltas(subscriber, copy, &sequence) == BUFFER_SIZE, "copied in full when too far behind");
+    check(memcmp(copy, frame, BUFFER_SIZE) == 0, "copy matches after falling behind");
+
+    // An unchanged buffer has nothing to copy, but still moves the sequence on
+    uint64_t before = sequence;
+    publish();
+    check(srb_subscriber_apply_deltas(subscriber, copy, &sequence) == 0, "unchanged buffer copies nothing");
+    check(sequence == before + 1, "sequence moves on for an unchanged buffer");
+
+    // Rings without dirty tracking are always copied in full
+    struct ShmRingBuffer* plain_producer = srb_get_ring_by_description(h, "plain");
+    struct ShmRingBuffer* plain = srb_get_ring_by_description(c, "plain");
+    uint8_t plain_copy[4096];
+    uint64_t plain_sequence = 0;
+    memset(srb_producer_next_write_buffer(plain_producer), 9, 4096);
+    memset(srb_producer_next_write_buffer(plain_producer), 9, 4096);
+    check(srb_subscriber_get_buffer_dirty_tiles(plain, srb_subscriber_get_most_recent_buffer(plain), &tile_size_got) == NULL, "no dirty tiles without tracking");
+    check(srb_subscriber_apply_deltas(plain, plain_copy, &plain_sequence) == 4096, "untracked ring copied in full");
+    srb_producer_next_write_buffer(plain_producer);
+    check(srb_subscriber_apply_deltas(plain, plain_copy, &plain_sequence) == 4096, "untracked ring copied in full every time");
+    check(plain_copy[0] == 9, "untracked copy matches");
+
+    // A resized ring keeps tracking, and its carried over buffer counts as all new
+    struct ShmRingBuffer* resized = srb_host_resize_ring(h, "frames", NUM_BUFFERS * 2);
+    check(resized && resized->dirty_tiles, "resized ring is dirty tracked");
+    srb_client_refresh(c);
+    subscriber = srb_get_ring_by_description(c, "frames");
+    sequence = 0;
+    check(srb_subscriber_apply_deltas(subscriber, copy, &sequence) == BUFFER_SIZE, "carried over buffer copied in full");
+    check(memcmp(copy, frame, BUFFER_SIZE) == 0, "resized ring carries the most recent buffer");
+
+    free(frame);
+    free(copy);
+    srb_close(c);
+    srb_close(h);
+
+    if (failures) {
+        fprintf(stderr, "%d dirty tile checks failed.\n", failures);
+        return 1;
+    }
+    printf("All dirty tile checks passed.\n");
+    return 0;
+}
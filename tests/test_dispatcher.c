@@ -0,0 +1,139 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2025-present Edward Andrew Flick.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include "test_check.h"
+#include <pthread.h>
+#include <shm_ringbuffers.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NUM_RINGS (8)
+#define NUM_WORKERS (4)
+#define NUM_PER_RING (50)
+
+struct RingStats {
+    int in_callback;
+    int last_value;
+    int count;
+    pthread_t first_thread;
+    int other_threads;
+} stats[NUM_RINGS];
+struct ShmRingBuffer* rings;
+
+void on_buffer(struct ShmRingBuffer* ring_buffer, uint8_t* buffer, __attribute((unused)) void* user_data)
+{
+    struct RingStats* rs = stats + (ring_buffer - rings);
+    check(__atomic_add_fetch(&rs->in_callback, 1, __ATOMIC_SEQ_CST) == 1, "one consumer per ring at a time");
+    int value = *(int*)buffer;
+    check(value == rs->last_value + 1, "ring order is preserved");
+    rs->last_value = value;
+    if (rs->count == 0) {
+        rs->first_thread = pthread_self();
+    } else if (!pthread_equal(rs->first_thread, pthread_self())) {
+        rs->other_threads = 1;
+    }
+    usleep(1000); // Make this a busy ring
+    __atomic_add_fetch(&rs->count, 1, __ATOMIC_SEQ_CST);
+    __atomic_sub_fetch(&rs->in_callback, 1, __ATOMIC_SEQ_CST);
+}
+
+double get_cpu_seconds(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0;
+}
+
+double get_wall_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+int main(void)
+{
+    struct ShmRingBufferDef srbd[NUM_RINGS];
+    char names[NUM_RINGS][16];
+    for (int i = 0; i < NUM_RINGS; i++) {
+        snprintf(names[i], sizeof(names[i]), "ring%d", i);
+        srbd[i] = (struct ShmRingBufferDef) { .buffer_size = sizeof(int), .num_buffers = NUM_PER_RING + 2, .description = names[i] };
+    }
+
+    SRBHandle h = srb_host_new("/srb_test_dispatcher", NUM_RINGS, srbd);
+    if (h == NULL) {
+        return 1;
+    }
+    srb_get_rings(h, &rings);
+
+    // Only rings 0 and 4, both owned by worker 0, get work, so the other workers must steal to help out
+    for (int value = 1; value <= NUM_PER_RING + 1; value++) {
+        *(int*)srb_producer_next_write_buffer(rings + 0) = value;
+        *(int*)srb_producer_next_write_buffer(rings + 4) = value;
+        if (value == 2) {
+            // A new subscriber starts at the most recent buffer, read it so the rest are read in order
+            srb_subscriber_get_next_unread_buffer(rings + 0);
+            srb_subscriber_get_next_unread_buffer(rings + 4);
+        }
+    }
+    stats[0].last_value = stats[4].last_value = 1;
+
+    struct ShmRingBufferDispatcher* dispatcher = srb_dispatcher_new(NUM_WORKERS, on_buffer, NULL);
+    for (int i = 0; i < NUM_RINGS; i++) {
+        check(srb_dispatcher_add(dispatcher, rings + i) == 0, "add ring to dispatcher");
+    }
+    check(srb_dispatcher_start(dispatcher) == 0, "start dispatcher");
+    check(srb_dispatcher_add(dispatcher, rings) == -1, "no adding rings while running");
+
+    for (int tries = 0; (tries < 500) && ((stats[0].count < NUM_PER_RING - 1) || (stats[4].count < NUM_PER_RING - 1)); tries++) {
+        usleep(10000);
+    }
+
+    // Once the host stops, idle workers sleep rather than spin, and stopping wakes them straight away
+    srb_host_signal_stopping(h);
+    double cpu_before = get_cpu_seconds();
+    usleep(200000);
+    check((get_cpu_seconds() - cpu_before) < 0.1, "idle workers do not spin after the host stops");
+    double stop_start = get_wall_seconds();
+    srb_dispatcher_stop(dispatcher);
+    check((get_wall_seconds() - stop_start) < 0.05, "stopping wakes idle workers");
+    srb_dispatcher_free(dispatcher);
+
+    check(stats[0].count == NUM_PER_RING - 1, "every buffer of ring 0 dispatched");
+    check(stats[4].count == NUM_PER_RING - 1, "every buffer of ring 4 dispatched");
+    int stolen = stats[0].other_threads || stats[4].other_threads || !pthread_equal(stats[0].first_thread, stats[4].first_thread);
+    check(stolen, "an idle worker stole a busy ring");
+    srb_close(h);
+
+    if (failures) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("All dispatcher checks passed.\n");
+    return 0;
+}
@@ -0,0 +1,139 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2025-present Edward Andrew Flick.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include "test_check.h"
+#include <pthread.h>
+#include <sched.h>
+#include <shm_ringbuffers.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_PUBLISHES (200000)
+
+int producer_done = 0;
+struct ShmRingBuffer* producer_rings;
+
+void* produce(void* arg)
+{
+    (void)arg;
+    struct ShmRingBuffer* rings[2] = { producer_rings, producer_rings + 1 };
+    uint8_t* buffers[2];
+    buffers[0] = srb_producer_next_write_buffer(rings[0]);
+    buffers[1] = srb_producer_next_write_buffer(rings[1]);
+    for (uint64_t i = 1; i <= NUM_PUBLISHES; i++) {
+        memcpy(buffers[0], &i, sizeof(i));
+        memcpy(buffers[1], &i, sizeof(i));
+        srb_producer_next_write_buffers(rings, 2, buffers);
+        if (i % 64 == 0) {
+            sched_yield(); // Publish at a less than flat out rate, so snapshots are taken throughout
+        }
+    }
+    __atomic_store_n(&producer_done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+int main(void)
+{
+    // Rings of different lengths so their write sequences differ, like a frame ring and a pose ring
+    struct ShmRingBufferDef srbd[2] = {
+        { .buffer_size = 64, .num_buffers = 32, .description = "frames" },
+        { .buffer_size = 16, .num_buffers = 5, .description = "poses" },
+    };
+
+    SRBHandle h = srb_host_new("/srb_test_epochs", 2, srbd);
+    if (h == NULL) {
+        return 1;
+    }
+    SRBHandle c = srb_client_new("/srb_test_epochs");
+    if (c == NULL) {
+        srb_close(h);
+        return 1;
+    }
+    srb_get_rings(h, &producer_rings);
+    struct ShmRingBuffer* client_rings;
+    srb_get_rings(c, &client_rings);
+    struct ShmRingBuffer* rings[2] = { client_rings, client_rings + 1 };
+    uint8_t* buffers[2];
+    uint64_t sequences[2];
+
+    // Nothing published yet
+    uint64_t epoch = srb_subscriber_get_most_recent_buffers(rings, 2, buffers, sequences);
+    check(epoch == 0, "initial epoch is 0");
+    check(buffers[0] == NULL && buffers[1] == NULL, "no buffers before first publish");
+
+    pthread_t producer;
+    pthread_create(&producer, NULL, produce, NULL);
+
+    // Every snapshot must pair slots from the same publish, whatever the producer is doing
+    uint64_t last_epoch = 0;
+    int mismatched = 0, went_back = 0, snapshots = 0, failed = 0;
+    while (!__atomic_load_n(&producer_done, __ATOMIC_ACQUIRE)) {
+        epoch = srb_subscriber_get_most_recent_buffers(rings, 2, buffers, sequences);
+        if (epoch == SRB_SNAPSHOT_FAILED) {
+            failed++;
+            continue;
+        }
+        if ((buffers[0] == NULL) != (buffers[1] == NULL)) {
+            mismatched++;
+        } else if (buffers[0] != NULL) {
+            snapshots++;
+            if (sequences[0] - (srbd[0].num_buffers - 1) != sequences[1] - (srbd[1].num_buffers - 1)) {
+                mismatched++;
+            }
+        }
+        if (epoch < last_epoch) {
+            went_back++;
+        }
+        last_epoch = epoch;
+    }
+    pthread_join(producer, NULL);
+    check(mismatched == 0, "snapshots are consistent across rings");
+    check(went_back == 0, "epochs never go backwards");
+    check(snapshots > 0, "snapshots taken while publishing");
+    check(failed == 0, "snapshots only give up on a publish that never finishes");
+
+    // Once quiet, the snapshot holds the last publish
+    epoch = srb_subscriber_get_most_recent_buffers(rings, 2, buffers, sequences);
+    check(epoch == NUM_PUBLISHES, "one epoch per publish");
+    uint64_t v0, v1;
+    memcpy(&v0, buffers[0], sizeof(v0));
+    memcpy(&v1, buffers[1], sizeof(v1));
+    check(v0 == NUM_PUBLISHES && v1 == NUM_PUBLISHES, "snapshot has the last published values");
+
+    // A producer that died part way through a publish leaves the epoch odd, readers must give up rather than spin
+    uint64_t* publish_epoch = &h->ring_buffers_head->publish_epoch;
+    __atomic_store_n(publish_epoch, 2 * NUM_PUBLISHES + 1, __ATOMIC_RELEASE);
+    check(srb_subscriber_get_most_recent_buffers(rings, 2, buffers, sequences) == SRB_SNAPSHOT_FAILED, "snapshot gives up on an unfinished publish");
+    __atomic_store_n(publish_epoch, 2 * NUM_PUBLISHES, __ATOMIC_RELEASE);
+    check(srb_subscriber_get_most_recent_buffers(rings, 2, buffers, sequences) == NUM_PUBLISHES, "snapshot works once the publish finishes");
+
+    srb_close(c);
+    srb_close(h);
+
+    if (failures == 0) {
+        printf("All epoch tests passed (%d consistent snapshots)\n", snapshots);
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,120 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2025-present Edward Andrew Flick.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include "test_check.h"
+#include <inttypes.h>
+#include <shm_ringbuffers.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 4K and 8K RGBA frames
+#define FRAME_4K (3840ull * 2160 * 4)
+#define FRAME_8K (7680ull * 4320 * 4)
+
+/*
+ * Writes a marker into the first and last bytes of every buffer of a full lap of the ring, touching only a couple
+ * of pages of each, and checks a client sees the most recent one at the same place.
+ */
+void check_ring(struct ShmRingBuffer* producer, struct ShmRingBuffer* subscriber)
+{
+    uint64_t buffer_size = producer->shared->buffer_size;
+    for (uint64_t k = 1; k <= producer->shared->num_buffers + 1; k++) {
+        uint8_t* b = srb_producer_next_write_buffer(producer);
+        memcpy(b, &k, sizeof(k));
+        b[buffer_size - 1] = (uint8_t)k;
+    }
+    uint8_t* b = srb_subscriber_get_most_recent_buffer(subscriber);
+    uint64_t k;
+    memcpy(&k, b, sizeof(k));
+    check(k == producer->shared->num_buffers, "client reads the most recent buffer");
+    check(b[buffer_size - 1] == (uint8_t)k, "last byte of the buffer lands in place");
+    check((b - subscriber->buffers) == (int64_t)(((k - 1) % producer->shared->num_buffers) * buffer_size), "slot offset is 64-bit");
+}
+
+int main(void)
+{
+    struct ShmRingBufferDef srbd[] = {
+        { .buffer_size = FRAME_4K, .num_buffers = 64, .description = "video_4k" },
+        { .buffer_size = FRAME_8K, .num_buffers = 128, .description = "video_8k" },
+        { .buffer_size = 64, .num_buffers = 5, .description = "pose" },
+    };
+    struct ShmBlockPoolDef pool_def = { .block_size = FRAME_8K, .num_blocks = 16 };
+
+    SRBHandle h = srb_host_new_with_pool("/srb_test_large_segment", 3, srbd, &pool_def);
+    if (h == NULL) {
+        return 1;
+    }
+    printf("Hosting %" PRIu64 " bytes\n", h->shm_size);
+    check(h->shm_size > (16ull << 30), "segment is larger than 16GB");
+
+    SRBHandle c = srb_client_new("/srb_test_large_segment");
+    if (c == NULL) {
+        srb_close(h);
+        return 1;
+    }
+    check(c->shm_size == h->shm_size, "client maps the whole segment");
+
+    struct ShmRingBuffer* producer_rings;
+    struct ShmRingBuffer* rings;
+    srb_get_rings(h, &producer_rings);
+    srb_get_rings(c, &rings);
+    for (int i = 0; i < 3; i++) {
+        check(rings[i].shared->buffers_offset == (uint64_t)(producer_rings[i].buffers - h->mem_map), "buffers offset recorded in the segment");
+        check((rings[i].buffers - c->mem_map) == (producer_rings[i].buffers - h->mem_map), "client finds the same buffers");
+        check(rings[i].shared->buffer_size == srbd[i].buffer_size, "buffer size survives");
+        check_ring(producer_rings + i, rings + i);
+    }
+    check(rings[2].shared->buffers_offset > (16ull << 30), "a ring starts beyond 16GB");
+
+    uint32_t block = srb_block_alloc(h);
+    uint8_t* data = srb_block_get(c, block);
+    check((uint64_t)(data - c->mem_map) + FRAME_8K <= c->shm_size, "block fits in the segment");
+    data[FRAME_8K - 1] = 0x5A;
+    check(srb_block_get(h, block)[FRAME_8K - 1] == 0x5A, "block shared between host and client");
+    srb_block_release(h, block);
+
+    // The write sequence is 64-bit and keeps counting past where a 32-bit one would wrap
+    struct ShmRingBuffer* pose = producer_rings + 2;
+    pose->shared->write_ring_pos = UINT32_MAX - 2;
+    *(uint64_t*)srb_producer_next_write_buffer(pose) = 0;
+    srb_subscriber_get_next_unread_buffer(rings + 2); // Start reading from here
+    for (uint64_t k = 1; k <= 4; k++) {
+        *(uint64_t*)srb_producer_next_write_buffer(pose) = k;
+        uint64_t* got = (uint64_t*)srb_subscriber_get_next_unread_buffer(rings + 2);
+        check(got && (*got == k - 1), "reads in order across the 32-bit boundary");
+    }
+    check(pose->shared->write_ring_pos > UINT32_MAX, "write_ring_pos went past 32 bits");
+    check(srb_subscriber_get_most_recent_buffer_id(rings + 2) == pose->shared->write_ring_pos - pose->shared->num_buffers, "buffer ids are 64-bit");
+
+    srb_close(c);
+    srb_close(h);
+
+    if (failures) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("All large segment checks passed.\n");
+    return 0;
+}
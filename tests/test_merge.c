@@ -0,0 +1,197 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2025-present Edward Andrew Flick.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include "test_check.h"
+#include <inttypes.h>
+#include <shm_ringbuffers.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NUM_SMALL_RINGS (3)
+#define NUM_BENCH_RINGS (8)
+#define NUM_RINGS (NUM_SMALL_RINGS + NUM_BENCH_RINGS) // Then one ring without timestamps
+#define NUM_BUFFERS (16)
+#define BENCH_BUFFERS (1024)
+#define BENCH_ROUNDS (50)
+
+uint64_t get_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// The buffer each producer ring is writing, published by the next call
+uint8_t* writing[NUM_RINGS + 1];
+
+void publish(struct ShmRingBuffer* producer_rings, unsigned int ring, uint64_t timestamp)
+{
+    memcpy(writing[ring], &timestamp, sizeof(timestamp));
+    srb_producer_set_buffer_timestamp(producer_rings + ring, timestamp);
+    writing[ring] = srb_producer_next_write_buffer(producer_rings + ring);
+}
+
+uint64_t payload_key(struct ShmRingBuffer* ring_buffer, uint8_t* buffer, void* user_data)
+{
+    (void)ring_buffer;
+    uint64_t key;
+    memcpy(&key, buffer, sizeof(key));
+    return key + *(uint64_t*)user_data;
+}
+
+int main(void)
+{
+    struct ShmRingBufferDef srbd[NUM_RINGS + 1];
+    char names[NUM_RINGS + 1][16];
+    for (int i = 0; i <= NUM_RINGS; i++) {
+        snprintf(names[i], sizeof(names[i]), "producer%d", i);
+        srbd[i] = (struct ShmRingBufferDef) { .buffer_size = sizeof(uint64_t), .num_buffers = (i < NUM_SMALL_RINGS) ? NUM_BUFFERS : BENCH_BUFFERS, .description = names[i], .timestamped = (i < NUM_RINGS) };
+    }
+    SRBHandle h = srb_host_new("/srb_test_merge", NUM_RINGS + 1, srbd);
+    if (h == NULL) {
+        return 1;
+    }
+    SRBHandle c = srb_client_new("/srb_test_merge");
+    if (c == NULL) {
+        srb_close(h);
+        return 1;
+    }
+    struct ShmRingBuffer* producer_rings;
+    srb_get_rings(h, &producer_rings);
+    struct ShmRingBuffer* rings;
+    srb_get_rings(c, &rings);
+    for (int i = 0; i <= NUM_RINGS; i++) {
+        writing[i] = srb_producer_next_write_buffer(producer_rings + i);
+    }
+
+    struct ShmRingBufferMerge* merge = srb_merge_new(NULL, NULL);
+    check(srb_merge_add(merge, rings + NUM_RINGS) == -1, "ordering by timestamp needs timestamped rings");
+    for (int i = 0; i < NUM_SMALL_RINGS; i++) {
+        check(srb_merge_add(merge, rings + i) == 0, "add a ring");
+    }
+    check(srb_merge_next(merge, 0, NULL, NULL) == NULL, "nothing to merge yet");
+
+    // Each ring publishes its own share of the timestamps, in bursts
+    for (uint64_t i = 0; i < 10; i++) {
+        publish(producer_rings, 0, 3 * i);
+    }
+    for (uint64_t i = 0; i < 10; i++) {
+        publish(producer_rings, 2, 3 * i + 2);
+        publish(producer_rings, 1, 3 * i + 1);
+    }
+    uint64_t expected = 0;
+    int in_order = 1, keys_match = 1, rings_match = 1;
+    uint8_t* buffer;
+    struct ShmRingBuffer* from;
+    uint64_t key;
+    while ((buffer = srb_merge_next(merge, 0, &from, &key))) {
+        uint64_t value;
+        memcpy(&value, buffer, sizeof(value));
+        in_order &= value == expected;
+        keys_match &= key == value;
+        rings_match &= from == rings + (value % 3);
+        expected++;
+    }
+    check(expected == 30, "every buffer merged");
+    check(in_order, "buffers merged in timestamp order");
+    check(keys_match, "keys are the buffer timestamps");
+    check(rings_match, "each buffer comes with its ring");
+    check(srb_merge_get_num_lost(merge, NULL) == 0, "nothing lost");
+
+    // Requiring every ring waits for the ring that has not published
+    publish(producer_rings, 0, 100);
+    publish(producer_rings, 0, 101);
+    check(srb_merge_next(merge, 1, NULL, NULL) == NULL, "no buffer while a ring has nothing unread");
+    publish(producer_rings, 1, 50);
+    publish(producer_rings, 2, 200);
+    check(srb_merge_next(merge, 1, NULL, &key) && (key == 50), "the late ring's earlier buffer comes first");
+    check(srb_merge_next(merge, 1, NULL, NULL) == NULL, "no buffer once that ring is read");
+    check(srb_merge_next(merge, 0, NULL, &key) && (key == 100), "without requiring all rings the rest are merged");
+
+    // A ring lapped by its producer reports what it lost, and the rest still comes in order
+    for (uint64_t i = 0; i < 40; i++) {
+        publish(producer_rings, 2, 201 + i);
+    }
+    int num_from_lapped = 0;
+    uint64_t last_key = 0;
+    in_order = 1;
+    while ((buffer = srb_merge_next(merge, 0, &from, &key))) {
+        in_order &= key > last_key;
+        last_key = key;
+        num_from_lapped += from == rings + 2;
+    }
+    check(in_order, "still in order after a loss");
+    check(srb_merge_get_num_lost(merge, rings + 2) > 0, "loss reported for the lapped ring");
+    check(srb_merge_get_num_lost(merge, rings) == 0, "no loss reported for other rings");
+    check(num_from_lapped + srb_merge_get_num_lost(merge, NULL) == 41, "every buffer of the lapped ring merged or counted as lost");
+    srb_merge_free(merge);
+
+    // Keys from the payload, for rings without timestamps
+    uint64_t offset = 1000;
+    merge = srb_merge_new(payload_key, &offset);
+    check(srb_merge_add(merge, rings + NUM_RINGS) == 0, "custom keys need no timestamps");
+    publish(producer_rings, NUM_RINGS, 7);
+    check(srb_merge_next(merge, 0, NULL, &key) && (key == 1007), "key from the payload");
+    srb_merge_free(merge);
+
+    // Time merging 8 rings of interleaved timestamps
+    merge = srb_merge_new(NULL, NULL);
+    for (int i = NUM_SMALL_RINGS; i < NUM_RINGS; i++) {
+        srb_merge_add(merge, rings + i);
+    }
+    uint64_t timestamp = 0;
+    uint64_t merge_ns = 0;
+    uint64_t num_merged = 0;
+    in_order = 1;
+    last_key = 0;
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        for (int i = 0; i < BENCH_BUFFERS - 2; i++) {
+            publish(producer_rings, NUM_SMALL_RINGS + (rand() % NUM_BENCH_RINGS), ++timestamp);
+        }
+        uint64_t start = get_ns();
+        while ((buffer = srb_merge_next(merge, 0, NULL, &key))) {
+            in_order &= key > last_key;
+            last_key = key;
+            num_merged++;
+        }
+        merge_ns += get_ns() - start;
+    }
+    check(in_order, "large merge in order");
+    check(num_merged == timestamp, "large merge complete");
+    check(srb_merge_get_num_lost(merge, NULL) == 0, "large merge lost nothing");
+    printf("Merged %" PRIu64 " buffers from %d rings at %.1f ns each.\n", num_merged, NUM_BENCH_RINGS, (double)merge_ns / num_merged);
+    srb_merge_free(merge);
+
+    srb_close(c);
+    srb_close(h);
+
+    if (failures) {
+        fprintf(stderr, "%d merge checks failed.\n", failures);
+        return 1;
+    }
+    printf("All merge checks passed.\n");
+    return 0;
+}
@@ -0,0 +1,171 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2025-present Edward Andrew Flick.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include "test_check.h"
+#include <inttypes.h>
+#include <pthread.h>
+#include <shm_ringbuffers.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+int stop_producing = 0;
+uint64_t num_produced = 0;
+struct ShmRingBuffer* steady;
+
+uint64_t read_value(uint8_t* buffer)
+{
+    uint64_t value = 0;
+    if (buffer) {
+        memcpy(&value, buffer, sizeof(value));
+    }
+    return value;
+}
+
+void write_value(struct ShmRingBuffer* ring, uint64_t value)
+{
+    uint8_t* buffer = srb_producer_next_write_buffer(ring);
+    memcpy(buffer, &value, sizeof(value));
+}
+
+void* produce(void* arg)
+{
+    (void)arg;
+    srb_producer_next_write_buffer(steady);
+    while (!__atomic_load_n(&stop_producing, __ATOMIC_ACQUIRE)) {
+        uint64_t n = __atomic_add_fetch(&num_produced, 1, __ATOMIC_RELEASE);
+        write_value(steady, n); // Publishes n - 1
+    }
+    return NULL;
+}
+
+int main(void)
+{
+    struct ShmRingBufferDef srbd[2] = {
+        { .buffer_size = sizeof(uint64_t), .num_buffers = 4, .description = "steady" },
+        { .buffer_size = sizeof(uint64_t), .num_buffers = 3, .description = "sensor" },
+    };
+
+    SRBHandle h = srb_host_new("/srb_test_online_rings", 2, srbd);
+    if (h == NULL) {
+        return 1;
+    }
+    SRBHandle c = srb_client_new("/srb_test_online_rings");
+    if (c == NULL) {
+        srb_close(h);
+        return 1;
+    }
+    struct ShmRingBuffer* host_rings;
+    srb_get_rings(h, &host_rings);
+    steady = host_rings;
+    struct ShmRingBuffer* host_sensor = host_rings + 1;
+    struct ShmRingBuffer* client_rings;
+    check(srb_get_rings(c, &client_rings) == 2, "client starts with 2 rings");
+    struct ShmRingBuffer* client_steady = client_rings;
+    struct ShmRingBuffer* client_sensor = client_rings + 1;
+    check(srb_client_refresh(c) == 0, "refresh without changes");
+
+    write_value(host_sensor, 41);
+    write_value(host_sensor, 42);
+    write_value(host_sensor, 0); // Publishes 42
+
+    pthread_t producer;
+    pthread_create(&producer, NULL, produce, NULL);
+    while (srb_subscriber_get_most_recent_buffer(client_steady) == NULL) {
+        usleep(1000);
+    }
+
+    // Add a ring while the steady ring is being written flat out
+    struct ShmRingBufferDef new_def = { .buffer_size = 16, .num_buffers = 5, .description = "new", .multiplexed = 1 };
+    uint64_t headroom = srb_host_get_growth_headroom(h);
+    struct ShmRingBuffer* host_new = srb_host_add_ring(h, &new_def);
+    check(host_new != NULL, "add ring");
+    check((headroom > 0) && (srb_host_get_growth_headroom(h) < headroom), "adding a ring uses up growth");
+    struct ShmRingBuffer* rings;
+    check(srb_get_rings(h, &rings) == 3, "host sees added ring");
+    check(srb_client_refresh(c) == 1, "refresh picks up added ring");
+    check(srb_client_refresh(c) == 0, "second refresh has nothing to do");
+    check(srb_get_rings(c, &rings) == 3, "client sees added ring");
+    check(rings[0].shared == client_steady->shared, "unaffected ring keeps its place");
+    struct ShmRingBuffer* client_new = srb_get_ring_by_description(c, "new");
+    check(client_new != NULL && client_new->topic_ids != NULL, "added ring found by description");
+    if (host_new && client_new) {
+        srb_producer_next_write_topic_buffer(host_new, 7);
+        srb_producer_next_write_topic_buffer(host_new, 8);
+        uint8_t* buffer = srb_subscriber_get_next_unread_buffer(client_new);
+        check(buffer != NULL && srb_subscriber_get_buffer_topic(client_new, buffer) == 7, "added ring carries data");
+    }
+
+    // Resize the sensor ring, keeping its most recent buffer
+    uint64_t produced_before = __atomic_load_n(&num_produced, __ATOMIC_ACQUIRE);
+    struct ShmRingBuffer* host_sensor8 = srb_host_resize_ring(h, "sensor", 8);
+    check(host_sensor8 != NULL && host_sensor8->shared->num_buffers == 8, "resize ring");
+    check(srb_ring_is_retired(client_sensor), "old ring is retired");
+    check(!srb_ring_is_retired(client_steady), "unaffected ring is not retired");
+    check(srb_client_refresh(c) == 1, "refresh picks up resized ring");
+    srb_get_rings(c, &rings);
+    check(rings[1].shared->num_buffers == 8 && strcmp(rings[1].description, "sensor") == 0, "resized ring keeps its place");
+    check(read_value(srb_subscriber_get_most_recent_buffer(rings + 1)) == 42, "resized ring keeps most recent buffer");
+
+    // Retire the added ring
+    check(srb_host_retire_ring(h, "new") == 0, "retire ring");
+    check(srb_host_retire_ring(h, "new") == -1, "retire unknown ring");
+    check(srb_client_refresh(c) == 1, "refresh picks up retired ring");
+    check(srb_get_rings(c, &rings) == 2, "retired ring is gone");
+    check(srb_get_ring_by_description(c, "new") == NULL, "retired ring not found by description");
+
+    // A new client sees the segment as it is now
+    SRBHandle c2 = srb_client_new("/srb_test_online_rings");
+    check(c2 != NULL, "new client after changes");
+    if (c2) {
+        struct ShmRingBuffer* rings2;
+        check(srb_get_rings(c2, &rings2) == 2, "new client sees 2 rings");
+        struct ShmRingBuffer* sensor2 = srb_get_ring_by_description(c2, "sensor");
+        check(sensor2 && sensor2->shared->num_buffers == 8, "new client sees resized ring");
+        check(sensor2 && read_value(srb_subscriber_get_most_recent_buffer(sensor2)) == 42, "new client reads resized ring");
+        srb_close(c2);
+    }
+
+    // The steady ring never stopped, and the pointer from before the changes still reads it
+    usleep(10000);
+    __atomic_store_n(&stop_producing, 1, __ATOMIC_RELEASE);
+    pthread_join(producer, NULL);
+    check(num_produced > produced_before, "steady ring kept being written");
+    check(read_value(srb_subscriber_get_most_recent_buffer(client_steady)) == num_produced - 1, "old ring pointer still reads");
+    check(client_steady->shared == rings[0].shared, "old and refreshed pointers share the ring");
+
+    // Retired rings are reclaimed like any other idle ring
+    srb_host_reclaim_idle_rings(h, 0); // Notices the last writes
+    srb_host_reclaim_idle_rings(h, 0);
+    check(client_sensor->shared->reclaim_state == SRB_RING_RECLAIMED, "retired ring reclaimed");
+
+    srb_close(c);
+    srb_close(h);
+
+    if (failures == 0) {
+        printf("All online ring tests passed (%" PRIu64 " buffers written during changes)\n", num_produced);
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,217 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2025-present Edward Andrew Flick.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include "test_check.h"
+#include <pthread.h>
+#include <shm_ringbuffers.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BUFFER_SIZE (4096)
+#define NUM_BUFFERS (8)
+#define RING_FILE "/tmp/srb_test_persist.ring"
+#define ADDED_RING_FILE "/tmp/srb_test_persist_added.ring"
+
+int next_value = 0;
+int producer_done = 0;
+
+void publish(struct ShmRingBuffer* ring, int count)
+{
+    // The buffer written last is only complete once the next one is started
+    for (int i = 0; i < count; i++) {
+        int* buffer = (int*)srb_producer_next_write_buffer(ring);
+        for (int j = 0; j < BUFFER_SIZE / (int)sizeof(int); j++) {
+            buffer[j] = next_value;
+        }
+        next_value++;
+    }
+}
+
+/*
+ * Opens a ring file offline and reads all its buffers, checking each is whole and in order.
+ *
+ * returns:
+ *   the number of buffers read, with the first and last values and the file's state, or -1 if it did not open
+ */
+int read_file(const char* path, int* first, int* last, enum EShmRingBuffersState* state)
+{
+    SRBHandle f = srb_client_open_file(path);
+    if (f == NULL) {
+        return -1;
+    }
+    struct ShmRingBuffer* rings;
+    check(srb_get_rings(f, &rings) == 1, "a ring file holds one ring");
+    *state = srb_client_get_state(f);
+    int count = 0;
+    uint64_t last_timestamp = 0;
+    int* buffer;
+    while ((buffer = (int*)srb_subscriber_get_next_unread_buffer(rings))) {
+        int whole = 1;
+        for (int j = 1; j < BUFFER_SIZE / (int)sizeof(int); j++) {
+            whole &= buffer[j] == buffer[0];
+        }
+        check(whole, "flushed buffer is whole");
+        check(srb_subscriber_verify_buffer(rings, (uint8_t*)buffer) == 1, "flushed buffer matches its checksum");
+        uint64_t timestamp = srb_subscriber_get_buffer_timestamp(rings, (uint8_t*)buffer);
+        check(timestamp && (timestamp >= last_timestamp), "flushed timestamps in order");
+        last_timestamp = timestamp;
+        if (count == 0) {
+            *first = buffer[0];
+        } else {
+            check(buffer[0] == *last + 1, "flushed buffers read in order");
+        }
+        *last = buffer[0];
+        count++;
+    }
+    srb_close(f);
+    return count;
+}
+
+void* produce(void* arg)
+{
+    // Flat out, so the producer laps the flusher while buffers are being copied
+    struct ShmRingBuffer* ring = (struct ShmRingBuffer*)arg;
+    while (!__atomic_load_n(&producer_done, __ATOMIC_ACQUIRE)) {
+        publish(ring, 1);
+    }
+    return NULL;
+}
+
+int main(void)
+{
+    unlink(RING_FILE);
+    unlink(RING_FILE ".prev");
+    unlink(ADDED_RING_FILE);
+    unlink(ADDED_RING_FILE ".prev");
+
+    struct ShmRingBufferDef srbd[2] = {
+        { .buffer_size = BUFFER_SIZE, .num_buffers = NUM_BUFFERS, .description = "plain" },
+        { .buffer_size = BUFFER_SIZE, .num_buffers = NUM_BUFFERS, .description = "blackbox", .timestamped = 1, .checksummed = 1, .persist_path = RING_FILE },
+    };
+    SRBHandle h = srb_host_new("/srb_test_persist", 2, srbd);
+    if (h == NULL) {
+        return 1;
+    }
+    SRBHandle c = srb_client_new("/srb_test_persist");
+    if (c == NULL) {
+        srb_close(h);
+        return 1;
+    }
+    struct ShmRingBuffer* producer = srb_get_ring_by_description(h, "blackbox");
+    struct ShmRingBuffer* subscriber = srb_get_ring_by_description(c, "blackbox");
+    check(producer && subscriber, "persisted ring is in the segment");
+    check(access(RING_FILE, F_OK) == 0, "persisted ring's file is created");
+    check((producer->buffers >= h->mem_map) && (producer->buffers < h->mem_map + h->shm_size), "persisted ring's live buffers are in the segment");
+
+    // Live clients read a persisted ring like any other
+    publish(producer, 4);
+    int* buffer = (int*)srb_subscriber_get_most_recent_buffer(subscriber);
+    check(buffer && (buffer[0] == 2), "client reads persisted ring live");
+
+    int first = -1;
+    int last = -1;
+    enum EShmRingBuffersState state;
+    check(read_file(RING_FILE, &first, &last, &state) == 0, "unflushed buffers are not in the file");
+
+    check(srb_host_flush_rings(h) == 0, "flush succeeds");
+    check(read_file(RING_FILE, &first, &last, &state) == 3, "flushed buffers are in the file");
+    check((first == 0) && (last == 2), "file holds the flushed buffers");
+    check(state == SRB_RUNNING, "file of a live host is running");
+
+    // Once the ring wraps, the file holds its most recent buffers
+    publish(producer, 3 * NUM_BUFFERS);
+    check(srb_host_flush_rings(h) == 0, "flush after wrapping succeeds");
+    check(read_file(RING_FILE, &first, &last, &state) == NUM_BUFFERS - 1, "file holds a whole ring of buffers");
+    check(last == next_value - 2, "file holds the latest complete buffer");
+
+    // Only flushes write the file, so buffers published since never reach it, however long they wait
+    int flushed_first = first;
+    int flushed_last = last;
+    publish(producer, NUM_BUFFERS - 1);
+    check((read_file(RING_FILE, &first, &last, &state) == NUM_BUFFERS - 1) && (first == flushed_first) && (last == flushed_last), "unflushed buffers never reach the file");
+
+    // A flusher thread keeps the file current
+    struct ShmRingBufferFlusher* flusher = srb_flusher_new(h, 10);
+    check(flusher != NULL, "flusher starts");
+    publish(producer, 2);
+    usleep(200000);
+    check((read_file(RING_FILE, &first, &last, &state) == NUM_BUFFERS - 1) && (last == next_value - 2), "flusher writes new buffers");
+
+    // Rings added later can be persisted too, but not resized
+    struct ShmRingBufferDef added_def = { .buffer_size = BUFFER_SIZE, .num_buffers = NUM_BUFFERS, .description = "added", .checksummed = 1, .timestamped = 1, .persist_path = ADDED_RING_FILE };
+    struct ShmRingBuffer* added = srb_host_add_ring(h, &added_def);
+    check(added != NULL, "persisted ring added");
+    check(srb_client_refresh(c) >= 0, "client refreshes");
+    struct ShmRingBuffer* added_subscriber = srb_get_ring_by_description(c, "added");
+    check(added_subscriber != NULL, "client sees added persisted ring");
+    check(srb_host_resize_ring(h, "blackbox", 2 * NUM_BUFFERS) == NULL, "persisted ring is not resized");
+    int last_written = next_value - 1; // Still being written, complete once the ring is next published
+    int added_first = next_value;
+    publish(added, 3);
+    buffer = added_subscriber ? (int*)srb_subscriber_get_next_unread_buffer(added_subscriber) : NULL;
+    check(buffer && (buffer[0] == added_first + 1), "client reads added persisted ring");
+    srb_flusher_free(flusher); // Flushes once more as it stops
+    check((read_file(ADDED_RING_FILE, &first, &last, &state) == 2) && (first == added_first) && (last == added_first + 1), "added ring's file is flushed");
+
+    publish(producer, 1);
+    srb_close(c);
+    srb_close(h);
+    check((read_file(RING_FILE, &first, &last, &state) == NUM_BUFFERS - 1) && (last == last_written), "closing flushes the file");
+    check(state == SRB_STOPPED, "file of a closed host is stopped");
+
+    // A new host keeps the previous file aside
+    h = srb_host_new("/srb_test_persist", 2, srbd);
+    check(h != NULL, "host starts again");
+    if (h) {
+        check(read_file(RING_FILE, &first, &last, &state) == 0, "new file starts empty");
+        check((read_file(RING_FILE ".prev", &first, &last, &state) == NUM_BUFFERS - 1) && (last == last_written), "previous file is kept");
+
+        // A producer lapping the flusher never leaves a torn buffer in the file, read_file checks each is whole
+        struct ShmRingBuffer* lapping = srb_get_ring_by_description(h, "blackbox");
+        pthread_t thread;
+        pthread_create(&thread, NULL, produce, lapping);
+        for (int flushes = 0; flushes < 200; flushes++) {
+            check(srb_host_flush_rings(h) == 0, "flush while producing succeeds");
+            check(read_file(RING_FILE, &first, &last, &state) <= NUM_BUFFERS - 1, "file flushed while producing reads back");
+        }
+        __atomic_store_n(&producer_done, 1, __ATOMIC_RELEASE);
+        pthread_join(thread, NULL);
+        srb_close(h);
+    }
+    check(srb_client_open_file("/srb_test_persist_missing.ring") == NULL, "missing file does not open");
+
+    unlink(RING_FILE);
+    unlink(RING_FILE ".prev");
+    unlink(ADDED_RING_FILE);
+    unlink(ADDED_RING_FILE ".prev");
+
+    if (failures) {
+        fprintf(stderr, "%d persist checks failed.\n", failures);
+        return 1;
+    }
+    printf("All persist checks passed.\n");
+    return 0;
+}
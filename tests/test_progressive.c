@@ -0,0 +1,134 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2025-present Edward Andrew Flick.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include "test_check.h"
+#include <pthread.h>
+#include <sched.h>
+#include <shm_ringbuffers.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define FRAME_SIZE (8 * 1024 * 1024)
+#define NUM_CHUNKS (16)
+#define CHUNK_SIZE (FRAME_SIZE / NUM_CHUNKS)
+#define NUM_FRAMES (5)
+
+struct ShmRingBuffer* producer_ring;
+
+void* produce(void* arg)
+{
+    (void)arg;
+    for (int frame = 1; frame <= NUM_FRAMES; frame++) {
+        uint8_t* buffer = srb_producer_next_write_buffer(producer_ring);
+        for (int chunk = 0; chunk < NUM_CHUNKS; chunk++) {
+            memset(buffer + chunk * CHUNK_SIZE, frame * NUM_CHUNKS + chunk, CHUNK_SIZE);
+            srb_producer_set_write_progress(producer_ring, (uint64_t)(chunk + 1) * CHUNK_SIZE);
+            usleep(2000); // Rendering the next rows
+        }
+    }
+    srb_producer_next_write_buffer(producer_ring); // Publishes the last frame
+    return NULL;
+}
+
+int main(void)
+{
+    struct ShmRingBufferDef srbd = { .buffer_size = FRAME_SIZE, .num_buffers = 4, .description = "video" };
+
+    SRBHandle h = srb_host_new("/srb_test_progressive", 1, &srbd);
+    if (h == NULL) {
+        return 1;
+    }
+    SRBHandle c = srb_client_new("/srb_test_progressive");
+    if (c == NULL) {
+        srb_close(h);
+        return 1;
+    }
+    srb_get_rings(h, &producer_ring);
+    struct ShmRingBuffer* ring;
+    srb_get_rings(c, &ring);
+    uint64_t sequence;
+
+    check(srb_subscriber_get_next_partial_buffer(ring, &sequence) == NULL, "no partial buffer before producer starts");
+
+    pthread_t producer;
+    pthread_create(&producer, NULL, produce, NULL);
+
+    // Process each frame a chunk at a time, as the producer completes them
+    int frames = 0, early_chunks = 0, bad_chunks = 0;
+    while (frames < NUM_FRAMES) {
+        uint8_t* buffer = srb_subscriber_get_next_partial_buffer(ring, &sequence);
+        if (buffer == NULL) {
+            sched_yield();
+            continue;
+        }
+        int frame = frames + 1;
+        uint64_t processed = 0;
+        while (processed < FRAME_SIZE) {
+            uint64_t completed = srb_subscriber_get_buffer_progress(ring, sequence);
+            if (completed == processed) {
+                sched_yield();
+                continue;
+            }
+            if (completed < FRAME_SIZE) {
+                early_chunks++; // Processed while the frame was still being written
+            }
+            for (; processed < completed; processed += CHUNK_SIZE) {
+                uint8_t expected = frame * NUM_CHUNKS + processed / CHUNK_SIZE;
+                if ((buffer[processed] != expected) || (buffer[processed + CHUNK_SIZE - 1] != expected)) {
+                    bad_chunks++;
+                }
+            }
+        }
+        frames++;
+    }
+    pthread_join(producer, NULL);
+
+    check(bad_chunks == 0, "completed chunks hold the producer's data");
+    check(early_chunks > NUM_FRAMES, "chunks processed before their frame was published");
+    check(srb_subscriber_get_next_unread_buffer(ring) == NULL, "partially read frames are not read again");
+    check(srb_subscriber_get_buffer_progress(ring, sequence) == FRAME_SIZE, "published frames are complete");
+
+    // A subscriber that is behind gets the frames published since it last read first, then the one being written
+    uint64_t behind = producer_ring->shared->write_ring_pos; // Started by the producer's last publish, not read yet
+    uint8_t* next = srb_producer_next_write_buffer(producer_ring);
+    srb_producer_next_write_buffer(producer_ring);
+    srb_producer_set_write_progress(producer_ring, CHUNK_SIZE);
+    uint8_t* buffer = srb_subscriber_get_next_partial_buffer(ring, &sequence);
+    check(buffer && (sequence == behind) && (srb_subscriber_get_buffer_progress(ring, sequence) == FRAME_SIZE), "unread published frame comes first");
+    buffer = srb_subscriber_get_next_partial_buffer(ring, &sequence);
+    check((buffer == ring->buffers + (next - producer_ring->buffers)) && (sequence == behind + 1), "published frames are not skipped");
+    buffer = srb_subscriber_get_next_partial_buffer(ring, &sequence);
+    check(buffer && (sequence == behind + 2) && (srb_subscriber_get_buffer_progress(ring, sequence) == CHUNK_SIZE), "frame being written comes once caught up");
+    check(srb_subscriber_get_next_partial_buffer(ring, &sequence) == NULL, "frame being written is read once");
+
+    srb_close(c);
+    srb_close(h);
+
+    if (failures == 0) {
+        printf("All progressive publishing checks passed (%d chunks processed early).\n", early_chunks);
+    }
+    return failures == 0 ? 0 : 1;
+}
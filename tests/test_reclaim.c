@@ -0,0 +1,121 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2025-present Edward Andrew Flick.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include "test_check.h"
+#include <shm_ringbuffers.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BUFFER_SIZE (65536)
+#define NUM_BUFFERS (16)
+
+int next_value = 0;
+
+void publish(struct ShmRingBuffer* ring, int count)
+{
+    // The buffer written last is only complete once the next one is started
+    for (int i = 0; i < count; i++) {
+        int* buffer = (int*)srb_producer_next_write_buffer(ring);
+        for (int j = 0; j < BUFFER_SIZE / (int)sizeof(int); j++) {
+            buffer[j] = next_value;
+        }
+        next_value++;
+    }
+}
+
+/*
+ * returns:
+ *   the value a buffer was filled with, or -1 if it is not whole or does not match its checksum
+ */
+int read_value(struct ShmRingBuffer* ring, int* buffer)
+{
+    for (int j = 1; j < BUFFER_SIZE / (int)sizeof(int); j++) {
+        if (buffer[j] != buffer[0]) {
+            return -1;
+        }
+    }
+    return (srb_subscriber_verify_buffer(ring, (uint8_t*)buffer) == 1) ? buffer[0] : -1;
+}
+
+int main(void)
+{
+    struct ShmRingBufferDef srbd = { .buffer_size = BUFFER_SIZE, .num_buffers = NUM_BUFFERS, .description = "frames", .timestamped = 1, .checksummed = 1 };
+    SRBHandle h = srb_host_new("/srb_test_reclaim", 1, &srbd);
+    if (h == NULL) {
+        return 1;
+    }
+    SRBHandle c = srb_client_new("/srb_test_reclaim");
+    if (c == NULL) {
+        srb_close(h);
+        return 1;
+    }
+    struct ShmRingBuffer* producer = srb_get_ring_by_description(h, "frames");
+    struct ShmRingBuffer* subscriber = srb_get_ring_by_description(c, "frames");
+
+    // A subscriber reads one buffer, and then falls behind
+    publish(producer, 3);
+    int* buffer = (int*)srb_subscriber_get_next_unread_buffer(subscriber);
+    check(buffer && (read_value(subscriber, buffer) == 1), "subscriber reads before falling behind");
+    publish(producer, 10);
+    int newest = next_value - 2;
+    uint64_t resident = srb_get_ring_resident_size(producer);
+    check(resident >= (uint64_t)(next_value * BUFFER_SIZE), "written slots are resident");
+
+    // The ring goes idle and all but the slot being written and the most recent slot are released
+    check(srb_host_reclaim_idle_rings(h, 0) == 0, "first pass only notices the writes");
+    check(srb_host_reclaim_idle_rings(h, 0) == 1, "idle ring released");
+    check(producer->shared->reclaim_state == SRB_RING_RECLAIMED, "ring marked reclaimed");
+    uint64_t released = srb_get_ring_resident_size(producer);
+    check(released <= 2 * BUFFER_SIZE, "only two slots stay resident");
+    check(srb_host_reclaim_idle_rings(h, 0) == 0, "released ring is not released again");
+
+    // The lagging subscriber skips what was released, rather than reading zeroed slots
+    buffer = (int*)srb_subscriber_get_next_unread_buffer(subscriber);
+    check(buffer && (read_value(subscriber, buffer) == newest), "lagging subscriber skips to the most recent buffer");
+    check(srb_subscriber_get_next_unread_buffer(subscriber) == NULL, "nothing else to read");
+    uint64_t sequence = 0;
+    buffer = (int*)srb_subscriber_seek_timestamp(subscriber, 0, &sequence);
+    check(buffer && (read_value(subscriber, buffer) == newest), "seek lands on the oldest intact buffer");
+    check(sequence == producer->shared->reclaim_floor, "seek gives the oldest intact sequence");
+
+    // Writing again commits the released slots lazily, and reading carries on in order
+    publish(producer, 4);
+    check(producer->shared->reclaim_state == SRB_RING_ACTIVE, "ring active again");
+    uint64_t recommitted = srb_get_ring_resident_size(producer);
+    check((recommitted > released) && (recommitted <= released + 4 * BUFFER_SIZE), "written slots are committed again");
+    for (int expected = newest + 1; expected <= next_value - 2; expected++) {
+        buffer = (int*)srb_subscriber_get_next_unread_buffer(subscriber);
+        check(buffer && (read_value(subscriber, buffer) == expected), "new buffers read in order");
+    }
+
+    srb_close(c);
+    srb_close(h);
+
+    if (failures) {
+        fprintf(stderr, "%d reclaim checks failed.\n", failures);
+        return 1;
+    }
+    printf("All reclaim checks passed.\n");
+    return 0;
+}
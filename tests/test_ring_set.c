@@ -0,0 +1,119 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2025-present Edward Andrew Flick.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include "test_check.h"
+#include <pthread.h>
+#include <shm_ringbuffers.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NUM_RINGS (50)
+
+struct ShmRingBuffer* producer_rings;
+
+double get_cur_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec + (double)ts.tv_nsec / 1000000000.0);
+}
+
+void* produce(void* arg)
+{
+    int ring = *(int*)arg;
+    usleep(100000);
+    *(int*)srb_producer_next_write_buffer(producer_rings + ring) = ring;
+    *(int*)srb_producer_next_write_buffer(producer_rings + ring) = ring; // Publishes the first
+    return NULL;
+}
+
+int main(void)
+{
+    struct ShmRingBufferDef srbd[NUM_RINGS];
+    char names[NUM_RINGS][16];
+    for (int i = 0; i < NUM_RINGS; i++) {
+        snprintf(names[i], sizeof(names[i]), "ring%d", i);
+        srbd[i] = (struct ShmRingBufferDef) { .buffer_size = sizeof(int), .num_buffers = 3, .description = names[i] };
+    }
+
+    SRBHandle h = srb_host_new("/srb_test_ring_set", NUM_RINGS, srbd);
+    if (h == NULL) {
+        return 1;
+    }
+    SRBHandle c = srb_client_new("/srb_test_ring_set");
+    if (c == NULL) {
+        srb_close(h);
+        return 1;
+    }
+    srb_get_rings(h, &producer_rings);
+
+    struct ShmRingBuffer* rings;
+    srb_get_rings(c, &rings);
+    struct ShmRingBufferSet* set = srb_ring_set_new();
+    for (int i = 0; i < NUM_RINGS; i++) {
+        check(srb_ring_set_add(set, rings + i) == 0, "add ring to set");
+    }
+    check(srb_ring_set_add(set, producer_rings) == -1, "reject ring from another mapping");
+
+    struct ShmRingBuffer* ready[NUM_RINGS];
+    double start = get_cur_time();
+    check(srb_ring_set_wait(set, ready, NUM_RINGS, 50) == 0, "nothing ready before producing");
+    check(get_cur_time() - start >= 0.045, "wait honours its timeout");
+
+    // A blocked wait wakes up when another thread publishes to one ring
+    int ring = 37;
+    pthread_t thread;
+    pthread_create(&thread, NULL, produce, &ring);
+    start = get_cur_time();
+    unsigned int num_ready = srb_ring_set_wait(set, ready, NUM_RINGS, -1);
+    check(get_cur_time() - start < 1.0, "woken by the doorbell");
+    check((num_ready == 1) && (ready[0] == rings + ring), "only the written ring is ready");
+    pthread_join(thread, NULL);
+
+    int* got = (int*)srb_subscriber_get_next_unread_buffer(ready[0]);
+    check(got && (*got == ring), "ready ring has the published buffer");
+    check(srb_ring_set_wait(set, ready, NUM_RINGS, 0) == 0, "each advance is reported once");
+
+    // More ready rings than space in ready are handed out fairly over successive calls
+    for (int i = 0; i < NUM_RINGS; i++) {
+        srb_producer_next_write_buffer(producer_rings + i);
+    }
+    num_ready = srb_ring_set_wait(set, ready, 30, 0);
+    num_ready += srb_ring_set_wait(set, ready, 30, 0);
+    check(num_ready == NUM_RINGS, "all advanced rings are reported across calls");
+
+    srb_ring_set_free(set);
+    srb_close(c);
+    srb_close(h);
+
+    if (failures) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("All ring set checks passed.\n");
+    return 0;
+}
@@ -0,0 +1,198 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2025-present Edward Andrew Flick.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include "test_check.h"
+#include <inttypes.h>
+#include <pthread.h>
+#include <shm_ringbuffers.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CAPACITY (1000)
+#define VALUE_WORDS (32)
+#define NUM_HAMMER_UPDATES (200000)
+
+struct Value {
+    uint64_t words[VALUE_WORDS]; // All the same, so a torn read shows up as a mismatch
+};
+
+void set_value(struct Value* value, uint64_t word)
+{
+    for (int i = 0; i < VALUE_WORDS; i++) {
+        value->words[i] = word;
+    }
+}
+
+int is_consistent(struct Value* value)
+{
+    for (int i = 1; i < VALUE_WORDS; i++) {
+        if (value->words[i] != value->words[0]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+struct ShmStateTable* hammered;
+int hammering = 1;
+
+void* hammer(void* arg)
+{
+    (void)arg;
+    struct Value value;
+    for (uint64_t i = 1; i <= NUM_HAMMER_UPDATES; i++) {
+        set_value(&value, i);
+        srb_state_table_update(hammered, i % 4, &value);
+    }
+    __atomic_store_n(&hammering, 0, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+int main(void)
+{
+    struct ShmRingBufferDef srbd[1] = {
+        { .buffer_size = 64, .num_buffers = 3, .description = "frames" },
+    };
+    SRBHandle h = srb_host_new("/srb_test_state_table", 1, srbd);
+    if (h == NULL) {
+        return 1;
+    }
+    SRBHandle c = srb_client_new("/srb_test_state_table");
+    if (c == NULL) {
+        srb_close(h);
+        return 1;
+    }
+    check(srb_get_state_table(c, "prices") == NULL, "no table before it is added");
+
+    struct ShmStateTableDef def = { .capacity = CAPACITY, .value_size = sizeof(struct Value), .description = "prices" };
+    struct ShmStateTable* table = srb_host_add_state_table(h, &def);
+    check(table != NULL, "add a table");
+    check(srb_host_add_state_table(h, &def) == NULL, "descriptions are unique");
+    check(srb_host_add_state_table(c, &def) == NULL, "only the host adds tables");
+
+    // The client picks up the table from the grown segment
+    struct ShmStateTable* reader = srb_get_state_table(c, "prices");
+    check(reader != NULL, "client finds the table");
+    check(srb_get_state_table(c, "prices") == reader, "lookups are cached");
+    struct Value value;
+    check(srb_state_table_read(reader, 42, &value, NULL) == 0, "missing key is not found");
+    check(srb_state_table_get_change_sequence(reader) == 0, "nothing changed yet");
+
+    // Fill to capacity, with keys that would collide under a poor hash
+    int all_added = 1;
+    for (uint64_t key = 0; key < CAPACITY; key++) {
+        set_value(&value, key * 1000);
+        all_added &= srb_state_table_update(table, key << 32, &value) == 0;
+    }
+    check(all_added, "keys up to capacity are added");
+    set_value(&value, 1);
+    check(srb_state_table_update(table, 12345, &value) == -1, "a new key past capacity is refused");
+    check(srb_state_table_update(table, 7ull << 32, &value) == 0, "existing keys still update when full");
+    check(srb_state_table_get_change_sequence(reader) == CAPACITY + 1, "every update counted");
+
+    int all_read = 1;
+    uint64_t changed = 0;
+    for (uint64_t key = 0; key < CAPACITY; key++) {
+        all_read &= (srb_state_table_read(reader, key << 32, &value, &changed) == 1) && is_consistent(&value);
+        all_read &= (key == 7) ? ((value.words[0] == 1) && (changed == CAPACITY + 1)) : ((value.words[0] == key * 1000) && (changed == key + 1));
+    }
+    check(all_read, "client reads each key's latest value and change");
+
+    // Changes are reported once per key, oldest first, and in batches
+    uint64_t since = 0;
+    uint64_t keys[CAPACITY];
+    unsigned int num_changes = srb_state_table_get_changes(reader, &since, keys, 10);
+    // Key 7 changed again later, so it is skipped here
+    check((num_changes == 10) && (since == 11) && (keys[0] == 0) && (keys[9] == (10ull << 32)), "first batch of changes");
+    unsigned int total = num_changes;
+    int updated_last = 0;
+    while ((num_changes = srb_state_table_get_changes(reader, &since, keys, 10)) > 0) {
+        total += num_changes;
+        updated_last = keys[num_changes - 1] == (7ull << 32);
+    }
+    check(total == CAPACITY, "each changed key reported once");
+    check(updated_last && (since == CAPACITY + 1), "the updated key is reported at its latest change");
+
+    // A few changes since then come from the log
+    for (uint64_t key = 3; key < 6; key++) {
+        srb_state_table_update(table, key << 32, &value);
+        srb_state_table_update(table, key << 32, &value);
+    }
+    num_changes = srb_state_table_get_changes(reader, &since, keys, CAPACITY);
+    check((num_changes == 3) && (keys[0] == (3ull << 32)) && (keys[2] == (5ull << 32)), "recent changes each reported once");
+    check(since == CAPACITY + 7, "since advanced to the latest change");
+
+    // A reader that fell further behind than the log reaches gets the same answer from a scan
+    uint64_t behind = CAPACITY + 7;
+    for (int i = 0; i < 5000; i++) {
+        srb_state_table_update(table, (uint64_t)(i % 50) << 32, &value);
+    }
+    num_changes = srb_state_table_get_changes(reader, &behind, keys, 20);
+    check((num_changes == 20) && (keys[0] == (0ull << 32)) && (keys[19] == (19ull << 32)), "scan reports the oldest changes first");
+    total = num_changes;
+    while ((num_changes = srb_state_table_get_changes(reader, &behind, keys, 20)) > 0) {
+        total += num_changes;
+    }
+    check((total == 50) && (behind == srb_state_table_get_change_sequence(reader)), "scan reports every changed key once");
+
+    // Reads stay consistent while another thread updates the same keys as fast as it can
+    struct ShmStateTableDef hammer_def = { .capacity = 4, .value_size = sizeof(struct Value), .description = "hammered" };
+    hammered = srb_host_add_state_table(h, &hammer_def);
+    set_value(&value, 0);
+    for (uint64_t key = 0; key < 4; key++) {
+        srb_state_table_update(hammered, key, &value);
+    }
+    struct ShmStateTable* hammered_reader = srb_get_state_table(c, "hammered");
+    check(hammered_reader != NULL, "client finds a second table");
+    check(srb_get_state_table(c, "prices") == reader, "first table still found");
+    pthread_t thread;
+    pthread_create(&thread, NULL, hammer, NULL);
+    int num_torn = 0;
+    uint64_t num_reads = 0;
+    uint64_t last_seen[4] = { 0, 0, 0, 0 };
+    int went_back = 0;
+    while (__atomic_load_n(&hammering, __ATOMIC_ACQUIRE)) {
+        uint64_t key = num_reads++ % 4;
+        srb_state_table_read(hammered_reader, key, &value, NULL);
+        num_torn += !is_consistent(&value);
+        went_back |= value.words[0] < last_seen[key];
+        last_seen[key] = value.words[0];
+    }
+    pthread_join(thread, NULL);
+    check(num_torn == 0, "no torn reads while updating");
+    check(!went_back, "a key's value never goes back");
+    check(srb_state_table_read(hammered_reader, NUM_HAMMER_UPDATES % 4, &value, NULL) && (value.words[0] == NUM_HAMMER_UPDATES), "last update is read");
+    printf("%" PRIu64 " reads during %d updates.\n", num_reads, NUM_HAMMER_UPDATES);
+
+    srb_close(c);
+    srb_close(h);
+
+    if (failures) {
+        fprintf(stderr, "%d state table checks failed.\n", failures);
+        return 1;
+    }
+    printf("All state table checks passed.\n");
+    return 0;
+}
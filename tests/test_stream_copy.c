@@ -0,0 +1,88 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2025-present Edward Andrew Flick.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include "test_check.h"
+#include <shm_ringbuffers.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BUFFER_SIZE (1024 * 1024)
+
+int main(void)
+{
+    struct ShmRingBufferDef srbd = { .buffer_size = BUFFER_SIZE, .num_buffers = 4, .description = "frames" };
+    SRBHandle h = srb_host_new("/srb_test_stream_copy", 1, &srbd);
+    if (h == NULL) {
+        return 1;
+    }
+    struct ShmRingBuffer* ring;
+    srb_get_rings(h, &ring);
+
+    uint8_t* src = malloc(BUFFER_SIZE);
+    for (int i = 0; i < BUFFER_SIZE; i++) {
+        src[i] = (uint8_t)(i * 7 + 3);
+    }
+
+    // Unaligned starts and odd lengths exercise the regular store head and tail around the streamed body
+    uint64_t offsets[] = { 0, 1, 15, 33, 63 };
+    uint64_t sizes[] = { 100, 4096, 4097, 65536 + 17, BUFFER_SIZE - 64 };
+    uint8_t* buffer = srb_producer_next_write_buffer(ring);
+    for (int o = 0; o < 5; o++) {
+        for (int s = 0; s < 5; s++) {
+            memset(buffer, 0xEE, BUFFER_SIZE);
+            srb_producer_stream_copy(buffer + offsets[o], src, sizes[s]);
+            check(memcmp(buffer + offsets[o], src, sizes[s]) == 0, "stream copy matches memcpy");
+            check(buffer[offsets[o] + sizes[s]] == 0xEE, "stream copy stops at size");
+            check((offsets[o] == 0) || (buffer[offsets[o] - 1] == 0xEE), "stream copy starts at buffer");
+
+            srb_producer_stream_fill(buffer + offsets[o], 0x42, sizes[s]);
+            int filled = 1;
+            for (uint64_t i = 0; i < sizes[s]; i++) {
+                filled &= (buffer[offsets[o] + i] == 0x42);
+            }
+            check(filled, "stream fill sets every byte");
+            check(buffer[offsets[o] + sizes[s]] == 0xEE, "stream fill stops at size");
+        }
+    }
+
+    // Prefetching looks at the next unread buffer without consuming it
+    srb_producer_next_write_buffer(ring);
+    srb_subscriber_get_next_unread_buffer(ring);
+    srb_producer_next_write_buffer(ring);
+    uint64_t last_read = ring->last_read_ring_pos;
+    srb_subscriber_prefetch_next_unread_buffer(ring, BUFFER_SIZE * 2);
+    check(ring->last_read_ring_pos == last_read, "prefetch leaves the read position alone");
+    check(srb_subscriber_get_next_unread_buffer(ring) != NULL, "prefetched buffer is still unread");
+
+    free(src);
+    srb_close(h);
+
+    if (failures) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("All stream copy checks passed.\n");
+    return 0;
+}
@@ -0,0 +1,127 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2025-present Edward Andrew Flick.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include "test_check.h"
+#include <shm_ringbuffers.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NUM_BUFFERS (64)
+#define NUM_WRITES (200)
+
+uint64_t seek_value(struct ShmRingBuffer* ring, uint64_t timestamp, uint64_t* sequence)
+{
+    uint8_t* buffer = srb_subscriber_seek_timestamp(ring, timestamp, sequence);
+    uint64_t value = 0;
+    if (buffer) {
+        memcpy(&value, buffer, sizeof(value));
+    }
+    return value;
+}
+
+int main(void)
+{
+    struct ShmRingBufferDef srbd[3] = {
+        { .buffer_size = sizeof(uint64_t), .num_buffers = NUM_BUFFERS, .description = "imu", .timestamped = 1 },
+        { .buffer_size = sizeof(uint64_t), .num_buffers = 8, .description = "camera", .timestamped = 1, .multiplexed = 1 },
+        { .buffer_size = sizeof(uint64_t), .num_buffers = 8, .description = "plain" },
+    };
+
+    SRBHandle h = srb_host_new("/srb_test_timestamps", 3, srbd);
+    if (h == NULL) {
+        return 1;
+    }
+    SRBHandle c = srb_client_new("/srb_test_timestamps");
+    if (c == NULL) {
+        srb_close(h);
+        return 1;
+    }
+    struct ShmRingBuffer* producer_rings;
+    srb_get_rings(h, &producer_rings);
+    struct ShmRingBuffer* rings;
+    srb_get_rings(c, &rings);
+    uint64_t sequence = 0;
+
+    check(srb_subscriber_seek_timestamp(rings, 1000, &sequence) == NULL, "no buffers yet");
+    check(srb_subscriber_seek_timestamp(rings + 2, 1000, &sequence) == NULL, "ring without timestamps");
+
+    // Value i stamped at time 1000 * i, wrapping the ring a few times
+    for (uint64_t i = 1; i <= NUM_WRITES; i++) {
+        uint8_t* buffer = srb_producer_next_write_buffer(producer_rings);
+        memcpy(buffer, &i, sizeof(i));
+        srb_producer_set_buffer_timestamp(producer_rings, 1000 * i);
+    }
+    srb_producer_next_write_buffer(producer_rings); // Publishes the last value
+
+    uint64_t oldest = NUM_WRITES - (NUM_BUFFERS - 2);
+    check(seek_value(rings, 150000, &sequence) == 150, "exact match");
+    check(seek_value(rings, 150499, &sequence) == 150, "closest below");
+    check(seek_value(rings, 150501, &sequence) == 151, "closest above");
+    check(seek_value(rings, 150500, &sequence) == 150, "tie goes to earlier buffer");
+    check(seek_value(rings, 0, &sequence) == oldest, "before the window gives the oldest intact buffer");
+    check(seek_value(rings, 1000000000, &sequence) == NUM_WRITES, "after the window gives the newest buffer");
+    uint64_t newest_sequence = srb_subscriber_get_most_recent_buffer_id(rings) + NUM_BUFFERS - 1;
+    check(sequence == newest_sequence, "sequence of newest buffer");
+    uint64_t previous_sequence = sequence;
+    seek_value(rings, 199000, &sequence);
+    check(sequence == previous_sequence - 1, "sequences are consecutive");
+    uint8_t* buffer = srb_subscriber_seek_timestamp(rings, 170200, &sequence);
+    check(srb_subscriber_get_buffer_timestamp(rings, buffer) == 170000, "timestamp of found buffer");
+    check(srb_subscriber_get_next_unread_buffer(rings) != NULL, "seeking does not move the read position");
+
+    // Without srb_producer_set_buffer_timestamp buffers are stamped with the time they were started
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t before = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    for (uint16_t i = 1; i <= 5; i++) {
+        uint64_t value = i;
+        memcpy(srb_producer_next_write_topic_buffer(producer_rings + 1, i), &value, sizeof(value));
+    }
+    srb_producer_next_write_buffer(producer_rings + 1);
+    buffer = srb_subscriber_seek_timestamp(rings + 1, before, &sequence);
+    check(buffer != NULL && srb_subscriber_get_buffer_topic(rings + 1, buffer) == 1, "default timestamps follow writes");
+    check(srb_subscriber_get_buffer_timestamp(rings + 1, buffer) >= before, "default timestamp is monotonic time");
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    buffer = srb_subscriber_seek_timestamp(rings + 1, (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec, &sequence);
+    check(buffer != NULL && srb_subscriber_get_buffer_topic(rings + 1, buffer) == 5, "now gives the newest buffer");
+
+    // Resizing keeps the timestamp of the carried over buffer
+    struct ShmRingBuffer* resized = srb_host_resize_ring(h, "imu", 16);
+    check(resized != NULL && resized->timestamps != NULL, "resized ring keeps its timestamp index");
+    if (resized) {
+        check(seek_value(resized, 0, &sequence) == NUM_WRITES, "resized ring holds newest buffer");
+        buffer = srb_subscriber_get_most_recent_buffer(resized);
+        check(srb_subscriber_get_buffer_timestamp(resized, buffer) == 1000 * NUM_WRITES, "resized ring keeps timestamp");
+    }
+
+    srb_close(c);
+    srb_close(h);
+
+    if (failures == 0) {
+        printf("All timestamp checks passed.\n");
+    }
+    return failures == 0 ? 0 : 1;
+}
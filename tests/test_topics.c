@@ -0,0 +1,101 @@
+/******************************************************************************
+ *
+ * Copyright (c) 2025-present Edward Andrew Flick.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include "test_check.h"
+#include <shm_ringbuffers.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_BUFFERS (37)
+#define NUM_TOPICS (5)
+
+int main(void)
+{
+    struct ShmRingBufferDef srbd = {
+        .buffer_size = sizeof(uint32_t),
+        .num_buffers = NUM_BUFFERS,
+        .description = "topics",
+        .multiplexed = 1,
+    };
+
+    SRBHandle h = srb_host_new("/srb_test_topics", 1, &srbd);
+    if (h == NULL) {
+        return 1;
+    }
+    SRBHandle c = srb_client_new("/srb_test_topics");
+    if (c == NULL) {
+        srb_close(h);
+        return 1;
+    }
+    struct ShmRingBuffer* producer = srb_get_ring_by_description(h, "topics");
+    struct ShmRingBuffer* subscriber = srb_get_ring_by_description(c, "topics");
+    check(subscriber->topic_ids != NULL, "client sees the ring as multiplexed");
+
+    uint16_t wanted[2] = { 1, 3 };
+    check(srb_subscriber_set_topic_filter(subscriber, 2, wanted) == 0, "set topic filter");
+
+    // Publish a few laps worth of buffers in batches smaller than the ring, reading after each batch
+    uint32_t next_expected = 0;
+    for (uint32_t seq = 0; seq < NUM_BUFFERS * 4; seq++) {
+        uint32_t* buffer = (uint32_t*)srb_producer_next_write_topic_buffer(producer, seq % NUM_TOPICS);
+        *buffer = seq;
+        if ((seq % 20) != 19) {
+            continue;
+        }
+        uint8_t* b;
+        while ((b = srb_subscriber_get_next_unread_buffer(subscriber))) {
+            uint32_t got = *(uint32_t*)b;
+            uint16_t topic = srb_subscriber_get_buffer_topic(subscriber, b);
+            check((topic == 1) || (topic == 3), "only filtered topics are returned");
+            check(topic == (got % NUM_TOPICS), "topic matches the buffer it was written with");
+            if (next_expected) {
+                while ((next_expected % NUM_TOPICS != 1) && (next_expected % NUM_TOPICS != 3)) {
+                    next_expected++;
+                }
+                check(got == next_expected, "no filtered buffer is skipped");
+            }
+            next_expected = got + 1;
+        }
+    }
+
+    // Falling a full lap behind resumes from the oldest intact buffer of a wanted topic
+    for (uint32_t seq = 0; seq < NUM_BUFFERS * 2; seq++) {
+        *(uint32_t*)srb_producer_next_write_topic_buffer(producer, 4) = 0;
+    }
+    uint8_t* b = srb_subscriber_get_next_unread_buffer(subscriber);
+    check(b == NULL, "a lap of unwanted topics returns nothing");
+
+    check(srb_subscriber_set_topic_filter(subscriber, SRB_MAX_TOPIC_FILTER + 1, wanted) == -1, "reject oversized filter");
+
+    srb_close(c);
+    srb_close(h);
+
+    if (failures) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("All topic checks passed.\n");
+    return 0;
+}